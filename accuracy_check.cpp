@@ -0,0 +1,90 @@
+// Accuracy sweep driver: runs the IEC 62053-21 style grid of load points on a
+// pool of engines and prints the error table as CSV.
+//
+//   accuracy_check [--three-phase] [--voltage V] [--ib A] [--imax A] [--frequency Hz]
+//                  [--class C] [--duration S] [--step S] [--threads N] [--out FILE]
+
+#include "accuracy_sweep.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: accuracy_check [--three-phase] [--voltage V] [--ib A] [--imax A] [--frequency Hz]\n"
+                 "                      [--class C] [--duration S] [--step S] [--threads N] [--out FILE]\n");
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    bool threePhase = false;
+    double voltage = 230.0, basicCurrent = 5.0, maxCurrent = 60.0, frequency = 50.0;
+    AccuracySweepConfig config = {10.0, 0.02, 1.0, 0};
+    const char* outPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--three-phase") == 0) {
+            threePhase = true;
+        } else if (std::strcmp(argv[i], "--voltage") == 0 && hasValue) {
+            voltage = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--ib") == 0 && hasValue) {
+            basicCurrent = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--imax") == 0 && hasValue) {
+            maxCurrent = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--frequency") == 0 && hasValue) {
+            frequency = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--class") == 0 && hasValue) {
+            config.accuracyClass = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--duration") == 0 && hasValue) {
+            config.duration = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--step") == 0 && hasValue) {
+            config.timeStep = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            config.threadCount = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--out") == 0 && hasValue) {
+            outPath = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (voltage <= 0.0 || basicCurrent <= 0.0 || maxCurrent < basicCurrent || frequency <= 0.0 ||
+        config.duration <= 0.0 || config.timeStep <= 0.0 || config.accuracyClass <= 0.0) {
+        usage();
+        return 2;
+    }
+
+    AccuracySweep sweep;
+    sweep.setConfig(config);
+    sweep.buildIEC62053Grid(threePhase, voltage, basicCurrent, maxCurrent, frequency);
+    std::vector<AccuracySweepResult> results = sweep.run();
+
+    if (outPath) {
+        std::ofstream out(outPath);
+        if (!out) {
+            std::fprintf(stderr, "cannot write %s\n", outPath);
+            return 2;
+        }
+        AccuracySweep::writeErrorTable(out, results);
+    } else {
+        AccuracySweep::writeErrorTable(std::cout, results);
+    }
+
+    size_t failed = 0;
+    double worst = 0.0;
+    for (const auto& result : results) {
+        if (!result.passed) failed++;
+        worst = std::max(worst, std::abs(result.errorPercent));
+    }
+    std::fprintf(stderr, "%s: %zu of %zu points within class %g limits, worst error %.4f%%\n",
+                 failed ? "FAIL" : "PASS", results.size() - failed, results.size(), config.accuracyClass, worst);
+    return failed ? 1 : 0;
+}
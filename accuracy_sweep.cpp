@@ -0,0 +1,171 @@
+
+#include "accuracy_sweep.h"
+#include "metering_engine.h"
+#include "harmonic_synthesizer.h"
+#include "parallel_for.h"
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+AccuracySweep::AccuracySweep()
+    : m_config{10.0, 0.02, 1.0, 0}
+    , m_nominalVoltage(230.0)
+    , m_nominalFrequency(50.0)
+    , m_basicCurrent(5.0)
+{
+}
+
+void AccuracySweep::buildIEC62053Grid(bool threePhase, double nominalVoltage, double basicCurrent,
+                                      double maxCurrent, double nominalFrequency)
+{
+    m_nominalVoltage = nominalVoltage;
+    m_nominalFrequency = nominalFrequency;
+    m_basicCurrent = basicCurrent;
+
+    const double currentFactors[] = {0.05, 0.1, 0.2, 0.5, 1.0};
+    const double powerFactors[] = {1.0, 0.8, 0.5};
+    const double voltageFactors[] = {0.9, 1.0, 1.1};
+    const double frequencyFactors[] = {0.98, 1.0, 1.02};
+    const int harmonicOrders[] = {0, 3, 5};
+
+    std::vector<double> currents;
+    for (double factor : currentFactors) {
+        currents.push_back(basicCurrent * factor);
+    }
+    currents.push_back(maxCurrent);
+
+    for (double current : currents) {
+        for (double pf : powerFactors) {
+            // 0.05 Ib is only specified at unity power factor
+            if (pf < 1.0 && current < 0.1 * basicCurrent) continue;
+
+            for (double vf : voltageFactors) {
+                for (double ff : frequencyFactors) {
+                    for (int harmonic : harmonicOrders) {
+                        AccuracyTestPoint point;
+                        point.threePhase = threePhase;
+                        point.voltage = nominalVoltage * vf;
+                        point.current = current;
+                        point.powerFactor = pf;
+                        point.frequency = nominalFrequency * ff;
+                        point.harmonicOrder = harmonic;
+                        point.harmonicMagnitude = harmonic > 0 ? 0.1 : 0.0;
+
+                        std::ostringstream label;
+                        label << std::fixed << std::setprecision(2)
+                              << current / basicCurrent << "Ib PF" << pf
+                              << " " << vf * 100.0 << "%Un " << point.frequency << "Hz";
+                        if (harmonic > 0) {
+                            label << " H" << harmonic;
+                        }
+                        point.label = label.str();
+
+                        m_points.push_back(point);
+                    }
+                }
+            }
+        }
+    }
+}
+
+std::vector<AccuracySweepResult> AccuracySweep::run()
+{
+    std::vector<AccuracySweepResult> results(m_points.size());
+
+    // Every point owns its engine, so no state is shared
+    parallelFor(m_points.size(), m_config.threadCount, [&](size_t i) {
+        results[i] = runPoint(m_points[i]);
+    });
+
+    return results;
+}
+
+AccuracySweepResult AccuracySweep::runPoint(const AccuracyTestPoint& point) const
+{
+    MeteringEngine engine;
+    engine.configure(point.threePhase, point.voltage, point.current, point.frequency, point.powerFactor);
+    if (point.harmonicOrder > 1) {
+        engine.injectHarmonics(point.harmonicOrder, point.harmonicMagnitude);
+    }
+
+    int steps = static_cast<int>(std::lround(m_config.duration / m_config.timeStep));
+    for (int i = 0; i < steps; i++) {
+        engine.update(m_config.timeStep);
+    }
+
+    AccuracySweepResult result;
+    result.point = point;
+    result.referenceEnergy = referenceEnergy(point, engine.getHarmonicSynthesizer(), steps * m_config.timeStep);
+    result.registeredEnergy = engine.getBasicMeasurements().energy;
+    result.errorPercent = (result.referenceEnergy != 0.0)
+        ? (result.registeredEnergy - result.referenceEnergy) / result.referenceEnergy * 100.0
+        : 0.0;
+    result.limitPercent = errorLimit(point);
+    result.passed = std::abs(result.errorPercent) <= result.limitPercent;
+
+    return result;
+}
+
+double AccuracySweep::referenceEnergy(const AccuracyTestPoint& point, const HarmonicSynthesizer& harmonics,
+                                      double duration)
+{
+    // The energy is integrated from the samples, so harmonics injected on both voltage
+    // and current add V_h * I_h * cos(phi_h); both phases are against the voltage fundamental
+    const double degrees = M_PI / 180.0;
+    const int phases = point.threePhase ? 3 : 1;
+    double totalPower = 0.0;
+    for (int ph = 0; ph < phases; ph++) {
+        double perUnit = point.powerFactor;
+        for (int h = 2; h <= HarmonicSynthesizer::MAX_ORDER; h++) {
+            double v = harmonics.getMagnitude(HarmonicChannel::Voltage, ph, h);
+            double i = harmonics.getMagnitude(HarmonicChannel::Current, ph, h);
+            if (v == 0.0 || i == 0.0) continue;
+            double phi = (harmonics.getPhase(HarmonicChannel::Voltage, ph, h) -
+                          harmonics.getPhase(HarmonicChannel::Current, ph, h)) * degrees;
+            perUnit += v * i * std::cos(phi);
+        }
+        totalPower += point.voltage * point.current * perUnit;
+    }
+
+    return totalPower * duration / 3600.0; // Wh
+}
+
+double AccuracySweep::errorLimit(const AccuracyTestPoint& point) const
+{
+    // Base limits per IEC 62053-21; widened at the low-current end of the range
+    double limit = m_config.accuracyClass;
+    double lowCurrentBoundary = (point.powerFactor < 1.0) ? 0.2 : 0.1;
+    if (point.current < lowCurrentBoundary * m_basicCurrent) {
+        limit += 0.5 * m_config.accuracyClass;
+    }
+
+    // Additional variation allowed for each influence quantity away from reference
+    if (std::abs(point.voltage - m_nominalVoltage) > 1e-9) {
+        limit += 0.7 * m_config.accuracyClass;
+    }
+    if (std::abs(point.frequency - m_nominalFrequency) > 1e-9) {
+        limit += 0.5 * m_config.accuracyClass;
+    }
+    if (point.harmonicOrder > 1) {
+        limit += 0.8 * m_config.accuracyClass;
+    }
+
+    return limit;
+}
+
+void AccuracySweep::writeErrorTable(std::ostream& out, const std::vector<AccuracySweepResult>& results)
+{
+    out << "Point,Voltage,Current,PF,Frequency,Harmonic,Reference (Wh),Registered (Wh),Error (%),Limit (%),Result\n";
+
+    for (const auto& result : results) {
+        const auto& p = result.point;
+        out << '"' << p.label << '"' << ','
+            << p.voltage << ',' << p.current << ',' << p.powerFactor << ','
+            << p.frequency << ',' << p.harmonicOrder << ','
+            << std::setprecision(9) << result.referenceEnergy << ',' << result.registeredEnergy << ','
+            << std::setprecision(4) << result.errorPercent << ',' << result.limitPercent << ','
+            << (result.passed ? "PASS" : "FAIL") << '\n';
+        out << std::setprecision(6);
+    }
+}
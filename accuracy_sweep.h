@@ -0,0 +1,73 @@
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+class HarmonicSynthesizer;
+
+// One load point of an accuracy test grid
+struct AccuracyTestPoint {
+    std::string label;
+    bool threePhase;
+    double voltage;            // V RMS
+    double current;            // A RMS
+    double powerFactor;        // lagging, 0..1
+    double frequency;          // Hz
+    int harmonicOrder;         // 0 = no harmonic content
+    double harmonicMagnitude;  // relative to fundamental
+};
+
+struct AccuracySweepResult {
+    AccuracyTestPoint point;
+    double referenceEnergy;    // Wh, analytic
+    double registeredEnergy;   // Wh, from MeteringEngine
+    double errorPercent;
+    double limitPercent;
+    bool passed;
+};
+
+struct AccuracySweepConfig {
+    double duration;           // simulated seconds per point
+    double timeStep;           // fast-forward update step in seconds
+    double accuracyClass;      // 1.0 = class 1, 2.0 = class 2, ...
+    unsigned int threadCount;  // 0 = hardware concurrency
+};
+
+class AccuracySweep
+{
+public:
+    AccuracySweep();
+
+    void setConfig(const AccuracySweepConfig& config) { m_config = config; }
+    const AccuracySweepConfig& getConfig() const { return m_config; }
+
+    void addPoint(const AccuracyTestPoint& point) { m_points.push_back(point); }
+    void clearPoints() { m_points.clear(); }
+    const std::vector<AccuracyTestPoint>& getPoints() const { return m_points; }
+
+    // IEC 62053-21 style grid: current (5%Ib..Imax) x PF x voltage x frequency x harmonics
+    void buildIEC62053Grid(bool threePhase, double nominalVoltage, double basicCurrent,
+                           double maxCurrent, double nominalFrequency);
+
+    // Runs every point on its own MeteringEngine across a pool of worker threads
+    std::vector<AccuracySweepResult> run();
+
+    // Fundamental plus the active power of every harmonic order present on both voltage and current
+    static double referenceEnergy(const AccuracyTestPoint& point, const HarmonicSynthesizer& harmonics, double duration);
+    double errorLimit(const AccuracyTestPoint& point) const;
+
+    static void writeErrorTable(std::ostream& out, const std::vector<AccuracySweepResult>& results);
+
+private:
+    AccuracySweepResult runPoint(const AccuracyTestPoint& point) const;
+
+    AccuracySweepConfig m_config;
+    std::vector<AccuracyTestPoint> m_points;
+
+    // Rated values used to classify load points when computing error limits
+    double m_nominalVoltage;
+    double m_nominalFrequency;
+    double m_basicCurrent;
+};
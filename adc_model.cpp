@@ -0,0 +1,239 @@
+
+#include "adc_model.h"
+#include "metering_engine.h"
+#include "mcu_emulator.h"
+#include <algorithm>
+#include <cmath>
+
+ADCModel::ADCModel()
+    : m_sampleRate(12800.0)
+    , m_noiseGenerator(0x41444331ULL)
+    , m_blockLength(0)
+{
+    // Defaults match the MCU's built-in converter: 12 bits, 3.3 V, single supply
+    m_converter.resolution = 12;
+    m_converter.reference = 3.3;
+    m_converter.bipolar = false;
+    m_converter.apertureDelay = 0.0;
+    m_converter.conversionTime = 0.0;
+    m_converter.inl = 0.0;
+    m_converter.dnl = 0.0;
+    m_converter.noise = 0.0;
+    m_converter.pgaGains = {1.0};
+
+    rebuildTables();
+}
+
+void ADCModel::setConverter(const ADCConverterConfig& config)
+{
+    m_converter = config;
+    m_converter.resolution = std::min(std::max(m_converter.resolution, 8), 24);
+    if (m_converter.pgaGains.empty()) {
+        m_converter.pgaGains = {1.0};
+    }
+
+    rebuildTables();
+    updateDelayFilters();
+}
+
+int ADCModel::addInput(const ADCInputConfig& input)
+{
+    m_inputs.push_back(input);
+    m_inputs.back().phase = std::min(std::max(input.phase, 0), 2);
+    m_history.resize(m_inputs.size() * HISTORY, 0.0);
+    m_codes.resize(m_inputs.size());
+    m_pinVoltage.resize(m_inputs.size());
+
+    updateDelayFilters();
+    return static_cast<int>(m_inputs.size()) - 1;
+}
+
+void ADCModel::clearInputs()
+{
+    m_inputs.clear();
+    m_history.clear();
+    m_codes.clear();
+    m_pinVoltage.clear();
+    m_delayTaps.clear();
+    m_delayWhole.clear();
+    m_blockLength = 0;
+}
+
+void ADCModel::setPGA(int input, int pgaIndex)
+{
+    if (input >= 0 && input < static_cast<int>(m_inputs.size())) {
+        m_inputs[input].pga = pgaIndex;
+    }
+}
+
+void ADCModel::seed(uint64_t seed)
+{
+    m_noiseGenerator.seed(seed);
+    rebuildTables();
+}
+
+void ADCModel::reset()
+{
+    std::fill(m_history.begin(), m_history.end(), 0.0);
+    m_blockLength = 0;
+}
+
+double ADCModel::pgaGain(const ADCInputConfig& input) const
+{
+    int index = std::min(std::max(input.pga, 0), static_cast<int>(m_converter.pgaGains.size()) - 1);
+    return m_converter.pgaGains[index];
+}
+
+void ADCModel::rebuildTables()
+{
+    m_dnlTable.clear();
+
+    // A per-code transition table is only practical for SAR-class resolutions
+    if (m_converter.dnl > 0.0 && m_converter.resolution <= 16) {
+        m_dnlTable.resize(size_t(1) << m_converter.resolution);
+        for (auto& error : m_dnlTable) {
+            // Transition errors within +-dnl/2 keep every code width within +-dnl
+            error = (m_noiseGenerator.nextUniform() - 0.5) * m_converter.dnl;
+        }
+    }
+}
+
+void ADCModel::updateDelayFilters()
+{
+    m_delayTaps.resize(m_inputs.size() * 4);
+    m_delayWhole.resize(m_inputs.size());
+
+    for (size_t k = 0; k < m_inputs.size(); k++) {
+        // Multiplexed converters hold each input one conversion time after the previous one;
+        // a later hold instant is a shorter lag behind the newest engine sample
+        double delay = m_converter.apertureDelay + k * m_converter.conversionTime + m_inputs[k].skew;
+        double samples = std::min(std::max(HOLD_LATENCY - delay * m_sampleRate, 2.0), HISTORY - 2.0);
+
+        double position = HISTORY - samples;
+        int whole = static_cast<int>(std::floor(position));
+        double f = position - whole;
+
+        // Cubic Lagrange interpolation on nodes -1, 0, 1, 2
+        m_delayWhole[k] = whole;
+        m_delayTaps[k * 4 + 0] = -f * (f - 1.0) * (f - 2.0) / 6.0;
+        m_delayTaps[k * 4 + 1] = (f + 1.0) * (f - 1.0) * (f - 2.0) / 2.0;
+        m_delayTaps[k * 4 + 2] = -(f + 1.0) * f * (f - 2.0) / 2.0;
+        m_delayTaps[k * 4 + 3] = (f + 1.0) * f * (f - 1.0) / 6.0;
+    }
+}
+
+void ADCModel::processBlock(const SampleBlock& block)
+{
+    const int count = block.count;
+    if (count <= 0) {
+        return;
+    }
+
+    if (block.sampleRate != m_sampleRate) {
+        m_sampleRate = block.sampleRate;
+        updateDelayFilters();
+    }
+
+    const int bits = m_converter.resolution;
+    const double levels = std::ldexp(1.0, bits);
+    const double maxCode = levels - 1.0;
+    const double fullScale = m_converter.bipolar ? 2.0 * m_converter.reference : m_converter.reference;
+    const double lowest = m_converter.bipolar ? -m_converter.reference : -0.5 * m_converter.reference;
+    const double lsbPerVolt = levels / fullScale;
+    const int32_t codeOffset = m_converter.bipolar ? static_cast<int32_t>(levels / 2) : 0;
+    const double inl = m_converter.inl;
+    const double* dnl = m_dnlTable.empty() ? nullptr : m_dnlTable.data();
+
+    m_work.resize(HISTORY + count);
+    m_noise.resize(count);
+    m_blockLength = count;
+
+    for (size_t k = 0; k < m_inputs.size(); k++) {
+        const ADCInputConfig& input = m_inputs[k];
+        std::vector<int32_t>& codes = m_codes[k];
+        std::vector<double>& pin = m_pinVoltage[k];
+        codes.resize(count);
+        pin.resize(count);
+
+        // Stage the input behind its history so the delay filter can look back
+        double* work = m_work.data();
+        double* history = &m_history[k * HISTORY];
+        std::copy(history, history + HISTORY, work);
+        if (input.phase < block.phases) {
+            const std::vector<double>& source = (input.signal == ADCSignal::Voltage)
+                ? block.voltage[input.phase] : block.current[input.phase];
+            std::copy(source.begin(), source.begin() + count, work + HISTORY);
+        } else {
+            std::fill(work + HISTORY, work + HISTORY + count, 0.0);
+        }
+        std::copy(work + count, work + count + HISTORY, history);
+
+        // Sample-and-hold instant as a fractional delay, then the analog front end
+        const double* taps = &m_delayTaps[k * 4];
+        const double* x = work + m_delayWhole[k] - 1;
+        const double gain = input.scale * pgaGain(input) * (1.0 + input.gainError);
+        const double offset = input.offset;
+        double* v = pin.data();
+        for (int n = 0; n < count; n++) {
+            double held = taps[0] * x[n] + taps[1] * x[n + 1] + taps[2] * x[n + 2] + taps[3] * x[n + 3];
+            v[n] = held * gain + offset;
+        }
+
+        // Quantiser input in LSB: bow-shaped INL plus noise
+        double* u = m_noise.data();
+        if (m_converter.noise > 0.0) {
+            m_noiseGenerator.fill(u, count);
+        } else {
+            std::fill(u, u + count, 0.0);
+        }
+        const double noise = m_converter.noise;
+        for (int n = 0; n < count; n++) {
+            double level = (v[n] - lowest) * lsbPerVolt;
+            double centred = 2.0 * level / levels - 1.0;
+            u[n] = level + inl * (1.0 - centred * centred) + noise * u[n];
+        }
+
+        // Per-code transition errors
+        if (dnl) {
+            for (int n = 0; n < count; n++) {
+                u[n] += dnl[static_cast<size_t>(std::min(std::max(u[n], 0.0), maxCode))];
+            }
+        }
+
+        int32_t* out = codes.data();
+        for (int n = 0; n < count; n++) {
+            out[n] = static_cast<int32_t>(std::min(std::max(u[n], 0.0), maxCode)) - codeOffset;
+        }
+    }
+}
+
+int ADCModel::connect(MeteringEngine& engine, MCUEmulator& mcu)
+{
+    MCUEmulator* target = &mcu;
+    return engine.addSampleBlockListener([this, target](const SampleBlock& block) {
+        processBlock(block);
+
+        // The MCU sees the most recent conversion of each mapped input, bipolar codes offset binary
+        const double bias = m_converter.bipolar ? 0.0 : 0.5 * m_converter.reference;
+        const int32_t codeOffset = m_converter.bipolar ? static_cast<int32_t>(1u << (m_converter.resolution - 1)) : 0;
+        for (size_t k = 0; k < m_inputs.size(); k++) {
+            if (m_inputs[k].mcuChannel < 0 || m_blockLength == 0) continue;
+
+            int32_t code = m_codes[k][m_blockLength - 1];
+            double pinVoltage = m_pinVoltage[k][m_blockLength - 1] + bias;
+            target->setADCSample(m_inputs[k].mcuChannel, pinVoltage, static_cast<uint32_t>(code + codeOffset));
+        }
+    });
+}
+
+double ADCModel::codeToValue(int input, int32_t code) const
+{
+    const ADCInputConfig& config = m_inputs[input];
+    const double levels = std::ldexp(1.0, m_converter.resolution);
+    const double fullScale = m_converter.bipolar ? 2.0 * m_converter.reference : m_converter.reference;
+    const double lowest = m_converter.bipolar ? -m_converter.reference : -0.5 * m_converter.reference;
+    const int32_t codeOffset = m_converter.bipolar ? static_cast<int32_t>(levels / 2) : 0;
+
+    double pin = (code + codeOffset + 0.5) / levels * fullScale + lowest;
+    return pin / (config.scale * pgaGain(config));
+}
@@ -0,0 +1,102 @@
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "noise_generator.h"
+
+class MeteringEngine;
+class MCUEmulator;
+struct SampleBlock;
+
+enum class ADCSignal {
+    Voltage,
+    Current
+};
+
+// Converter-wide characteristics
+struct ADCConverterConfig {
+    int resolution;          // bits, 8..24
+    double reference;        // volts
+    bool bipolar;            // false: single-supply input biased at reference / 2
+    double apertureDelay;    // seconds from the nominal sample instant to hold
+    double conversionTime;   // seconds per input when multiplexed; 0 = simultaneous sample-and-hold
+    double inl;              // peak integral nonlinearity (bow), LSB
+    double dnl;              // peak differential nonlinearity, LSB (applied up to 16 bits)
+    double noise;            // input-referred noise, LSB RMS
+    std::vector<double> pgaGains;
+};
+
+// One analog input of the acquisition chain
+struct ADCInputConfig {
+    ADCSignal signal;
+    int phase;               // 0..2
+    int mcuChannel;          // MCU ADC channel fed with the result, -1 for none
+    double scale;            // ADC pin volts per line volt or amp (divider ratio, burden)
+    double offset;           // volts at the pin
+    double gainError;        // relative, e.g. 0.002 = +0.2 %
+    double skew;             // seconds added to this input's hold instant
+    int pga;                 // index into ADCConverterConfig::pgaGains
+};
+
+// Acquisition chain between MeteringEngine and the MCU: sample-and-hold timing
+// (aperture delay, multiplexed conversion, per-input skew) as a fractional
+// delay, analog front-end gain/offset/PGA, then quantisation with INL/DNL and
+// noise. Whole sample blocks are processed per input with fixed-length loops.
+// Output codes lag the engine's samples by HOLD_LATENCY samples.
+class ADCModel
+{
+public:
+    static constexpr int HOLD_LATENCY = 3;
+
+    ADCModel();
+
+    void setConverter(const ADCConverterConfig& config);
+    const ADCConverterConfig& getConverter() const { return m_converter; }
+
+    int addInput(const ADCInputConfig& input);
+    void clearInputs();
+    void setPGA(int input, int pgaIndex);
+    const std::vector<ADCInputConfig>& getInputs() const { return m_inputs; }
+
+    void seed(uint64_t seed);
+    void reset();
+
+    // Converts a block; results are available through getCodes()/getPinVoltages()
+    void processBlock(const SampleBlock& block);
+
+    // Feeds every converted block to the MCU inputs mapped in the configuration
+    int connect(MeteringEngine& engine, MCUEmulator& mcu);
+
+    const std::vector<int32_t>& getCodes(int input) const { return m_codes[input]; }
+    const std::vector<double>& getPinVoltages(int input) const { return m_pinVoltage[input]; }
+    int getBlockLength() const { return m_blockLength; }
+
+    // Nominal analog value (line volts or amps) of a code on an input
+    double codeToValue(int input, int32_t code) const;
+
+private:
+    void rebuildTables();
+    void updateDelayFilters();
+    double pgaGain(const ADCInputConfig& input) const;
+
+    static constexpr int HISTORY = 8;
+
+    ADCConverterConfig m_converter;
+    std::vector<ADCInputConfig> m_inputs;
+    double m_sampleRate;
+
+    // Per input: four-tap Lagrange fractional delay and its input history
+    std::vector<double> m_delayTaps;      // 4 per input
+    std::vector<int> m_delayWhole;        // integer part of the delay, samples
+    std::vector<double> m_history;        // HISTORY per input
+
+    std::vector<double> m_dnlTable;       // per code transition error, LSB
+    std::vector<double> m_work;
+    std::vector<double> m_noise;
+    NoiseGenerator m_noiseGenerator;
+
+    int m_blockLength;
+    std::vector<std::vector<int32_t>> m_codes;
+    std::vector<std::vector<double>> m_pinVoltage;
+};
@@ -0,0 +1,402 @@
+
+#include "c37118_server.h"
+#include "synchrophasor_estimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace {
+
+// SYNC words: 0xAA, frame type in bits 6-4, version 2 (2011) in bits 3-0
+constexpr uint16_t SYNC_DATA = 0xAA02;
+constexpr uint16_t SYNC_HEADER = 0xAA12;
+constexpr uint16_t SYNC_CFG1 = 0xAA22;
+constexpr uint16_t SYNC_CFG2 = 0xAA32;
+constexpr uint8_t TYPE_COMMAND = 0x40;
+
+enum Command : uint16_t {
+    TransmissionOff = 1,
+    TransmissionOn = 2,
+    SendHeader = 3,
+    SendConfig1 = 4,
+    SendConfig2 = 5
+};
+
+// Polar phasors, float phasors, float analogs, float frequency
+constexpr uint16_t FORMAT_FLOAT_POLAR = 0x000F;
+
+void put16(std::vector<uint8_t>& out, uint16_t value)
+{
+    out.push_back(value >> 8);
+    out.push_back(value & 0xFF);
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t value)
+{
+    put16(out, value >> 16);
+    put16(out, value & 0xFFFF);
+}
+
+void putFloat(std::vector<uint8_t>& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put32(out, bits);
+}
+
+void putName(std::vector<uint8_t>& out, const std::string& name)
+{
+    for (size_t i = 0; i < 16; i++) {
+        out.push_back(i < name.size() ? name[i] : ' ');
+    }
+}
+
+uint16_t get16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+}
+
+C37118Server::C37118Server()
+    : m_idCode(1)
+    , m_stationName("SMART METER")
+    , m_nominalFrequency(50.0)
+    , m_reportingRate(50)
+    , m_phases(3)
+    , m_epoch(0)
+    , m_lastTime(0.0)
+    , m_listenSocket(-1)
+    , m_port(0)
+    , m_framesSent(0)
+    , m_framesDropped(0)
+{
+}
+
+C37118Server::~C37118Server()
+{
+    close();
+}
+
+void C37118Server::configure(uint16_t idCode, const std::string& stationName, double nominalFrequency,
+                             int reportingRate, int phases)
+{
+    m_idCode = idCode;
+    m_stationName = stationName;
+    m_nominalFrequency = nominalFrequency;
+    m_reportingRate = reportingRate;
+    m_phases = phases == 3 ? 3 : 1;
+}
+
+bool C37118Server::listen(uint16_t port)
+{
+    close();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    socklen_t length = sizeof(address);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(fd, 16) < 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) < 0 ||
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    m_listenSocket = fd;
+    m_port = ntohs(address.sin_port);
+    return true;
+}
+
+void C37118Server::close()
+{
+    for (Client& client : m_clients) {
+        ::close(client.socket);
+    }
+    m_clients.clear();
+
+    if (m_listenSocket >= 0) {
+        ::close(m_listenSocket);
+        m_listenSocket = -1;
+    }
+    m_port = 0;
+}
+
+void C37118Server::poll()
+{
+    if (m_listenSocket < 0) return;
+
+    acceptClients();
+
+    for (size_t i = 0; i < m_clients.size();) {
+        if (readClient(m_clients[i]) && flushClient(m_clients[i])) {
+            i++;
+        } else {
+            ::close(m_clients[i].socket);
+            m_clients.erase(m_clients.begin() + i);
+        }
+    }
+}
+
+void C37118Server::acceptClients()
+{
+    for (;;) {
+        int fd = ::accept(m_listenSocket, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        m_clients.push_back({fd, false, {}, {}});
+    }
+}
+
+bool C37118Server::readClient(Client& client)
+{
+    uint8_t buffer[1024];
+    for (;;) {
+        ssize_t received = ::recv(client.socket, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            client.input.insert(client.input.end(), buffer, buffer + received);
+            continue;
+        }
+        if (received == 0) {
+            return false;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    // Complete frames only; bytes up to the next SYNC are discarded on a bad frame
+    size_t offset = 0;
+    while (client.input.size() - offset >= 4) {
+        const uint8_t* frame = client.input.data() + offset;
+        uint16_t size = get16(frame + 2);
+        if (frame[0] != 0xAA || size < 18) {
+            offset++;
+            continue;
+        }
+        if (client.input.size() - offset < size) {
+            break;
+        }
+        if (crc(frame, size - 2) == get16(frame + size - 2) && (frame[1] & 0x70) == TYPE_COMMAND) {
+            handleCommand(client, frame);
+        }
+        offset += size;
+    }
+    client.input.erase(client.input.begin(), client.input.begin() + offset);
+    return true;
+}
+
+bool C37118Server::flushClient(Client& client)
+{
+    size_t sent = 0;
+    while (sent < client.output.size()) {
+        ssize_t n = ::send(client.socket, client.output.data() + sent, client.output.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+    client.output.erase(client.output.begin(), client.output.begin() + sent);
+    return true;
+}
+
+void C37118Server::handleCommand(Client& client, const uint8_t* frame)
+{
+    if (get16(frame + 4) != m_idCode) return;
+
+    std::vector<uint8_t> reply;
+    switch (get16(frame + 14)) {
+    case TransmissionOff:
+        client.streaming = false;
+        return;
+    case TransmissionOn:
+        client.streaming = true;
+        return;
+    case SendHeader:
+        reply = buildHeaderFrame(m_lastTime);
+        break;
+    case SendConfig1:
+        reply = buildConfigurationFrame(1, m_lastTime);
+        break;
+    case SendConfig2:
+        reply = buildConfigurationFrame(2, m_lastTime);
+        break;
+    default:
+        return;
+    }
+    // Replies are always queued; only data frames are subject to the backlog limit
+    client.output.insert(client.output.end(), reply.begin(), reply.end());
+}
+
+void C37118Server::publish(const SynchrophasorFrame& frame)
+{
+    m_lastTime = frame.timestamp;
+    if (m_clients.empty()) return;
+
+    std::vector<uint8_t> data = buildDataFrame(frame);
+    for (size_t i = 0; i < m_clients.size();) {
+        Client& client = m_clients[i];
+        if (client.streaming) {
+            if (client.output.size() + data.size() > MAX_PENDING_BYTES) {
+                m_framesDropped++;
+            } else {
+                client.output.insert(client.output.end(), data.begin(), data.end());
+                m_framesSent++;
+            }
+        }
+        if (flushClient(client)) {
+            i++;
+        } else {
+            ::close(client.socket);
+            m_clients.erase(m_clients.begin() + i);
+        }
+    }
+}
+
+void C37118Server::connect(SynchrophasorEstimator& estimator)
+{
+    estimator.setFrameListener([this](const SynchrophasorFrame& frame) {
+        publish(frame);
+    });
+}
+
+void C37118Server::beginFrame(std::vector<uint8_t>& out, uint16_t sync, double time) const
+{
+    // FRACSEC carries a zero time quality byte and a 24-bit count of TIME_BASE
+    double whole = std::floor(time);
+    uint32_t fraction = static_cast<uint32_t>(std::lround((time - whole) * TIME_BASE));
+    if (fraction >= TIME_BASE) {
+        whole += 1.0;
+        fraction -= TIME_BASE;
+    }
+
+    put16(out, sync);
+    put16(out, 0);  // FRAMESIZE, patched by endFrame
+    put16(out, m_idCode);
+    put32(out, m_epoch + static_cast<uint32_t>(std::max(0.0, whole)));
+    put32(out, fraction & 0x00FFFFFF);
+}
+
+void C37118Server::endFrame(std::vector<uint8_t>& out) const
+{
+    uint16_t size = static_cast<uint16_t>(out.size() + 2);
+    out[2] = size >> 8;
+    out[3] = size & 0xFF;
+    put16(out, crc(out.data(), out.size()));
+}
+
+std::vector<uint8_t> C37118Server::buildConfigurationFrame(int version, double time) const
+{
+    static const char* const NAMES_THREE_PHASE[] = {"VA", "VB", "VC", "V1", "IA", "IB", "IC"};
+    static const char* const NAMES_SINGLE_PHASE[] = {"VA", "IA"};
+    const char* const* names = m_phases == 3 ? NAMES_THREE_PHASE : NAMES_SINGLE_PHASE;
+    const int phasors = phasorCount();
+
+    std::vector<uint8_t> out;
+    beginFrame(out, version == 1 ? SYNC_CFG1 : SYNC_CFG2, time);
+    put32(out, TIME_BASE);
+    put16(out, 1);  // NUM_PMU
+
+    putName(out, m_stationName);
+    put16(out, m_idCode);
+    put16(out, FORMAT_FLOAT_POLAR);
+    put16(out, phasors);
+    put16(out, 0);  // ANNMR
+    put16(out, 0);  // DGNMR
+    for (int i = 0; i < phasors; i++) {
+        putName(out, names[i]);
+    }
+    // PHUNIT: type byte 0 voltage, 1 current; the scale is unused for float phasors
+    for (int i = 0; i < phasors; i++) {
+        put32(out, names[i][0] == 'I' ? 0x01000000 : 0x00000000);
+    }
+    put16(out, m_nominalFrequency < 55.0 ? 1 : 0);  // FNOM bit 0: 50 Hz
+    put16(out, 0);  // CFGCNT
+
+    put16(out, static_cast<uint16_t>(m_reportingRate));
+    endFrame(out);
+    return out;
+}
+
+std::vector<uint8_t> C37118Server::buildHeaderFrame(double time) const
+{
+    std::string text = "Smart meter simulator synchrophasor stream, " + m_stationName +
+                       ", two-cycle triangular filter, " + std::to_string(m_reportingRate) + " frames/s";
+
+    std::vector<uint8_t> out;
+    beginFrame(out, SYNC_HEADER, time);
+    out.insert(out.end(), text.begin(), text.end());
+    endFrame(out);
+    return out;
+}
+
+std::vector<uint8_t> C37118Server::buildDataFrame(const SynchrophasorFrame& frame) const
+{
+    std::vector<uint8_t> out;
+    out.reserve(16 + 8 * phasorCount() + 12);
+    beginFrame(out, SYNC_DATA, frame.timestamp);
+    put16(out, 0);  // STAT: good data, in sync
+
+    auto putPhasor = [&](const std::complex<double>& phasor) {
+        putFloat(out, static_cast<float>(std::abs(phasor)));
+        putFloat(out, static_cast<float>(std::arg(phasor)));
+    };
+    if (m_phases == 3) {
+        for (int ph = 0; ph < 3; ph++) putPhasor(frame.phasor[ph]);
+        putPhasor(frame.positiveSequence);
+        for (int ph = 0; ph < 3; ph++) putPhasor(frame.phasor[3 + ph]);
+    } else {
+        putPhasor(frame.phasor[0]);
+        putPhasor(frame.phasor[3]);
+    }
+
+    putFloat(out, static_cast<float>(frame.frequency));
+    putFloat(out, static_cast<float>(frame.rocof));
+    endFrame(out);
+    return out;
+}
+
+uint16_t C37118Server::crc(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        uint16_t temp = ((crc >> 8) ^ data[i]) & 0xFF;
+        crc <<= 8;
+        uint16_t quick = temp ^ (temp >> 4);
+        crc ^= quick;
+        quick <<= 5;
+        crc ^= quick;
+        quick <<= 7;
+        crc ^= quick;
+    }
+    return crc;
+}
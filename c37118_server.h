@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct SynchrophasorFrame;
+class SynchrophasorEstimator;
+
+// IEEE C37.118.2-2011 data stream server for one simulated PMU. Listens on a
+// loopback TCP port and serves configuration (CFG-1/CFG-2), header and data
+// frames to any number of concentrators; data flows once a client sends the
+// "turn on transmission" command. Phasors are sent as float polar, frequency
+// and ROCOF as float. Sockets are non-blocking and are serviced from poll(),
+// so the server runs inside the simulation loop without threads; a client
+// that falls behind loses data frames rather than stalling the simulation.
+class C37118Server
+{
+public:
+    static constexpr uint32_t TIME_BASE = 1000000;        // FRACSEC resolution, microseconds
+    static constexpr size_t MAX_PENDING_BYTES = 65536;     // per client, before data frames are dropped
+
+    C37118Server();
+    ~C37118Server();
+
+    C37118Server(const C37118Server&) = delete;
+    C37118Server& operator=(const C37118Server&) = delete;
+
+    // Stream identity; phases is 1 (VA, IA) or 3 (VA-VC, IA-IC and V1)
+    void configure(uint16_t idCode, const std::string& stationName, double nominalFrequency,
+                   int reportingRate, int phases);
+
+    // Seconds since 1970 at frame timestamp zero
+    void setEpoch(uint32_t soc) { m_epoch = soc; }
+
+    // Binds 127.0.0.1; port 0 picks a free port, see getPort()
+    bool listen(uint16_t port);
+    void close();
+    bool isListening() const { return m_listenSocket >= 0; }
+    uint16_t getPort() const { return m_port; }
+
+    // Accepts connections, answers commands and flushes queued output; never blocks
+    void poll();
+
+    // Queues one data frame to every client with transmission on
+    void publish(const SynchrophasorFrame& frame);
+
+    // Publishes every frame the estimator reports
+    void connect(SynchrophasorEstimator& estimator);
+
+    int getClientCount() const { return static_cast<int>(m_clients.size()); }
+    uint64_t getFramesSent() const { return m_framesSent; }
+    uint64_t getFramesDropped() const { return m_framesDropped; }
+
+    std::vector<uint8_t> buildConfigurationFrame(int version, double time) const;
+    std::vector<uint8_t> buildHeaderFrame(double time) const;
+    std::vector<uint8_t> buildDataFrame(const SynchrophasorFrame& frame) const;
+
+    // CRC-CCITT as used for CHK: polynomial 0x1021, initial 0xFFFF
+    static uint16_t crc(const uint8_t* data, size_t length);
+
+private:
+    struct Client {
+        int socket;
+        bool streaming;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+    };
+
+    void acceptClients();
+    bool readClient(Client& client);
+    bool flushClient(Client& client);
+    void handleCommand(Client& client, const uint8_t* frame);
+
+    void beginFrame(std::vector<uint8_t>& out, uint16_t sync, double time) const;
+    void endFrame(std::vector<uint8_t>& out) const;
+    int phasorCount() const { return m_phases == 3 ? 7 : 2; }
+
+    uint16_t m_idCode;
+    std::string m_stationName;
+    double m_nominalFrequency;
+    int m_reportingRate;
+    int m_phases;
+    uint32_t m_epoch;
+    double m_lastTime;       // timestamp of the newest published frame
+
+    int m_listenSocket;
+    uint16_t m_port;
+    std::vector<Client> m_clients;
+
+    uint64_t m_framesSent;
+    uint64_t m_framesDropped;
+};
@@ -0,0 +1,269 @@
+
+#include "calibration_solver.h"
+#include "metering_engine.h"
+#include "parallel_for.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+constexpr int CHANNELS = MetrologyAFE::CHANNELS;
+constexpr double REGISTER_SCALE = 134217728.0;  // 2^27
+
+// Normal equations of y = A cos(wt) + B sin(wt) + C, accumulated block by block.
+// The design matrix is shared by every lane, so only the right-hand sides are per lane.
+struct SineFit {
+    double cc = 0.0, cs = 0.0, c = 0.0, ss = 0.0, s = 0.0, n = 0.0;
+    double yc[CHANNELS] = {}, ys[CHANNELS] = {}, y[CHANNELS] = {}, yy[CHANNELS] = {};
+
+    std::vector<double> cosine;
+    std::vector<double> sine;
+
+    void addBlock(const SampleBlock& block, const MetrologyAFE& afe, double omega)
+    {
+        const int count = block.count;
+        cosine.resize(count);
+        sine.resize(count);
+
+        for (int i = 0; i < count; i++) {
+            double theta = omega * (block.startTime + i / block.sampleRate);
+            cosine[i] = std::cos(theta);
+            sine[i] = std::sin(theta);
+        }
+
+        for (int i = 0; i < count; i++) {
+            cc += cosine[i] * cosine[i];
+            cs += cosine[i] * sine[i];
+            c += cosine[i];
+            ss += sine[i] * sine[i];
+            s += sine[i];
+        }
+        n += count;
+
+        for (int lane = 0; lane < CHANNELS; lane++) {
+            const int32_t* codes = afe.getBlockCodes(lane).data();
+            double sumC = 0.0, sumS = 0.0, sum = 0.0, sumSquares = 0.0;
+            for (int i = 0; i < count; i++) {
+                double value = codes[i];
+                sumC += value * cosine[i];
+                sumS += value * sine[i];
+                sum += value;
+                sumSquares += value * value;
+            }
+            yc[lane] += sumC;
+            ys[lane] += sumS;
+            y[lane] += sum;
+            yy[lane] += sumSquares;
+        }
+    }
+
+    // Solves all lanes against the one 3x3 system (Cramer's rule)
+    bool solve(double* a, double* b, double* offset) const
+    {
+        double det = cc * (ss * n - s * s) - cs * (cs * n - s * c) + c * (cs * s - ss * c);
+        if (std::abs(det) < 1e-12) {
+            return false;
+        }
+
+        for (int lane = 0; lane < CHANNELS; lane++) {
+            double r0 = yc[lane], r1 = ys[lane], r2 = y[lane];
+            a[lane] = (r0 * (ss * n - s * s) - cs * (r1 * n - s * r2) + c * (r1 * s - ss * r2)) / det;
+            b[lane] = (cc * (r1 * n - s * r2) - r0 * (cs * n - s * c) + c * (cs * r2 - r1 * c)) / det;
+            offset[lane] = (cc * (ss * r2 - r1 * s) - cs * (cs * r2 - r1 * c) + r0 * (cs * s - ss * c)) / det;
+        }
+        return true;
+    }
+};
+
+double wrapAngle(double angle)
+{
+    return std::remainder(angle, 2.0 * M_PI);
+}
+
+}
+
+CalibrationSolver::CalibrationSolver()
+    : m_config{false, 50.0, 0.5, 1.0, 0.01, 0}
+{
+}
+
+void CalibrationSolver::buildDefaultSequence(double nominalVoltage, double basicCurrent)
+{
+    m_points.clear();
+    m_points.push_back({"Ib PF1", nominalVoltage, basicCurrent, 1.0});
+    m_points.push_back({"Ib PF0.5L", nominalVoltage, basicCurrent, 0.5});
+    m_points.push_back({"0.05Ib PF1", nominalVoltage, 0.05 * basicCurrent, 1.0});
+}
+
+void CalibrationSolver::clearRegisters(MetrologyAFE& afe)
+{
+    for (int ph = 0; ph < 3; ph++) {
+        uint16_t base = ph * AFERegister::PHASE_STRIDE;
+        afe.writeRegister(base + AFERegister::AIGAIN, 0);
+        afe.writeRegister(base + AFERegister::AVGAIN, 0);
+        afe.writeRegister(base + AFERegister::APHCAL0, 0);
+        afe.writeRegister(base + AFERegister::AIRMSOS, 0);
+        afe.writeRegister(base + AFERegister::AVRMSOS, 0);
+    }
+    afe.writeRegister(AFERegister::NIGAIN, 0);
+    afe.writeRegister(AFERegister::NIRMSOS, 0);
+}
+
+void CalibrationSolver::writeRegisters(MetrologyAFE& afe, const CalibrationResult& result)
+{
+    for (int ph = 0; ph < 3; ph++) {
+        uint16_t base = ph * AFERegister::PHASE_STRIDE;
+        const ChannelCalibration& current = result.channels[MetrologyAFE::CH_IA + ph];
+        const ChannelCalibration& voltage = result.channels[MetrologyAFE::CH_VA + ph];
+
+        if (current.used) {
+            afe.writeRegister(base + AFERegister::AIGAIN, static_cast<uint32_t>(current.gainRegister));
+            afe.writeRegister(base + AFERegister::APHCAL0, static_cast<uint32_t>(current.phaseRegister));
+            afe.writeRegister(base + AFERegister::AIRMSOS, static_cast<uint32_t>(current.rmsOffsetRegister));
+        }
+        if (voltage.used) {
+            afe.writeRegister(base + AFERegister::AVGAIN, static_cast<uint32_t>(voltage.gainRegister));
+            afe.writeRegister(base + AFERegister::AVRMSOS, static_cast<uint32_t>(voltage.rmsOffsetRegister));
+        }
+    }
+}
+
+CalibrationResult CalibrationSolver::calibrate(MeteringEngine& engine, MetrologyAFE& afe) const
+{
+    CalibrationResult result = {};
+    const int phases = m_config.threePhase ? 3 : 1;
+    const double omega = 2.0 * M_PI * m_config.frequency;
+
+    if (m_points.empty()) {
+        return result;
+    }
+
+    clearRegisters(afe);
+
+    // Per point and lane: fitted amplitude and phase, expected amplitude, RMS of the captured codes
+    struct PointFit {
+        double amplitude[CHANNELS];
+        double phase[CHANNELS];
+        double offset[CHANNELS];
+        double expected[CHANNELS];
+        double rms[CHANNELS];
+        double powerFactor;
+    };
+    std::vector<PointFit> fits;
+
+    SineFit fit;
+    bool capturing = false;
+    int listener = engine.addSampleBlockListener([&](const SampleBlock& block) {
+        if (capturing) {
+            fit.addBlock(block, afe, omega);
+        }
+    });
+
+    for (const auto& point : m_points) {
+        engine.configure(m_config.threePhase, point.voltage, point.current, m_config.frequency, point.powerFactor);
+
+        int settleSteps = static_cast<int>(std::lround(m_config.settleTime / m_config.timeStep));
+        int captureSteps = static_cast<int>(std::lround(m_config.captureTime / m_config.timeStep));
+
+        for (int i = 0; i < settleSteps; i++) {
+            engine.update(m_config.timeStep);
+        }
+
+        fit = SineFit();
+        capturing = true;
+        for (int i = 0; i < captureSteps; i++) {
+            engine.update(m_config.timeStep);
+        }
+        capturing = false;
+
+        double a[CHANNELS], b[CHANNELS];
+        PointFit pointFit = {};
+        if (!fit.solve(a, b, pointFit.offset)) {
+            engine.removeSampleBlockListener(listener);
+            return result;
+        }
+
+        // y = a sin(wt + phi) gives A = a sin(phi), B = a cos(phi)
+        for (int lane = 0; lane < CHANNELS; lane++) {
+            pointFit.amplitude[lane] = std::hypot(a[lane], b[lane]);
+            pointFit.phase[lane] = std::atan2(a[lane], b[lane]);
+            pointFit.rms[lane] = std::sqrt(fit.yy[lane] / fit.n);
+            pointFit.expected[lane] = 0.0;
+        }
+        for (int ph = 0; ph < phases; ph++) {
+            pointFit.expected[MetrologyAFE::CH_IA + ph] =
+                std::sqrt(2.0) * point.current * afe.codesPerUnit(MetrologyAFE::CH_IA + ph);
+            pointFit.expected[MetrologyAFE::CH_VA + ph] =
+                std::sqrt(2.0) * point.voltage * afe.codesPerUnit(MetrologyAFE::CH_VA + ph);
+        }
+        pointFit.powerFactor = point.powerFactor;
+        fits.push_back(pointFit);
+    }
+
+    engine.removeSampleBlockListener(listener);
+
+    const double samplesPerRadian = engine.getSampleRate() / omega;
+
+    for (int lane = 0; lane < CHANNELS; lane++) {
+        ChannelCalibration& channel = result.channels[lane];
+
+        // Gain: one-parameter least squares of fitted against nominal amplitude
+        double num = 0.0, den = 0.0, offset = 0.0;
+        const PointFit* lowest = nullptr;
+        double highest = 0.0;
+        for (const auto& f : fits) {
+            num += f.amplitude[lane] * f.expected[lane];
+            den += f.expected[lane] * f.expected[lane];
+            offset += f.offset[lane];
+            if (f.expected[lane] > 0.0 && (!lowest || f.expected[lane] < lowest->expected[lane])) {
+                lowest = &f;
+            }
+            highest = std::max(highest, f.expected[lane]);
+        }
+        if (den <= 0.0 || num <= 0.0) continue;
+
+        channel.used = true;
+        channel.gain = num / den;
+        channel.dcOffset = offset / fits.size();
+        channel.gainRegister = static_cast<int32_t>(std::lround((1.0 / channel.gain - 1.0) * REGISTER_SCALE));
+
+        // Current lanes: phase of I relative to V against the applied angle, weighted by amplitude
+        if (lane < MetrologyAFE::CH_VA && lane != MetrologyAFE::CH_IN) {
+            int voltageLane = MetrologyAFE::CH_VA + (lane - MetrologyAFE::CH_IA);
+            double weighted = 0.0, weight = 0.0;
+            for (const auto& f : fits) {
+                double measured = f.phase[lane] - f.phase[voltageLane];
+                double applied = -std::acos(f.powerFactor);
+                weighted += wrapAngle(measured - applied) * f.expected[lane];
+                weight += f.expected[lane];
+            }
+            channel.phaseError = weight > 0.0 ? weighted / weight : 0.0;
+
+            double delay = channel.phaseError * samplesPerRadian * REGISTER_SCALE;
+            channel.phaseRegister = static_cast<int32_t>(std::lround(std::min(std::max(delay, -REGISTER_SCALE), REGISTER_SCALE)));
+        }
+
+        // RMS offset from the low-level point, after the gain correction
+        if (lowest && lowest->expected[lane] < 0.2 * highest) {
+            double expectedRms = lowest->expected[lane] / std::sqrt(2.0);
+            channel.rmsOffset = expectedRms - lowest->rms[lane] / channel.gain;
+            channel.rmsOffsetRegister = static_cast<int32_t>(std::lround(channel.rmsOffset));
+        }
+    }
+
+    result.success = true;
+    writeRegisters(afe, result);
+    return result;
+}
+
+std::vector<CalibrationResult> CalibrationSolver::calibrateFleet(const std::vector<CalibrationTarget>& targets) const
+{
+    std::vector<CalibrationResult> results(targets.size());
+
+    // Each meter is owned by exactly one worker at a time
+    parallelFor(targets.size(), m_config.threadCount, [&](size_t i) {
+        results[i] = calibrate(*targets[i].engine, *targets[i].afe);
+    });
+
+    return results;
+}
@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "metrology_afe.h"
+
+class MeteringEngine;
+
+// One step of the calibration sequence
+struct CalibrationPoint {
+    std::string label;
+    double voltage;      // V RMS
+    double current;      // A RMS
+    double powerFactor;  // lagging, 0..1
+};
+
+struct CalibrationConfig {
+    bool threePhase;
+    double frequency;     // Hz
+    double settleTime;    // seconds run before capture at each point (filters settle)
+    double captureTime;   // seconds of sample blocks captured at each point
+    double timeStep;      // engine update step in seconds
+    unsigned int threadCount;  // 0 = hardware concurrency
+};
+
+struct ChannelCalibration {
+    bool used;
+    double gain;          // measured / nominal amplitude
+    double phaseError;    // radians; current lanes only, positive = current leads
+    double dcOffset;      // codes
+    double rmsOffset;     // codes, residual at the lowest-current point
+    int32_t gainRegister;
+    int32_t phaseRegister;
+    int32_t rmsOffsetRegister;
+};
+
+struct CalibrationResult {
+    bool success;
+    ChannelCalibration channels[MetrologyAFE::CHANNELS];
+};
+
+// Meter under calibration: the AFE must already be connected to the engine so
+// its codes are ready when the solver's own sample listener runs
+struct CalibrationTarget {
+    MeteringEngine* engine;
+    MetrologyAFE* afe;
+};
+
+// End-of-line calibration station. Drives each meter through the sequence,
+// fits amplitude, phase and offset of every AFE channel by least squares over
+// the captured sample blocks, and writes the gain, phase and RMS offset
+// registers. A fleet is calibrated across a pool of worker threads.
+class CalibrationSolver
+{
+public:
+    CalibrationSolver();
+
+    void setConfig(const CalibrationConfig& config) { m_config = config; }
+    const CalibrationConfig& getConfig() const { return m_config; }
+
+    void addPoint(const CalibrationPoint& point) { m_points.push_back(point); }
+    void clearPoints() { m_points.clear(); }
+    const std::vector<CalibrationPoint>& getPoints() const { return m_points; }
+
+    // Ib at PF 1 and PF 0.5 lagging, then 5 % Ib for the offsets
+    void buildDefaultSequence(double nominalVoltage, double basicCurrent);
+
+    CalibrationResult calibrate(MeteringEngine& engine, MetrologyAFE& afe) const;
+    std::vector<CalibrationResult> calibrateFleet(const std::vector<CalibrationTarget>& targets) const;
+
+    static void writeRegisters(MetrologyAFE& afe, const CalibrationResult& result);
+    static void clearRegisters(MetrologyAFE& afe);
+
+private:
+    CalibrationConfig m_config;
+    std::vector<CalibrationPoint> m_points;
+};
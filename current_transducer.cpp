@@ -0,0 +1,196 @@
+
+#include "current_transducer.h"
+#include <algorithm>
+#include <cmath>
+
+CurrentTransducer::CurrentTransducer()
+    : m_type(TransducerType::Ideal)
+    , m_externalFlux(0.0)
+{
+    // 100 A : 40 mA class metering CT with a 10 ohm burden, knee around 2 V RMS
+    m_ct.turnsRatio = 2500.0;
+    m_ct.burdenResistance = 10.0;
+    m_ct.magnetizingInductance = 50.0;
+    m_ct.saturatedInductance = 0.05;
+    m_ct.kneeFlux = 9.0e-3;
+    m_ct.hysteresisFlux = 1.5e-3;
+
+    // Roughly 150 uV/A at 50 Hz
+    m_rogowski.mutualInductance = 0.48e-6;
+    m_rogowski.integratorCutoff = 0.1;
+    m_rogowski.integratorOffset = 0.0;
+
+    // 150 uOhm manganin shunt
+    m_shunt.resistance = 150e-6;
+    m_shunt.temperatureCoefficient = 20e-6;
+    m_shunt.thermalResistance = 20.0;
+    m_shunt.thermalTimeConstant = 30.0;
+    m_shunt.ambientTemperature = 25.0;
+    m_shunt.inductance = 2e-9;
+
+    reset();
+}
+
+void CurrentTransducer::setType(TransducerType type)
+{
+    if (type != m_type) {
+        m_type = type;
+        reset();
+    }
+}
+
+void CurrentTransducer::setShuntParameters(const ShuntParameters& parameters)
+{
+    m_shunt = parameters;
+    std::fill(m_temperature, m_temperature + LANES, m_shunt.ambientTemperature);
+}
+
+void CurrentTransducer::setRemanentFlux(int phase, double flux)
+{
+    if (phase >= 0 && phase < 3) {
+        m_flux[phase] = flux;
+        m_hysteresis[phase] = flux;
+    }
+}
+
+void CurrentTransducer::reset()
+{
+    std::fill(m_flux, m_flux + LANES, 0.0);
+    std::fill(m_hysteresis, m_hysteresis + LANES, 0.0);
+    std::fill(m_previousCurrent, m_previousCurrent + LANES, 0.0);
+    std::fill(m_previousEmf, m_previousEmf + LANES, 0.0);
+    std::fill(m_integrator, m_integrator + LANES, 0.0);
+    std::fill(m_temperature, m_temperature + LANES, m_shunt.ambientTemperature);
+}
+
+void CurrentTransducer::process(double* const* current, int phases, int count, double sampleRate)
+{
+    if (m_type == TransducerType::Ideal || count <= 0 || sampleRate <= 0.0) {
+        return;
+    }
+
+    phases = std::min(std::max(phases, 1), 3);
+
+    // Interleave so one sample of every phase sits in one four-lane group
+    m_buffer.assign(static_cast<size_t>(count) * LANES, 0.0);
+    for (int ph = 0; ph < phases; ph++) {
+        const double* in = current[ph];
+        for (int n = 0; n < count; n++) {
+            m_buffer[n * LANES + ph] = in[n];
+        }
+    }
+
+    const double dt = 1.0 / sampleRate;
+    switch (m_type) {
+    case TransducerType::CurrentTransformer:
+        processCT(count, dt);
+        break;
+    case TransducerType::RogowskiCoil:
+        processRogowski(count, dt);
+        break;
+    case TransducerType::Shunt:
+        processShunt(count, dt);
+        break;
+    default:
+        break;
+    }
+
+    for (int ph = 0; ph < phases; ph++) {
+        double* out = current[ph];
+        for (int n = 0; n < count; n++) {
+            out[n] = m_buffer[n * LANES + ph];
+        }
+    }
+}
+
+void CurrentTransducer::processCT(int count, double dt)
+{
+    const double ratio = m_ct.turnsRatio;
+    const double burden = m_ct.burdenResistance;
+    const double width = m_ct.hysteresisFlux;
+
+    // A magnet saturates part of the core and leaves less headroom below the knee
+    const double headroom = std::max(1.0 - std::abs(m_externalFlux) / m_ct.kneeFlux, 1e-3);
+    const double knee = m_ct.kneeFlux * headroom;
+    const double inverseLm = 1.0 / (m_ct.magnetizingInductance * headroom);
+
+    // Explicit integration is stable while burden * dt / L stays below 2
+    const double inverseLsat = 1.0 / std::max(m_ct.saturatedInductance, burden * dt);
+
+    double flux[LANES], band[LANES];
+    std::copy(m_flux, m_flux + LANES, flux);
+    std::copy(m_hysteresis, m_hysteresis + LANES, band);
+
+    for (int n = 0; n < count; n++) {
+        double* x = &m_buffer[n * LANES];
+        for (int l = 0; l < LANES; l++) {
+            band[l] = std::min(std::max(band[l], flux[l] - width), flux[l] + width);
+            double excess = flux[l] - std::min(std::max(flux[l], -knee), knee);
+            double magnetizing = (flux[l] - band[l]) * inverseLm + excess * inverseLsat;
+            double secondary = x[l] / ratio - magnetizing;
+            flux[l] += burden * secondary * dt;
+            x[l] = secondary * ratio;
+        }
+    }
+
+    std::copy(flux, flux + LANES, m_flux);
+    std::copy(band, band + LANES, m_hysteresis);
+}
+
+void CurrentTransducer::processRogowski(int count, double dt)
+{
+    const double mutual = m_rogowski.mutualInductance;
+    const double offset = m_rogowski.integratorOffset;
+    const double leak = std::exp(-2.0 * M_PI * m_rogowski.integratorCutoff * dt);
+    const double gain = dt / (2.0 * mutual);
+    const double rate = mutual / dt;
+
+    double previous[LANES], emfPrevious[LANES], y[LANES];
+    std::copy(m_previousCurrent, m_previousCurrent + LANES, previous);
+    std::copy(m_previousEmf, m_previousEmf + LANES, emfPrevious);
+    std::copy(m_integrator, m_integrator + LANES, y);
+
+    for (int n = 0; n < count; n++) {
+        double* x = &m_buffer[n * LANES];
+        for (int l = 0; l < LANES; l++) {
+            double emf = (x[l] - previous[l]) * rate + offset;
+            y[l] = leak * y[l] + (emf + emfPrevious[l]) * gain;
+            previous[l] = x[l];
+            emfPrevious[l] = emf;
+            x[l] = y[l];
+        }
+    }
+
+    std::copy(previous, previous + LANES, m_previousCurrent);
+    std::copy(emfPrevious, emfPrevious + LANES, m_previousEmf);
+    std::copy(y, y + LANES, m_integrator);
+}
+
+void CurrentTransducer::processShunt(int count, double dt)
+{
+    const double r0 = m_shunt.resistance;
+    const double alpha = m_shunt.temperatureCoefficient;
+    const double ambient = m_shunt.ambientTemperature;
+    const double rth = m_shunt.thermalResistance;
+    const double thermalStep = dt / m_shunt.thermalTimeConstant;
+    const double reactance = m_shunt.inductance / dt;
+
+    double previous[LANES], temperature[LANES];
+    std::copy(m_previousCurrent, m_previousCurrent + LANES, previous);
+    std::copy(m_temperature, m_temperature + LANES, temperature);
+
+    for (int n = 0; n < count; n++) {
+        double* x = &m_buffer[n * LANES];
+        for (int l = 0; l < LANES; l++) {
+            double resistance = r0 * (1.0 + alpha * (temperature[l] - ambient));
+            double voltage = resistance * x[l] + reactance * (x[l] - previous[l]);
+            double power = x[l] * x[l] * resistance;
+            temperature[l] += (power * rth - (temperature[l] - ambient)) * thermalStep;
+            previous[l] = x[l];
+            x[l] = voltage / r0;
+        }
+    }
+
+    std::copy(previous, previous + LANES, m_previousCurrent);
+    std::copy(temperature, temperature + LANES, m_temperature);
+}
@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <vector>
+
+enum class TransducerType {
+    Ideal,
+    CurrentTransformer,
+    RogowskiCoil,
+    Shunt
+};
+
+// Iron-core CT, referred to the secondary. Two-slope magnetising branch with a
+// play-operator hysteresis band, which leaves remanent flux after saturation.
+struct CTParameters {
+    double turnsRatio;             // primary amps per secondary amp
+    double burdenResistance;       // ohms, burden plus winding
+    double magnetizingInductance;  // henry, below the knee
+    double saturatedInductance;    // henry, above the knee
+    double kneeFlux;               // volt-seconds
+    double hysteresisFlux;         // half-width of the hysteresis band, volt-seconds
+};
+
+// Air-cored coil (e = M di/dt) followed by a leaky trapezoidal integrator
+struct RogowskiParameters {
+    double mutualInductance;       // henry
+    double integratorCutoff;       // Hz, leak that bounds integrator drift
+    double integratorOffset;       // volts at the integrator input
+};
+
+// Resistive shunt with self-heating and series inductance
+struct ShuntParameters {
+    double resistance;             // ohms at the reference temperature
+    double temperatureCoefficient; // per kelvin
+    double thermalResistance;      // kelvin per watt
+    double thermalTimeConstant;    // seconds
+    double ambientTemperature;     // degrees C, also the reference temperature
+    double inductance;             // henry
+};
+
+// Current sensor model applied to the current channels of each sample block.
+// The output is the primary current the meter would infer using the nominal
+// sensor constant. The per-sample state update runs across all phases at once
+// on a padded four-lane layout.
+class CurrentTransducer
+{
+public:
+    static constexpr int LANES = 4;
+
+    CurrentTransducer();
+
+    void setType(TransducerType type);
+    TransducerType getType() const { return m_type; }
+
+    void setCTParameters(const CTParameters& parameters) { m_ct = parameters; }
+    void setRogowskiParameters(const RogowskiParameters& parameters) { m_rogowski = parameters; }
+    void setShuntParameters(const ShuntParameters& parameters);
+    const CTParameters& getCTParameters() const { return m_ct; }
+    const RogowskiParameters& getRogowskiParameters() const { return m_rogowski; }
+    const ShuntParameters& getShuntParameters() const { return m_shunt; }
+
+    // Flux imposed on the CT core by an external magnet, volt-seconds
+    void setExternalFlux(double flux) { m_externalFlux = flux; }
+    void setRemanentFlux(int phase, double flux);
+
+    void reset();
+
+    // Transforms count samples of each phase's current in place
+    void process(double* const* current, int phases, int count, double sampleRate);
+
+    double getCoreFlux(int phase) const { return m_flux[phase]; }
+    double getShuntTemperature(int phase) const { return m_temperature[phase]; }
+
+private:
+    void processCT(int count, double dt);
+    void processRogowski(int count, double dt);
+    void processShunt(int count, double dt);
+
+    TransducerType m_type;
+    CTParameters m_ct;
+    RogowskiParameters m_rogowski;
+    ShuntParameters m_shunt;
+    double m_externalFlux;
+
+    // Interleaved working buffer: sample n of phase p at [n * LANES + p]
+    std::vector<double> m_buffer;
+
+    // State, one lane per phase plus padding
+    double m_flux[LANES];
+    double m_hysteresis[LANES];
+    double m_previousCurrent[LANES];
+    double m_previousEmf[LANES];
+    double m_integrator[LANES];
+    double m_temperature[LANES];
+};
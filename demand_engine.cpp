@@ -0,0 +1,171 @@
+
+#include "demand_engine.h"
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+DemandEngine::DemandEngine()
+    : m_integrationPeriod(900.0)
+    , m_subIntervalLength(300.0)
+    , m_activeTariff(0)
+    , m_ringHead(0)
+    , m_ringFilled(0)
+    , m_ringSum(0.0)
+    , m_started(false)
+    , m_subIntervalStart(0.0)
+    , m_subIntervalEnergy(0.0)
+    , m_lastTime(0.0)
+    , m_lastEnergy(0.0)
+    , m_blockDemand(0.0)
+    , m_slidingDemand(0.0)
+    , m_resetCount(0)
+{
+    configure(900.0, 3, 4);
+}
+
+void DemandEngine::configure(double integrationPeriod, int subIntervals, int tariffCount)
+{
+    if (integrationPeriod <= 0.0 || subIntervals < 1 || tariffCount < 1) {
+        return;
+    }
+
+    m_integrationPeriod = integrationPeriod;
+    m_subIntervalLength = integrationPeriod / subIntervals;
+    m_ring.assign(subIntervals, 0.0);
+    m_blockMaxDemand.assign(tariffCount, {0.0, 0.0});
+    m_slidingMaxDemand.assign(tariffCount, {0.0, 0.0});
+
+    if (m_activeTariff >= tariffCount) {
+        m_activeTariff = 0;
+    }
+
+    reset();
+}
+
+void DemandEngine::reset()
+{
+    std::fill(m_ring.begin(), m_ring.end(), 0.0);
+    m_ringHead = 0;
+    m_ringFilled = 0;
+    m_ringSum = 0.0;
+
+    m_started = false;
+    m_subIntervalStart = 0.0;
+    m_subIntervalEnergy = 0.0;
+    m_lastTime = 0.0;
+    m_lastEnergy = 0.0;
+
+    m_blockDemand = 0.0;
+    m_slidingDemand = 0.0;
+    std::fill(m_blockMaxDemand.begin(), m_blockMaxDemand.end(), MaxDemandRegister{0.0, 0.0});
+    std::fill(m_slidingMaxDemand.begin(), m_slidingMaxDemand.end(), MaxDemandRegister{0.0, 0.0});
+
+    m_resetCount = 0;
+    m_billingSnapshots.clear();
+}
+
+void DemandEngine::setActiveTariff(int tariff)
+{
+    if (tariff >= 0 && tariff < getTariffCount()) {
+        m_activeTariff = tariff;
+    }
+}
+
+void DemandEngine::update(double time, double energy)
+{
+    if (!m_started) {
+        // Align sub-intervals to the clock, as meters do
+        m_subIntervalStart = std::floor(time / m_subIntervalLength) * m_subIntervalLength;
+        m_lastTime = time;
+        m_lastEnergy = energy;
+        m_started = true;
+        return;
+    }
+
+    double deltaEnergy = energy - m_lastEnergy;
+    double deltaTime = time - m_lastTime;
+
+    // A large fast-forward step may cross several boundaries; split the
+    // energy across them assuming constant power within the step
+    while (time >= m_subIntervalStart + m_subIntervalLength) {
+        double boundary = m_subIntervalStart + m_subIntervalLength;
+        double portion = (deltaTime > 0.0) ? deltaEnergy * (boundary - m_lastTime) / deltaTime : 0.0;
+
+        m_subIntervalEnergy += portion;
+        deltaEnergy -= portion;
+        deltaTime -= boundary - m_lastTime;
+        m_lastTime = boundary;
+
+        closeSubInterval(boundary);
+    }
+
+    m_subIntervalEnergy += deltaEnergy;
+    m_lastTime = time;
+    m_lastEnergy = energy;
+}
+
+void DemandEngine::closeSubInterval(double endTime)
+{
+    const size_t windowLength = m_ring.size();
+
+    m_ringSum += m_subIntervalEnergy - m_ring[m_ringHead];
+    m_ring[m_ringHead] = m_subIntervalEnergy;
+    m_ringHead = (m_ringHead + 1) % windowLength;
+    if (m_ringFilled < windowLength) {
+        m_ringFilled++;
+    }
+
+    m_subIntervalStart = endTime;
+    m_subIntervalEnergy = 0.0;
+
+    // Block boundaries fall on clock multiples of the integration period
+    long long index = std::llround(endTime / m_subIntervalLength);
+    bool blockBoundary = (index % static_cast<long long>(windowLength)) == 0;
+
+    if (blockBoundary) {
+        // Re-sum once per block so rounding in the running sum cannot accumulate
+        m_ringSum = std::accumulate(m_ring.begin(), m_ring.end(), 0.0);
+        m_blockDemand = m_ringSum * 3600.0 / m_integrationPeriod;
+        updateMaxDemand(m_blockMaxDemand, m_blockDemand, endTime);
+    }
+
+    if (m_ringFilled == windowLength) {
+        m_slidingDemand = m_ringSum * 3600.0 / m_integrationPeriod;
+        updateMaxDemand(m_slidingMaxDemand, m_slidingDemand, endTime);
+    }
+}
+
+void DemandEngine::updateMaxDemand(std::vector<MaxDemandRegister>& registers, double demand, double time)
+{
+    MaxDemandRegister& md = registers[m_activeTariff];
+    if (demand > md.value) {
+        md.value = demand;
+        md.timestamp = time;
+    }
+}
+
+void DemandEngine::restoreMaxDemand(const std::vector<MaxDemandRegister>& block,
+                                    const std::vector<MaxDemandRegister>& sliding, int resetCount)
+{
+    for (size_t t = 0; t < block.size() && t < m_blockMaxDemand.size(); t++) {
+        m_blockMaxDemand[t] = block[t];
+    }
+    for (size_t t = 0; t < sliding.size() && t < m_slidingMaxDemand.size(); t++) {
+        m_slidingMaxDemand[t] = sliding[t];
+    }
+    m_resetCount = resetCount;
+}
+
+void DemandEngine::resetMaxDemand(double time)
+{
+    DemandBillingSnapshot snapshot;
+    snapshot.timestamp = time;
+    snapshot.resetCount = ++m_resetCount;
+    snapshot.energy = m_lastEnergy;
+    snapshot.blockMaxDemand = m_blockMaxDemand;
+    snapshot.slidingMaxDemand = m_slidingMaxDemand;
+    m_billingSnapshots.push_back(snapshot);
+
+    std::fill(m_blockMaxDemand.begin(), m_blockMaxDemand.end(), MaxDemandRegister{0.0, 0.0});
+    std::fill(m_slidingMaxDemand.begin(), m_slidingMaxDemand.end(), MaxDemandRegister{0.0, 0.0});
+}
@@ -0,0 +1,88 @@
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+struct MaxDemandRegister {
+    double value;      // W
+    double timestamp;  // simulation time in seconds
+};
+
+struct DemandBillingSnapshot {
+    double timestamp;
+    int resetCount;
+    double energy;     // Wh register value at the time of reset
+    std::vector<MaxDemandRegister> blockMaxDemand;
+    std::vector<MaxDemandRegister> slidingMaxDemand;
+};
+
+// Block and sliding-window demand calculated from an energy register.
+// Sub-interval energies are kept in a ring buffer with a running sum, so
+// each closed sub-interval costs O(1) independent of the window length.
+class DemandEngine
+{
+public:
+    DemandEngine();
+
+    void configure(double integrationPeriod, int subIntervals, int tariffCount);
+    void reset();
+
+    // Feed the current energy register (Wh) at simulation time (s)
+    void update(double time, double energy);
+
+    void setActiveTariff(int tariff);
+    int getActiveTariff() const { return m_activeTariff; }
+
+    double getIntegrationPeriod() const { return m_integrationPeriod; }
+    int getSubIntervals() const { return static_cast<int>(m_ring.size()); }
+    int getTariffCount() const { return static_cast<int>(m_blockMaxDemand.size()); }
+
+    // Demand of the last completed block / sliding window in W
+    double getBlockDemand() const { return m_blockDemand; }
+    double getSlidingDemand() const { return m_slidingDemand; }
+
+    const std::vector<MaxDemandRegister>& getBlockMaxDemand() const { return m_blockMaxDemand; }
+    const std::vector<MaxDemandRegister>& getSlidingMaxDemand() const { return m_slidingMaxDemand; }
+
+    // Billing reset: snapshot the MD registers and clear them
+    void resetMaxDemand(double time);
+    const std::vector<DemandBillingSnapshot>& getBillingSnapshots() const { return m_billingSnapshots; }
+    int getResetCount() const { return m_resetCount; }
+
+    // Power-up: MD registers and reset count restored from non-volatile memory
+    void restoreMaxDemand(const std::vector<MaxDemandRegister>& block, const std::vector<MaxDemandRegister>& sliding,
+                          int resetCount);
+
+private:
+    void closeSubInterval(double endTime);
+    void updateMaxDemand(std::vector<MaxDemandRegister>& registers, double demand, double time);
+
+    // Configuration
+    double m_integrationPeriod;
+    double m_subIntervalLength;
+    int m_activeTariff;
+
+    // Sub-interval ring buffer (Wh per sub-interval)
+    std::vector<double> m_ring;
+    size_t m_ringHead;
+    size_t m_ringFilled;
+    double m_ringSum;
+
+    // Current sub-interval
+    bool m_started;
+    double m_subIntervalStart;
+    double m_subIntervalEnergy;
+    double m_lastTime;
+    double m_lastEnergy;
+
+    // Results
+    double m_blockDemand;
+    double m_slidingDemand;
+    std::vector<MaxDemandRegister> m_blockMaxDemand;
+    std::vector<MaxDemandRegister> m_slidingMaxDemand;
+
+    // Billing
+    int m_resetCount;
+    std::vector<DemandBillingSnapshot> m_billingSnapshots;
+};
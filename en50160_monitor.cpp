@@ -0,0 +1,359 @@
+
+#include "en50160_monitor.h"
+#include "metering_engine.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+
+namespace {
+
+constexpr double NO_LIMIT = std::numeric_limits<double>::infinity();
+constexpr int PLT_PST_COUNT = 12;  // Plt spans two hours of Pst values
+
+}
+
+EN50160Monitor::EN50160Monitor()
+    : m_nominalVoltage(230.0)
+    , m_nominalFrequency(50.0)
+    , m_threePhase(false)
+    , m_phases(1)
+{
+    configure(230.0, 50.0, false);
+}
+
+void EN50160Monitor::configure(double nominalVoltage, double nominalFrequency, bool threePhase)
+{
+    if (nominalVoltage <= 0.0 || nominalFrequency <= 0.0) {
+        return;
+    }
+
+    m_nominalVoltage = nominalVoltage;
+    m_nominalFrequency = nominalFrequency;
+    m_threePhase = threePhase;
+    m_phases = threePhase ? 3 : 1;
+
+    const double un = nominalVoltage;
+    const double fn = nominalFrequency;
+    m_statistics.clear();
+
+    m_frequencyStat = addStatistic("Frequency", "Hz");
+    addRequirement(m_frequencyStat, 0.99 * fn, 1.01 * fn, 0.995);
+    addRequirement(m_frequencyStat, 0.94 * fn, 1.04 * fn, 1.0);
+
+    static const char* const PHASE_NAMES[] = {"L1", "L2", "L3"};
+    for (int ph = 0; ph < m_phases; ph++) {
+        const std::string phase = PHASE_NAMES[ph];
+
+        m_voltageStat[ph] = addStatistic("Voltage " + phase, "V");
+        addRequirement(m_voltageStat[ph], 0.90 * un, 1.10 * un, 0.95);
+        addRequirement(m_voltageStat[ph], 0.85 * un, 1.10 * un, 1.0);
+
+        m_thdStat[ph] = addStatistic("THD " + phase, "%");
+        addRequirement(m_thdStat[ph], -NO_LIMIT, 8.0, 0.95);
+
+        for (int h = 2; h <= MAX_HARMONIC; h++) {
+            m_harmonicStat[ph][h] = addStatistic("H" + std::to_string(h) + " " + phase, "% Un");
+            addRequirement(m_harmonicStat[ph][h], -NO_LIMIT, harmonicLimit(h), 0.95);
+        }
+
+        m_pltStat[ph] = addStatistic("Plt " + phase, "");
+        addRequirement(m_pltStat[ph], -NO_LIMIT, 1.0, 0.95);
+    }
+
+    m_unbalanceStat = -1;
+    if (threePhase) {
+        m_unbalanceStat = addStatistic("Unbalance", "%");
+        addRequirement(m_unbalanceStat, -NO_LIMIT, 2.0, 0.95);
+    }
+
+    reset();
+}
+
+void EN50160Monitor::reset()
+{
+    for (Statistic& statistic : m_statistics) {
+        statistic.sketch.clear();
+        for (Requirement& requirement : statistic.requirements) {
+            requirement.within = 0;
+        }
+    }
+
+    m_started = false;
+    m_startTime = m_time = 0.0;
+    m_block = 0;
+    m_blockWeight = 0.0;
+    m_frequencyWeight = m_frequencySum = 0.0;
+    m_intervalWeight = 0.0;
+    m_unbalanceSquares = 0.0;
+    for (int ph = 0; ph < 3; ph++) {
+        m_blockVoltage[ph] = 0.0;
+        m_lastBlockRMS[ph] = -1.0;
+        m_flickerSum[ph] = 0.0;
+        m_voltageSquares[ph] = 0.0;
+        m_thdSquares[ph] = 0.0;
+        std::fill(m_harmonicSquares[ph], m_harmonicSquares[ph] + MAX_HARMONIC + 1, 0.0);
+        m_pstHistory[ph].clear();
+    }
+    m_intervalCount = 0;
+}
+
+int EN50160Monitor::addStatistic(const std::string& name, const std::string& unit)
+{
+    m_statistics.push_back({name, unit, QuantileSketch(1e-4), {}});
+    return static_cast<int>(m_statistics.size()) - 1;
+}
+
+void EN50160Monitor::addRequirement(int statistic, double lower, double upper, double fraction)
+{
+    m_statistics[statistic].requirements.push_back({lower, upper, fraction, 0});
+}
+
+void EN50160Monitor::record(int statistic, double value)
+{
+    Statistic& target = m_statistics[statistic];
+    target.sketch.add(value);
+    for (Requirement& requirement : target.requirements) {
+        if (value >= requirement.lower && value <= requirement.upper) {
+            requirement.within++;
+        }
+    }
+}
+
+double EN50160Monitor::harmonicLimit(int order)
+{
+    // EN 50160 table of individual harmonic voltages, % of Un, orders 2..25
+    static const double LIMITS[MAX_HARMONIC + 1] = {
+        0.0, 0.0,
+        2.0, 5.0, 1.0, 6.0, 0.5, 5.0, 0.5, 1.5, 0.5, 3.5, 0.5, 3.0,
+        0.5, 0.5, 0.5, 2.0, 0.5, 1.5, 0.5, 0.5, 0.5, 1.5, 0.5, 1.5
+    };
+    return order >= 2 && order <= MAX_HARMONIC ? LIMITS[order] : 0.0;
+}
+
+void EN50160Monitor::readSnapshot(const MeteringEngine& engine, Snapshot& snapshot) const
+{
+    const MeteringMeasurements& measurements = engine.getBasicMeasurements();
+    snapshot.frequency = measurements.frequency;
+    for (int ph = 0; ph < 3; ph++) {
+        snapshot.voltage[ph] = m_threePhase ? std::abs(measurements.voltage[ph]) : measurements.voltageRMS;
+    }
+
+    // Per-phase harmonic groups from the analysis window when it runs, else the injected spectra.
+    // Those are relative to the fundamental, which the total RMS would overstate by the harmonics.
+    const double scale = 100.0 / m_nominalVoltage;
+    const bool analyzed = engine.isHarmonicAnalysisEnabled() && engine.getHarmonicAnalyzer().hasResult();
+    for (int ph = 0; ph < m_phases; ph++) {
+        const double fundamentalRMS = analyzed
+            ? engine.getHarmonicAnalyzer().getResult().group[ph][1]
+            : std::abs(engine.getPhasePower(ph).voltagePhasor);
+        double squares = 0.0;
+        for (int h = 2; h <= THD_ORDER; h++) {
+            double magnitude = analyzed
+                ? engine.getHarmonicAnalyzer().getResult().group[ph][h]
+                : fundamentalRMS * engine.getHarmonicSynthesizer().getMagnitude(HarmonicChannel::Voltage, ph, h);
+            double percent = magnitude * scale;
+            if (h <= MAX_HARMONIC) {
+                snapshot.harmonic[ph][h] = percent;
+            }
+            squares += percent * percent;
+        }
+        double fundamental = fundamentalRMS * scale;
+        snapshot.thd[ph] = fundamental > 0.0 ? std::sqrt(squares) / fundamental * 100.0 : 0.0;
+    }
+
+    // Negative over positive sequence, in the generated rotation (phase B at +120 degrees).
+    // The measured fundamentals share one window, so phase jumps and a floating star show up.
+    snapshot.unbalance = 0.0;
+    if (m_threePhase) {
+        std::complex<double> v[3];
+        for (int ph = 0; ph < 3; ph++) {
+            v[ph] = engine.getPhasePower(ph).voltagePhasor;
+        }
+        const std::complex<double> a = std::polar(1.0, 2.0 * M_PI / 3.0);
+        std::complex<double> positive = (v[0] + std::conj(a) * v[1] + a * v[2]) / 3.0;
+        std::complex<double> negative = (v[0] + a * v[1] + std::conj(a) * v[2]) / 3.0;
+        snapshot.unbalance = std::abs(positive) > 0.0 ? std::abs(negative) / std::abs(positive) * 100.0 : 0.0;
+    }
+}
+
+void EN50160Monitor::update(const MeteringEngine& engine, double deltaTime)
+{
+    const double end = engine.getSimulationTime();
+    if (!m_started) {
+        m_started = true;
+        m_startTime = m_time = std::max(0.0, end - deltaTime);
+        m_block = static_cast<int64_t>(std::floor(m_time / BLOCK + 1e-9));
+    }
+    if (end <= m_time) return;
+
+    Snapshot snapshot;
+    readSnapshot(engine, snapshot);
+
+    // The values hold over the whole step; split it at the 200 ms block boundaries
+    while (m_time < end) {
+        double boundary = (m_block + 1) * BLOCK;
+        double segmentEnd = std::min(end, boundary);
+        accumulate(snapshot, segmentEnd - m_time);
+        m_time = segmentEnd;
+        if (m_time >= boundary - 1e-9) {
+            closeBlock();
+            m_block++;
+        }
+    }
+}
+
+void EN50160Monitor::accumulate(const Snapshot& snapshot, double weight)
+{
+    m_blockWeight += weight;
+    m_frequencyWeight += weight;
+    m_frequencySum += snapshot.frequency * weight;
+    m_intervalWeight += weight;
+    m_unbalanceSquares += snapshot.unbalance * snapshot.unbalance * weight;
+
+    for (int ph = 0; ph < m_phases; ph++) {
+        double v2 = snapshot.voltage[ph] * snapshot.voltage[ph] * weight;
+        m_blockVoltage[ph] += v2;
+        m_voltageSquares[ph] += v2;
+        m_thdSquares[ph] += snapshot.thd[ph] * snapshot.thd[ph] * weight;
+        double* squares = m_harmonicSquares[ph];
+        const double* harmonic = snapshot.harmonic[ph];
+        for (int h = 2; h <= MAX_HARMONIC; h++) {
+            squares[h] += harmonic[h] * harmonic[h] * weight;
+        }
+    }
+}
+
+void EN50160Monitor::closeBlock()
+{
+    // Flicker time of the relative change between consecutive 200 ms RMS values (shape factor 1)
+    if (m_blockWeight > 0.0) {
+        for (int ph = 0; ph < m_phases; ph++) {
+            double rms = std::sqrt(m_blockVoltage[ph] / m_blockWeight);
+            if (m_lastBlockRMS[ph] >= 0.0) {
+                double change = std::abs(rms - m_lastBlockRMS[ph]) / m_nominalVoltage * 100.0;
+                m_flickerSum[ph] += 2.3 * std::pow(change, 3.2);
+            }
+            m_lastBlockRMS[ph] = rms;
+            m_blockVoltage[ph] = 0.0;
+        }
+    }
+    m_blockWeight = 0.0;
+
+    const int64_t closed = m_block + 1;
+    if (closed % BLOCKS_PER_FREQUENCY == 0 && m_frequencyWeight > 0.0) {
+        record(m_frequencyStat, m_frequencySum / m_frequencyWeight);
+        m_frequencyWeight = m_frequencySum = 0.0;
+    }
+
+    if (closed % BLOCKS_PER_INTERVAL != 0 || m_intervalWeight <= 0.0) {
+        return;
+    }
+
+    // 10-minute interval: RMS aggregation of the magnitudes
+    const double w = m_intervalWeight;
+    for (int ph = 0; ph < m_phases; ph++) {
+        record(m_voltageStat[ph], std::sqrt(m_voltageSquares[ph] / w));
+        record(m_thdStat[ph], std::sqrt(m_thdSquares[ph] / w));
+        for (int h = 2; h <= MAX_HARMONIC; h++) {
+            record(m_harmonicStat[ph][h], std::sqrt(m_harmonicSquares[ph][h] / w));
+            m_harmonicSquares[ph][h] = 0.0;
+        }
+
+        double pst = std::pow(m_flickerSum[ph] / (BLOCKS_PER_INTERVAL * BLOCK), 1.0 / 3.2);
+        std::vector<double>& history = m_pstHistory[ph];
+        history.push_back(pst);
+        if (history.size() > PLT_PST_COUNT) {
+            history.erase(history.begin());
+        }
+        if (history.size() == PLT_PST_COUNT) {
+            double cubes = 0.0;
+            for (double value : history) {
+                cubes += value * value * value;
+            }
+            record(m_pltStat[ph], std::cbrt(cubes / PLT_PST_COUNT));
+        }
+
+        m_voltageSquares[ph] = 0.0;
+        m_thdSquares[ph] = 0.0;
+        m_flickerSum[ph] = 0.0;
+    }
+    if (m_unbalanceStat >= 0) {
+        record(m_unbalanceStat, std::sqrt(m_unbalanceSquares / w));
+    }
+    m_unbalanceSquares = 0.0;
+    m_intervalWeight = 0.0;
+    m_intervalCount++;
+}
+
+EN50160Report EN50160Monitor::getReport() const
+{
+    EN50160Report report;
+    report.startTime = m_startTime;
+    report.endTime = m_time;
+    report.intervals = m_intervalCount;
+    report.passed = true;
+
+    for (const Statistic& statistic : m_statistics) {
+        const QuantileSketch& sketch = statistic.sketch;
+        for (const Requirement& requirement : statistic.requirements) {
+            EN50160Result result;
+            result.parameter = statistic.name;
+            result.unit = statistic.unit;
+            result.requiredFraction = requirement.fraction;
+            result.lowerLimit = requirement.lower;
+            result.upperLimit = requirement.upper;
+            result.values = sketch.getCount();
+            result.fractionWithin = result.values > 0 ? double(requirement.within) / result.values : 1.0;
+            result.quantileLow = sketch.quantile(1.0 - requirement.fraction);
+            result.quantileHigh = sketch.quantile(requirement.fraction);
+            result.minimum = sketch.getMin();
+            result.maximum = sketch.getMax();
+            result.passed = requirement.within >= std::ceil(requirement.fraction * result.values - 1e-9);
+            report.passed = report.passed && result.passed;
+            report.results.push_back(result);
+        }
+    }
+    return report;
+}
+
+void EN50160Monitor::runFleet(const std::vector<MeteringEngine*>& engines, const std::vector<EN50160Monitor*>& monitors,
+                              double duration, double timeStep, unsigned int threadCount)
+{
+    const size_t meters = std::min(engines.size(), monitors.size());
+    if (meters == 0 || timeStep <= 0.0) return;
+
+    // Every meter owns its engine and monitor, so workers share nothing but the index
+    const int64_t steps = static_cast<int64_t>(std::llround(duration / timeStep));
+    parallelFor(meters, threadCount, [&](size_t i) {
+        for (int64_t s = 0; s < steps; s++) {
+            engines[i]->update(timeStep);
+            monitors[i]->update(*engines[i], timeStep);
+        }
+    });
+}
+
+void EN50160Monitor::writeReport(std::ostream& out, const EN50160Report& report)
+{
+    out << "Parameter,Unit,Required (%),Lower,Upper,Values,Within (%),Low quantile,High quantile,Min,Max,Result\n";
+
+    auto limit = [&](double value) {
+        if (std::isinf(value)) out << '-';
+        else out << value;
+    };
+    for (const auto& result : report.results) {
+        out << '"' << result.parameter << '"' << ',' << result.unit << ','
+            << result.requiredFraction * 100.0 << ',';
+        limit(result.lowerLimit);
+        out << ',';
+        limit(result.upperLimit);
+        out << ',' << result.values << ','
+            << std::setprecision(5) << result.fractionWithin * 100.0 << ','
+            << result.quantileLow << ',' << result.quantileHigh << ','
+            << result.minimum << ',' << result.maximum << ','
+            << (result.passed ? "PASS" : "FAIL") << '\n';
+        out << std::setprecision(6);
+    }
+    out << "Overall," << (report.passed ? "PASS" : "FAIL") << '\n';
+}
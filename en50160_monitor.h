@@ -0,0 +1,142 @@
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include "quantile_sketch.h"
+
+class MeteringEngine;
+
+// One EN 50160 requirement: a share of the aggregated values must lie within the limits
+struct EN50160Result {
+    std::string parameter;     // e.g. "Voltage L1", "H5 L2", "Frequency"
+    std::string unit;
+    double requiredFraction;   // 0.95, 0.995 or 1.0
+    double lowerLimit;         // -infinity when there is none
+    double upperLimit;
+    uint64_t values;           // aggregated values assessed
+    double fractionWithin;     // exact, from counters
+    double quantileLow;        // value at 1 - requiredFraction, from the sketch
+    double quantileHigh;       // value at requiredFraction
+    double minimum;
+    double maximum;
+    bool passed;
+};
+
+struct EN50160Report {
+    double startTime;
+    double endTime;
+    uint64_t intervals;        // complete 10-minute intervals
+    std::vector<EN50160Result> results;
+    bool passed;
+};
+
+// Low-voltage EN 50160 assessment of one meter, fed with the engine's results
+// after every update. Values are time-weighted into 200 ms, 10 s and 10 min
+// aggregates aligned to the simulation clock; each closed aggregate goes into a
+// quantile sketch and the in-limit counters of its requirements, so memory
+// stays constant however long the assessment runs.
+//
+// Frequency: 10 s means, 99.5% within +/-1% and 100% within -6/+4%.
+// Voltage: 10 min RMS, 95% within +/-10% and 100% within -15/+10% of Un.
+// Harmonics 2-25 (% of Un) and THD up to the 40th (8%): 10 min RMS, 95%.
+// Unbalance (negative/positive sequence, 2%): 10 min, 95%, three-phase only.
+// Flicker Plt (1.0): sliding over 12 Pst values, 95%. Pst uses the analytical
+// method of IEC 61000-3-3 on the relative changes between 200 ms RMS values,
+// not a full IEC 61000-4-15 flickermeter.
+class EN50160Monitor
+{
+public:
+    static constexpr int MAX_HARMONIC = 25;     // individually limited orders
+    static constexpr int THD_ORDER = 40;
+
+    EN50160Monitor();
+
+    void configure(double nominalVoltage, double nominalFrequency, bool threePhase);
+    void reset();
+
+    // Call after each engine.update(deltaTime)
+    void update(const MeteringEngine& engine, double deltaTime);
+
+    EN50160Report getReport() const;
+    uint64_t getIntervalCount() const { return m_intervalCount; }
+
+    // Fast-forwards every engine for duration seconds with its monitor, one meter per job
+    static void runFleet(const std::vector<MeteringEngine*>& engines, const std::vector<EN50160Monitor*>& monitors,
+                         double duration, double timeStep, unsigned int threadCount = 0);
+
+    static double harmonicLimit(int order);  // % of Un
+    static void writeReport(std::ostream& out, const EN50160Report& report);
+
+private:
+    struct Requirement {
+        double lower;
+        double upper;
+        double fraction;
+        uint64_t within;
+    };
+
+    struct Statistic {
+        std::string name;
+        std::string unit;
+        QuantileSketch sketch;
+        std::vector<Requirement> requirements;
+    };
+
+    // Instantaneous values read from the engine once per update
+    struct Snapshot {
+        double frequency;
+        double voltage[3];
+        double harmonic[3][MAX_HARMONIC + 1];  // % of Un
+        double thd[3];                         // %
+        double unbalance;                      // %
+    };
+
+    int addStatistic(const std::string& name, const std::string& unit);
+    void addRequirement(int statistic, double lower, double upper, double fraction);
+    void record(int statistic, double value);
+    void readSnapshot(const MeteringEngine& engine, Snapshot& snapshot) const;
+    void accumulate(const Snapshot& snapshot, double weight);
+    void closeBlock();
+
+    double m_nominalVoltage;
+    double m_nominalFrequency;
+    bool m_threePhase;
+    int m_phases;
+
+    std::vector<Statistic> m_statistics;
+    int m_frequencyStat;
+    int m_voltageStat[3];
+    int m_thdStat[3];
+    int m_harmonicStat[3][MAX_HARMONIC + 1];
+    int m_unbalanceStat;
+    int m_pltStat[3];
+
+    // 200 ms blocks, counted from the simulation clock
+    static constexpr double BLOCK = 0.2;
+    static constexpr int BLOCKS_PER_FREQUENCY = 50;   // 10 s
+    static constexpr int BLOCKS_PER_INTERVAL = 3000;  // 10 min
+    bool m_started;
+    double m_startTime;
+    double m_time;
+    int64_t m_block;            // index of the block being filled
+
+    double m_blockWeight;
+    double m_blockVoltage[3];   // sum of squares
+    double m_lastBlockRMS[3];   // previous 200 ms RMS, -1 before the first
+    double m_flickerSum[3];     // sum of IEC 61000-3-3 flicker times over the interval
+
+    double m_frequencyWeight;
+    double m_frequencySum;
+
+    double m_intervalWeight;
+    double m_voltageSquares[3];
+    double m_harmonicSquares[3][MAX_HARMONIC + 1];
+    double m_thdSquares[3];
+    double m_unbalanceSquares;
+
+    std::vector<double> m_pstHistory[3];  // last 12 Pst values per phase
+    uint64_t m_intervalCount;
+};
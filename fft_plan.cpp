@@ -0,0 +1,161 @@
+
+#include "fft_plan.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+FFTPlan::FFTPlan(int length)
+    : m_length(std::max(length, 1))
+{
+    // Radix 4 first, then 2, then odd factors; the remainder is treated as one prime radix
+    int remaining = m_length;
+    for (int radix : {4, 2, 3, 5}) {
+        while (remaining % radix == 0) {
+            m_factors.push_back(radix);
+            remaining /= radix;
+        }
+    }
+    for (int radix = 7; remaining > 1; radix += 2) {
+        while (remaining % radix == 0) {
+            m_factors.push_back(radix);
+            remaining /= radix;
+        }
+        if (radix * radix > remaining && remaining > 1) {
+            m_factors.push_back(remaining);
+            remaining = 1;
+        }
+    }
+    if (m_factors.empty()) {
+        m_factors.push_back(1);
+    }
+    m_maxRadix = *std::max_element(m_factors.begin(), m_factors.end());
+
+    m_twiddles.resize(m_length);
+    for (int j = 0; j < m_length; j++) {
+        m_twiddles[j] = std::polar(1.0, -2.0 * M_PI * j / m_length);
+    }
+}
+
+std::shared_ptr<const FFTPlan> FFTPlan::get(int length)
+{
+    static std::mutex mutex;
+    static std::map<int, std::shared_ptr<const FFTPlan>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& plan = plans[length];
+    if (!plan) {
+        plan = std::make_shared<const FFTPlan>(length);
+    }
+    return plan;
+}
+
+void FFTPlan::forward(const std::complex<double>* in, std::complex<double>* out) const
+{
+    if (m_maxRadix <= STACK_RADIX) {
+        std::complex<double> work[STACK_RADIX];
+        execute(in, out, work);
+    } else {
+        std::vector<std::complex<double>> work(m_maxRadix);
+        execute(in, out, work.data());
+    }
+}
+
+void FFTPlan::execute(const std::complex<double>* in, std::complex<double>* out, std::complex<double>* work) const
+{
+    if (m_length == 1) {
+        out[0] = in[0];
+        return;
+    }
+    transform(out, in, 1, 0, m_length, work);
+}
+
+void FFTPlan::transform(std::complex<double>* out, const std::complex<double>* in,
+                        int stride, int stage, int length, std::complex<double>* work) const
+{
+    const int radix = m_factors[stage];
+    const int count = length / radix;
+
+    if (count == 1) {
+        for (int q = 0; q < radix; q++) {
+            out[q] = in[q * stride];
+        }
+    } else {
+        for (int q = 0; q < radix; q++) {
+            transform(out + q * count, in + q * stride, stride * radix, stage + 1, count, work);
+        }
+    }
+
+    butterfly(out, stride, radix, count, work);
+}
+
+void FFTPlan::butterfly(std::complex<double>* out, int twiddleStride, int radix, int count,
+                        std::complex<double>* work) const
+{
+    const std::complex<double>* w = m_twiddles.data();
+
+    if (radix == 2) {
+        for (int k = 0; k < count; k++) {
+            std::complex<double> t = out[k + count] * w[k * twiddleStride];
+            out[k + count] = out[k] - t;
+            out[k] += t;
+        }
+        return;
+    }
+
+    if (radix == 4) {
+        for (int k = 0; k < count; k++) {
+            std::complex<double> a0 = out[k];
+            std::complex<double> a1 = out[k + count] * w[k * twiddleStride];
+            std::complex<double> a2 = out[k + 2 * count] * w[2 * k * twiddleStride];
+            std::complex<double> a3 = out[k + 3 * count] * w[3 * k * twiddleStride];
+            std::complex<double> t0 = a0 + a2, t1 = a0 - a2, t2 = a1 + a3, t3 = a1 - a3;
+            std::complex<double> jt3(t3.imag(), -t3.real());  // -i * t3
+            out[k] = t0 + t2;
+            out[k + count] = t1 + jt3;
+            out[k + 2 * count] = t0 - t2;
+            out[k + 3 * count] = t1 - jt3;
+        }
+        return;
+    }
+
+    // Generic radix: direct DFT of the twiddled inputs
+    std::complex<double>* scratch = work;
+    const int blockStride = count * twiddleStride;  // N / radix
+    for (int k = 0; k < count; k++) {
+        for (int q = 0; q < radix; q++) {
+            scratch[q] = out[k + q * count] * w[(static_cast<long>(q) * k * twiddleStride) % m_length];
+        }
+        for (int u = 0; u < radix; u++) {
+            std::complex<double> sum = scratch[0];
+            for (int q = 1; q < radix; q++) {
+                sum += scratch[q] * w[(static_cast<long>(q) * u * blockStride) % m_length];
+            }
+            out[k + u * count] = sum;
+        }
+    }
+}
+
+void FFTPlan::forwardRealPair(const double* a, const double* b,
+                              std::complex<double>* spectrumA, std::complex<double>* spectrumB,
+                              std::vector<std::complex<double>>& scratch) const
+{
+    const int n = m_length;
+    scratch.resize(realPairScratchSize());
+    std::complex<double>* packed = scratch.data();
+    std::complex<double>* result = scratch.data() + n;
+
+    for (int i = 0; i < n; i++) {
+        packed[i] = std::complex<double>(a[i], b[i]);
+    }
+    execute(packed, result, scratch.data() + 2 * n);
+
+    // Hermitian symmetry separates the two real spectra
+    for (int k = 0; k <= n / 2; k++) {
+        std::complex<double> z = result[k];
+        std::complex<double> zc = std::conj(result[(n - k) % n]);
+        spectrumA[k] = 0.5 * (z + zc);
+        std::complex<double> d = 0.5 * (z - zc);
+        spectrumB[k] = std::complex<double>(d.imag(), -d.real());
+    }
+}
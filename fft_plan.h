@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+
+// Mixed-radix (2, 3, 4, 5, generic) decimation-in-time FFT of a fixed length.
+// The factorisation and twiddle table are built once; a plan is immutable
+// afterwards and may be shared between channels, analysers and threads.
+class FFTPlan
+{
+public:
+    explicit FFTPlan(int length);
+
+    // Shared plan for a length, built on first use
+    static std::shared_ptr<const FFTPlan> get(int length);
+
+    int size() const { return m_length; }
+
+    // Forward transform, out[k] = sum x[n] exp(-2 pi i n k / N); in and out must not alias.
+    // Lengths with a prime factor above STACK_RADIX allocate one work buffer per call.
+    static constexpr int STACK_RADIX = 16;
+    void forward(const std::complex<double>* in, std::complex<double>* out) const;
+
+    // Two real signals in one complex transform: a goes in the real part, b in the
+    // imaginary part. Only bins 0..N/2 are written to each spectrum. The scratch
+    // buffer is grown on first use and then reused, so repeated calls do not allocate;
+    // size it to realPairScratchSize() up front to keep the first call free of allocation too.
+    size_t realPairScratchSize() const { return 2 * static_cast<size_t>(m_length) + m_maxRadix; }
+    void forwardRealPair(const double* a, const double* b,
+                         std::complex<double>* spectrumA, std::complex<double>* spectrumB,
+                         std::vector<std::complex<double>>& scratch) const;
+
+private:
+    // work holds the twiddled inputs of one generic-radix butterfly, m_maxRadix values
+    void execute(const std::complex<double>* in, std::complex<double>* out, std::complex<double>* work) const;
+    void transform(std::complex<double>* out, const std::complex<double>* in,
+                   int stride, int stage, int length, std::complex<double>* work) const;
+    void butterfly(std::complex<double>* out, int twiddleStride, int radix, int count,
+                   std::complex<double>* work) const;
+
+    int m_length;
+    std::vector<int> m_factors;  // radix per stage, outermost first
+    int m_maxRadix;
+    std::vector<std::complex<double>> m_twiddles;
+};
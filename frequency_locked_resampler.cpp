@@ -0,0 +1,265 @@
+
+#include "frequency_locked_resampler.h"
+#include "metering_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int CHANNELS = FrequencyLockedResampler::CHANNELS;
+constexpr int TAPS = FrequencyLockedResampler::TAPS;
+constexpr int TAPS_BEFORE = TAPS / 2 - 1;  // taps at or before the integer position, minus one
+
+// Farrow matrix of the Lagrange interpolator on nodes -2..3: the weight of tap t
+// at fractional position mu is the sum over p of value[t][p] * mu^p
+struct FarrowMatrix {
+    double value[TAPS][TAPS];
+    FarrowMatrix()
+    {
+        for (int t = 0; t < TAPS; t++) {
+            double poly[TAPS] = {1.0};
+            int degree = 0;
+            double denominator = 1.0;
+            for (int m = 0; m < TAPS; m++) {
+                if (m == t) continue;
+                double node = m - TAPS_BEFORE;
+                // poly *= (mu - node)
+                for (int p = degree + 1; p > 0; p--) {
+                    poly[p] = poly[p - 1] - node * poly[p];
+                }
+                poly[0] = -node * poly[0];
+                degree++;
+                denominator *= (t - TAPS_BEFORE) - node;
+            }
+            for (int p = 0; p < TAPS; p++) {
+                value[t][p] = poly[p] / denominator;
+            }
+        }
+    }
+};
+
+const FarrowMatrix& farrow()
+{
+    static const FarrowMatrix matrix;
+    return matrix;
+}
+
+}
+
+FrequencyLockedResampler::FrequencyLockedResampler()
+    : m_nominalFrequency(50.0)
+    , m_samplesPerCycle(256)
+    , m_inputRate(12800.0)
+    , m_externalFrequency(0.0)
+{
+    configure(50.0, 256);
+}
+
+void FrequencyLockedResampler::configure(double nominalFrequency, int samplesPerCycle)
+{
+    if (nominalFrequency <= 0.0 || samplesPerCycle < 4) {
+        return;
+    }
+
+    m_nominalFrequency = nominalFrequency;
+    m_samplesPerCycle = samplesPerCycle;
+
+    m_cosTable.resize(samplesPerCycle);
+    m_sinTable.resize(samplesPerCycle);
+    for (int n = 0; n < samplesPerCycle; n++) {
+        m_cosTable[n] = std::cos(2.0 * M_PI * n / samplesPerCycle);
+        m_sinTable[n] = std::sin(2.0 * M_PI * n / samplesPerCycle);
+    }
+    reset();
+}
+
+void FrequencyLockedResampler::reset()
+{
+    for (int c = 0; c < CHANNELS; c++) {
+        m_history[c].clear();
+        m_pending[c].clear();
+        m_last[c].assign(m_samplesPerCycle, 0.0);
+    }
+    m_pendingStart.clear();
+    m_pendingRate.clear();
+    m_historyStart = 0;
+    m_inputCount = 0;
+    m_inputStartTime = 0.0;
+    m_phases = 1;
+
+    m_frequency = m_measuredFrequency = m_nominalFrequency;
+    m_lastSample = 0.0;
+    m_lastCrossing = -1.0;
+    m_minimumPeriod = 0.6 * m_inputRate / m_nominalFrequency;
+
+    // The first output needs the taps before it
+    m_position = TAPS_BEFORE;
+    m_step = m_inputRate / (m_samplesPerCycle * m_frequency);
+    m_cyclePosition = 0;
+    m_cycleStart = m_position;
+    m_cycleCount = 0;
+}
+
+void FrequencyLockedResampler::process(const SampleBlock& block)
+{
+    const int count = block.count;
+    if (count <= 0) return;
+
+    if (m_inputCount == 0) {
+        m_inputStartTime = block.startTime;
+        m_inputRate = block.sampleRate;
+        m_minimumPeriod = 0.6 * m_inputRate / m_nominalFrequency;
+    }
+    m_phases = block.phases;
+
+    for (int ph = 0; ph < 3; ph++) {
+        for (int k = 0; k < 2; k++) {
+            std::vector<double>& history = m_history[ph + 3 * k];
+            size_t size = history.size();
+            history.resize(size + count, 0.0);
+            if (ph < block.phases) {
+                const std::vector<double>& input = k == 0 ? block.voltage[ph] : block.current[ph];
+                std::copy(input.begin(), input.begin() + count, history.begin() + size);
+            }
+        }
+    }
+
+    trackFrequency(block.voltage[0].data(), count);
+    m_inputCount += count;
+    interpolate(m_inputCount);
+
+    // Drop history no output can reach any more
+    uint64_t keep = static_cast<uint64_t>(std::floor(m_position)) - TAPS_BEFORE;
+    if (keep > m_historyStart + 1024) {
+        for (int c = 0; c < CHANNELS; c++) {
+            m_history[c].erase(m_history[c].begin(), m_history[c].begin() + (keep - m_historyStart));
+        }
+        m_historyStart = keep;
+    }
+}
+
+void FrequencyLockedResampler::trackFrequency(const double* voltage, int count)
+{
+    for (int i = 0; i < count; i++) {
+        double x = voltage[i];
+        if (m_lastSample < 0.0 && x >= 0.0) {
+            // Positive-going crossing, linearly interpolated between the two samples
+            double crossing = (m_inputCount + i - 1) + m_lastSample / (m_lastSample - x);
+            if (m_lastCrossing < 0.0) {
+                m_lastCrossing = crossing;
+            } else if (crossing - m_lastCrossing >= m_minimumPeriod) {
+                // Shorter intervals are noise or harmonics re-crossing zero and are skipped
+                double frequency = m_inputRate / (crossing - m_lastCrossing);
+                m_measuredFrequency = std::min(std::max(frequency, 0.5 * m_nominalFrequency), 1.5 * m_nominalFrequency);
+                m_lastCrossing = crossing;
+            }
+        }
+        m_lastSample = x;
+    }
+}
+
+void FrequencyLockedResampler::interpolate(uint64_t inputEnd)
+{
+    const int n = m_samplesPerCycle;
+
+    // Output positions first; the step only changes at cycle starts
+    m_index.clear();
+    m_fraction.clear();
+    while (static_cast<uint64_t>(std::floor(m_position)) + TAPS - TAPS_BEFORE <= inputEnd) {
+        if (m_cyclePosition == 0) {
+            m_frequency = m_externalFrequency > 0.0 ? m_externalFrequency : m_measuredFrequency;
+            m_step = m_inputRate / (n * m_frequency);
+            m_cycleStart = m_position;
+            m_pendingStart.push_back(m_inputStartTime + m_position / m_inputRate);
+            m_pendingRate.push_back(n * m_frequency);
+        }
+
+        double whole = std::floor(m_position);
+        m_index.push_back(static_cast<int64_t>(whole) - TAPS_BEFORE - static_cast<int64_t>(m_historyStart));
+        m_fraction.push_back(m_position - whole);
+
+        // Positions are taken from the cycle start so the step error does not accumulate
+        if (++m_cyclePosition == n) {
+            m_cyclePosition = 0;
+            m_position = m_cycleStart + n * m_step;
+        } else {
+            m_position = m_cycleStart + m_cyclePosition * m_step;
+        }
+    }
+
+    const size_t outputs = m_index.size();
+    if (outputs == 0) return;
+
+    // Farrow weights once for all channels
+    const FarrowMatrix& matrix = farrow();
+    const double* mu = m_fraction.data();
+    for (int t = 0; t < TAPS; t++) {
+        m_weights[t].resize(outputs);
+        double* w = m_weights[t].data();
+        const double* f = matrix.value[t];
+        for (size_t i = 0; i < outputs; i++) {
+            double value = f[TAPS - 1];
+            for (int p = TAPS - 2; p >= 0; p--) {
+                value = value * mu[i] + f[p];
+            }
+            w[i] = value;
+        }
+    }
+
+    const int64_t* index = m_index.data();
+    const double* w0 = m_weights[0].data();
+    const double* w1 = m_weights[1].data();
+    const double* w2 = m_weights[2].data();
+    const double* w3 = m_weights[3].data();
+    const double* w4 = m_weights[4].data();
+    const double* w5 = m_weights[5].data();
+    for (int c = 0; c < CHANNELS; c++) {
+        std::vector<double>& pending = m_pending[c];
+        size_t size = pending.size();
+        pending.resize(size + outputs);
+        double* out = pending.data() + size;
+        const double* x = m_history[c].data();
+        for (size_t i = 0; i < outputs; i++) {
+            const double* taps = x + index[i];
+            out[i] = w0[i] * taps[0] + w1[i] * taps[1] + w2[i] * taps[2] +
+                     w3[i] * taps[3] + w4[i] * taps[4] + w5[i] * taps[5];
+        }
+    }
+}
+
+bool FrequencyLockedResampler::nextCycle(SampleBlock& cycle)
+{
+    const int n = m_samplesPerCycle;
+    if (m_pending[0].size() < static_cast<size_t>(n)) {
+        return false;
+    }
+
+    cycle.startTime = m_pendingStart.front();
+    cycle.sampleRate = m_pendingRate.front();
+    cycle.count = n;
+    cycle.phases = m_phases;
+    for (int c = 0; c < CHANNELS; c++) {
+        std::vector<double>& target = c < 3 ? cycle.voltage[c] : cycle.current[c - 3];
+        target.assign(m_pending[c].begin(), m_pending[c].begin() + n);
+        m_last[c].assign(m_pending[c].begin(), m_pending[c].begin() + n);
+        m_pending[c].erase(m_pending[c].begin(), m_pending[c].begin() + n);
+    }
+    m_pendingStart.erase(m_pendingStart.begin());
+    m_pendingRate.erase(m_pendingRate.begin());
+    m_cycleCount++;
+    return true;
+}
+
+std::complex<double> FrequencyLockedResampler::getFundamental(int channel) const
+{
+    // Single DFT bin; the cycle holds exactly one period so there is no leakage
+    const double* x = m_last[channel].data();
+    const double* c = m_cosTable.data();
+    const double* s = m_sinTable.data();
+    double re = 0.0, im = 0.0;
+    for (int i = 0; i < m_samplesPerCycle; i++) {
+        re += x[i] * c[i];
+        im -= x[i] * s[i];
+    }
+    return std::sqrt(2.0) / m_samplesPerCycle * std::complex<double>(re, im);
+}
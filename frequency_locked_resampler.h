@@ -0,0 +1,87 @@
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+
+struct SampleBlock;
+
+// Resamples the fixed-rate sample stream onto a grid of exactly N samples per
+// mains cycle at the tracked frequency, so cycle-based windows stay coherent
+// when the frequency drifts. The frequency comes from the zero crossings of
+// the phase A voltage unless an external measurement is supplied. Output
+// samples are interpolated with a six-tap Lagrange fractional-delay filter in
+// Farrow form: the tap weights depend only on the fractional position, so they
+// are evaluated once per output sample for all six channels.
+class FrequencyLockedResampler
+{
+public:
+    static constexpr int CHANNELS = 6;  // voltages A-C, then currents A-C
+    static constexpr int TAPS = 6;
+
+    FrequencyLockedResampler();
+
+    void configure(double nominalFrequency, int samplesPerCycle);
+    void reset();
+
+    // External frequency measurement; 0 returns to zero-crossing tracking
+    void setFrequency(double frequency) { m_externalFrequency = frequency; }
+    double getFrequency() const { return m_frequency; }
+    int getSamplesPerCycle() const { return m_samplesPerCycle; }
+
+    void process(const SampleBlock& block);
+
+    // Moves the oldest complete output cycle into cycle; false when none is ready.
+    // cycle.sampleRate is samplesPerCycle times the frequency used for that cycle.
+    bool nextCycle(SampleBlock& cycle);
+    uint64_t getCycleCount() const { return m_cycleCount; }
+
+    // Fundamental of the last cycle returned by nextCycle(), as an RMS phasor against a cosine
+    std::complex<double> getFundamental(int channel) const;
+
+private:
+    void trackFrequency(const double* voltage, int count);
+    void interpolate(uint64_t inputEnd);
+
+    double m_nominalFrequency;
+    int m_samplesPerCycle;
+    double m_inputRate;
+    double m_externalFrequency;
+    double m_frequency;         // frequency driving the current output cycle
+    double m_measuredFrequency; // from the latest full period between crossings
+    int m_phases;
+
+    // Input history per channel; element 0 is absolute input sample m_historyStart
+    std::vector<double> m_history[CHANNELS];
+    uint64_t m_historyStart;
+    uint64_t m_inputCount;
+    double m_inputStartTime;    // time of absolute input sample 0
+
+    // Zero-crossing tracker on the phase A voltage
+    double m_lastSample;
+    double m_lastCrossing;      // in input samples, negative before the first
+    double m_minimumPeriod;
+
+    // Output grid in input-sample units
+    double m_position;          // next output sample
+    double m_step;              // input samples per output sample for the current cycle
+    int m_cyclePosition;        // output samples already produced in the current cycle
+    double m_cycleStart;        // position of the current cycle's first output sample
+
+    // Output samples not yet handed out, with the start time and rate of each pending cycle
+    std::vector<double> m_pending[CHANNELS];
+    std::vector<double> m_pendingStart;
+    std::vector<double> m_pendingRate;
+    uint64_t m_cycleCount;
+
+    // Last cycle handed out, for getFundamental()
+    std::vector<double> m_last[CHANNELS];
+    std::vector<double> m_cosTable;
+    std::vector<double> m_sinTable;
+
+    // Per-call Farrow state shared by the channels, structure of arrays
+    std::vector<int64_t> m_index;
+    std::vector<double> m_fraction;
+    std::vector<double> m_weights[TAPS];
+};
@@ -0,0 +1,387 @@
+
+#include "golden_trace.h"
+#include "metering_engine.h"
+#include "waveform_codec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr char MAGIC[8] = {'S', 'M', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint32_t VERSION = 2;
+constexpr int CHANNEL_COUNT = static_cast<int>(TraceChannel::Count);
+constexpr int STRIP = 16;  // values checked per branch-free strip
+
+bool isSampleChannel(TraceChannel channel)
+{
+    return channel <= TraceChannel::CurrentC;
+}
+
+template <typename T>
+void writeValue(std::ofstream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool readValue(std::ifstream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+// Signed integers in the same order as the doubles they encode
+int64_t orderedBits(double value)
+{
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? std::numeric_limits<int64_t>::min() - bits : bits;
+}
+
+enum class ChunkStatus { End, Ok, Bad };
+
+// A chunk is its channel id followed by one codec block
+ChunkStatus readChunk(std::ifstream& in, uint8_t& id, std::vector<uint8_t>& block, std::vector<double>& values)
+{
+    if (!readValue(in, id)) return ChunkStatus::End;
+
+    block.resize(WaveformCodec::HEADER_SIZE);
+    if (!in.read(reinterpret_cast<char*>(block.data()), block.size())) return ChunkStatus::Bad;
+    block.resize(WaveformCodec::blockSize(block.data()));
+    if (!in.read(reinterpret_cast<char*>(block.data()) + WaveformCodec::HEADER_SIZE,
+                 block.size() - WaveformCodec::HEADER_SIZE)) {
+        return ChunkStatus::Bad;
+    }
+    return WaveformCodec::decode(block.data(), block.size(), values) == block.size() ? ChunkStatus::Ok : ChunkStatus::Bad;
+}
+
+struct TraceHeader {
+    double sampleRate;
+    std::vector<uint8_t> channels;
+};
+
+bool readHeader(std::ifstream& in, TraceHeader& header)
+{
+    char magic[sizeof(MAGIC)];
+    uint32_t version, count;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !readValue(in, version) || version != VERSION || !readValue(in, count) || count > CHANNEL_COUNT ||
+        !readValue(in, header.sampleRate)) {
+        return false;
+    }
+    header.channels.resize(count);
+    if (count > 0 && !in.read(reinterpret_cast<char*>(header.channels.data()), count)) {
+        return false;
+    }
+
+    // Ids index per-channel state, so a corrupt or foreign trace must not name an unknown or repeated one
+    bool seen[CHANNEL_COUNT] = {};
+    for (uint8_t id : header.channels) {
+        if (id >= CHANNEL_COUNT || seen[id]) {
+            return false;
+        }
+        seen[id] = true;
+    }
+    return true;
+}
+
+}
+
+const char* traceChannelName(TraceChannel channel)
+{
+    static const char* const NAMES[CHANNEL_COUNT] = {
+        "VoltageA", "VoltageB", "VoltageC", "CurrentA", "CurrentB", "CurrentC",
+        "Time", "VoltageRMS", "CurrentRMS",
+        "ActivePower", "ReactivePower", "ApparentPower", "PowerFactor",
+        "Frequency", "Energy", "THDVoltage", "THDCurrent"
+    };
+    int index = static_cast<int>(channel);
+    return index >= 0 && index < CHANNEL_COUNT ? NAMES[index] : "Unknown";
+}
+
+TraceRecorder::TraceRecorder()
+    : m_valueCount(0)
+    , m_engine(nullptr)
+    , m_listenerId(-1)
+    , m_subscriptionId(-1)
+{
+    std::fill(m_slot, m_slot + CHANNEL_COUNT, -1);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    disconnect();
+    close();
+}
+
+bool TraceRecorder::open(const std::string& path, const std::vector<TraceChannel>& channels, double sampleRate)
+{
+    close();
+
+    // Enum order fixes the chunk interleaving, and puts Time ahead of the measurements
+    m_channels.clear();
+    std::fill(m_slot, m_slot + CHANNEL_COUNT, -1);
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+        if (std::find(channels.begin(), channels.end(), static_cast<TraceChannel>(c)) != channels.end()) {
+            m_slot[c] = static_cast<int>(m_channels.size());
+            m_channels.push_back(static_cast<TraceChannel>(c));
+        }
+    }
+    m_buffers.assign(m_channels.size(), {});
+    for (auto& buffer : m_buffers) {
+        buffer.reserve(CHUNK);
+    }
+    m_valueCount = 0;
+
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        return false;
+    }
+
+    m_file.write(MAGIC, sizeof(MAGIC));
+    writeValue(m_file, VERSION);
+    writeValue(m_file, static_cast<uint32_t>(m_channels.size()));
+    writeValue(m_file, sampleRate);
+    for (TraceChannel channel : m_channels) {
+        writeValue(m_file, static_cast<uint8_t>(channel));
+    }
+    return static_cast<bool>(m_file);
+}
+
+void TraceRecorder::setCompression(WaveformEncoding encoding, double quantum)
+{
+    m_sampleCodec.configure(encoding, quantum);
+    m_measurementCodec.configure(encoding == WaveformEncoding::Raw ? WaveformEncoding::Raw : WaveformEncoding::Xor);
+}
+
+void TraceRecorder::close()
+{
+    if (!m_file.is_open()) return;
+
+    for (size_t slot = 0; slot < m_buffers.size(); slot++) {
+        flush(static_cast<int>(slot));
+    }
+    m_file.close();
+}
+
+void TraceRecorder::connect(MeteringEngine& engine)
+{
+    disconnect();
+    m_engine = &engine;
+
+    m_listenerId = engine.addSampleBlockListener([this](const SampleBlock& block) {
+        static const std::vector<double> silence(CHUNK, 0.0);
+        for (int ph = 0; ph < 3; ph++) {
+            const double* voltage = ph < block.phases ? block.voltage[ph].data() : silence.data();
+            const double* current = ph < block.phases ? block.current[ph].data() : silence.data();
+            append(static_cast<TraceChannel>(static_cast<int>(TraceChannel::VoltageA) + ph), voltage, block.count);
+            append(static_cast<TraceChannel>(static_cast<int>(TraceChannel::CurrentA) + ph), current, block.count);
+        }
+    });
+
+    m_subscriptionId = engine.subscribeMeasurements(MeasurementGroup::All, [this](const MeteringMeasurements& m) {
+        const double time = m_engine->getSimulationTime();
+        const std::pair<TraceChannel, double> values[] = {
+            {TraceChannel::Time, time},
+            {TraceChannel::VoltageRMS, m.voltageRMS}, {TraceChannel::CurrentRMS, m.currentRMS},
+            {TraceChannel::ActivePower, m.activePower}, {TraceChannel::ReactivePower, m.reactivePower},
+            {TraceChannel::ApparentPower, m.apparentPower}, {TraceChannel::PowerFactor, m.powerFactor},
+            {TraceChannel::Frequency, m.frequency}, {TraceChannel::Energy, m.energy},
+            {TraceChannel::THDVoltage, m.thd_voltage}, {TraceChannel::THDCurrent, m.thd_current}
+        };
+        for (const auto& value : values) {
+            append(value.first, &value.second, 1);
+        }
+    });
+}
+
+void TraceRecorder::disconnect()
+{
+    if (m_engine) {
+        m_engine->removeSampleBlockListener(m_listenerId);
+        m_engine->unsubscribeMeasurements(m_subscriptionId);
+    }
+    m_engine = nullptr;
+    m_listenerId = m_subscriptionId = -1;
+}
+
+void TraceRecorder::append(TraceChannel channel, const double* values, size_t count)
+{
+    int slot = m_slot[static_cast<int>(channel)];
+    if (slot < 0 || !m_file.is_open()) return;
+
+    std::vector<double>& buffer = m_buffers[slot];
+    while (count > 0) {
+        size_t take = std::min<size_t>(count, CHUNK - buffer.size());
+        buffer.insert(buffer.end(), values, values + take);
+        values += take;
+        count -= take;
+        m_valueCount += take;
+        if (buffer.size() == CHUNK) {
+            flush(slot);
+        }
+    }
+}
+
+void TraceRecorder::flush(int slot)
+{
+    std::vector<double>& buffer = m_buffers[slot];
+    if (buffer.empty()) return;
+
+    const WaveformCodec& codec = isSampleChannel(m_channels[slot]) ? m_sampleCodec : m_measurementCodec;
+    m_block.clear();
+    codec.encode(buffer.data(), buffer.size(), m_block);
+
+    writeValue(m_file, static_cast<uint8_t>(m_channels[slot]));
+    m_file.write(reinterpret_cast<const char*>(m_block.data()), m_block.size());
+    buffer.clear();
+}
+
+TraceComparator::TraceComparator()
+    : m_defaultTolerance{0.0, 0.0, 0}
+{
+}
+
+TraceTolerance TraceComparator::toleranceFor(const std::string& channel) const
+{
+    auto it = m_tolerances.find(channel);
+    return it != m_tolerances.end() ? it->second : m_defaultTolerance;
+}
+
+uint64_t TraceComparator::ulpDistance(double a, double b)
+{
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<uint64_t>::max();
+    }
+    int64_t x = orderedBits(a), y = orderedBits(b);
+    return x > y ? static_cast<uint64_t>(x) - static_cast<uint64_t>(y) : static_cast<uint64_t>(y) - static_cast<uint64_t>(x);
+}
+
+TraceComparison TraceComparator::compare(const std::string& expectedPath, const std::string& actualPath) const
+{
+    TraceComparison result = {};
+    std::ifstream expectedFile(expectedPath, std::ios::binary);
+    std::ifstream actualFile(actualPath, std::ios::binary);
+    TraceHeader expectedHeader, actualHeader;
+
+    if (!expectedFile || !readHeader(expectedFile, expectedHeader)) {
+        result.error = "cannot read trace " + expectedPath;
+        return result;
+    }
+    if (!actualFile || !readHeader(actualFile, actualHeader)) {
+        result.error = "cannot read trace " + actualPath;
+        return result;
+    }
+    if (expectedHeader.channels != actualHeader.channels || expectedHeader.sampleRate != actualHeader.sampleRate) {
+        result.error = "traces record different channels or sample rates";
+        return result;
+    }
+    result.compatible = true;
+
+    // Per-channel state, indexed by channel id
+    std::vector<TraceTolerance> tolerance(CHANNEL_COUNT);
+    std::vector<uint64_t> position(CHANNEL_COUNT, 0);
+    std::vector<int> summary(CHANNEL_COUNT, -1);
+    for (uint8_t id : expectedHeader.channels) {
+        const char* name = traceChannelName(static_cast<TraceChannel>(id));
+        tolerance[id] = toleranceFor(name);
+        summary[id] = static_cast<int>(result.channels.size());
+        result.channels.push_back({name, 0, 0.0, 0, 0});
+    }
+
+    // The latest Time chunk dates measurement divergences
+    std::vector<double> timeChunk;
+    uint64_t timeChunkStart = 0;
+
+    // Either trace may be compressed; chunks are compared after decoding
+    std::vector<uint8_t> block;
+    std::vector<double> expected, actual;
+    for (;;) {
+        uint8_t expectedId, actualId;
+        ChunkStatus expectedStatus = readChunk(expectedFile, expectedId, block, expected);
+        ChunkStatus actualStatus = readChunk(actualFile, actualId, block, actual);
+        if (expectedStatus == ChunkStatus::End && actualStatus == ChunkStatus::End) break;
+
+        if (expectedStatus == ChunkStatus::Bad || actualStatus == ChunkStatus::Bad) {
+            result.compatible = false;
+            result.error = "trace truncated or corrupt";
+            break;
+        }
+        if (expectedStatus != actualStatus || expectedId != actualId || expected.size() != actual.size() ||
+            expectedId >= CHANNEL_COUNT || summary[expectedId] < 0) {
+            result.compatible = false;
+            result.error = "trace layouts diverge after " + std::to_string(result.valuesCompared) + " values";
+            break;
+        }
+
+        const size_t count = expected.size();
+
+        const TraceChannel channel = static_cast<TraceChannel>(expectedId);
+        if (channel == TraceChannel::Time) {
+            timeChunk.assign(expected.begin(), expected.begin() + count);
+            timeChunkStart = position[expectedId];
+        }
+
+        const TraceTolerance& tol = tolerance[expectedId];
+        TraceChannelSummary& stats = result.channels[summary[expectedId]];
+        const double* a = expected.data();
+        const double* b = actual.data();
+
+        // Strips of branch-free checks; a strip with any violation is rescanned in order
+        for (size_t start = 0; start < count; start += STRIP) {
+            const size_t end = std::min(count, start + STRIP);
+            int bad = 0;
+            double maxError = 0.0;
+            for (size_t i = start; i < end; i++) {
+                double error = std::abs(a[i] - b[i]);
+                double scale = std::max(std::abs(a[i]), std::abs(b[i]));
+                bool within = a[i] == b[i] || error <= tol.absolute || error <= tol.relative * scale;
+                bad += !within;
+                maxError = error > maxError ? error : maxError;
+            }
+            stats.maxAbsoluteError = std::max(stats.maxAbsoluteError, maxError);
+            if (bad == 0) continue;
+
+            for (size_t i = start; i < end; i++) {
+                double error = std::abs(a[i] - b[i]);
+                double scale = std::max(std::abs(a[i]), std::abs(b[i]));
+                if (a[i] == b[i] || error <= tol.absolute || error <= tol.relative * scale) continue;
+
+                // Bitwise-identical NaNs and values within the ULP budget still pass
+                uint64_t ulps = ulpDistance(a[i], b[i]);
+                if (!std::isnan(a[i]) || !std::isnan(b[i])) {
+                    stats.maxUlps = std::max(stats.maxUlps, ulps);
+                }
+                if (ulps <= tol.ulps) continue;
+                if (std::isnan(a[i]) || std::isnan(b[i])) {
+                    stats.maxAbsoluteError = std::numeric_limits<double>::infinity();
+                }
+
+                stats.violations++;
+                if (!result.diverged) {
+                    uint64_t index = position[expectedId] + i;
+                    result.diverged = true;
+                    result.channel = stats.name;
+                    result.index = index;
+                    result.expected = a[i];
+                    result.actual = b[i];
+                    if (isSampleChannel(channel)) {
+                        result.time = index / expectedHeader.sampleRate;
+                    } else if (index >= timeChunkStart && index - timeChunkStart < timeChunk.size()) {
+                        result.time = timeChunk[index - timeChunkStart];
+                    } else {
+                        result.time = -1.0;
+                    }
+                }
+            }
+        }
+
+        position[expectedId] += count;
+        stats.values += count;
+        result.valuesCompared += count;
+    }
+
+    result.passed = result.compatible && !result.diverged;
+    return result;
+}
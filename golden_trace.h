@@ -0,0 +1,126 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <cstdint>
+#include "waveform_codec.h"
+
+class MeteringEngine;
+
+// Channels a trace can carry. Sample channels are written at the sample
+// rate; measurement channels at each measurement boundary (a mains cycle, or
+// an analysis window while harmonic analysis runs), alongside Time.
+enum class TraceChannel : uint8_t {
+    VoltageA, VoltageB, VoltageC,
+    CurrentA, CurrentB, CurrentC,
+    Time,
+    VoltageRMS, CurrentRMS,
+    ActivePower, ReactivePower, ApparentPower, PowerFactor,
+    Frequency, Energy,
+    THDVoltage, THDCurrent,
+    Count
+};
+
+const char* traceChannelName(TraceChannel channel);
+
+// Records engine outputs to a compact binary trace: a header naming the
+// channels, then chunks of up to CHUNK values of one channel each, stored as
+// WaveformCodec blocks (lossless XOR unless configured otherwise). Chunks of
+// a channel appear in order and the interleaving is fixed by the recording,
+// so two traces of the same scenario can be compared chunk by chunk while
+// streaming, however large they are.
+class TraceRecorder
+{
+public:
+    static constexpr uint32_t CHUNK = 4096;
+
+    TraceRecorder();
+    ~TraceRecorder();
+
+    bool open(const std::string& path, const std::vector<TraceChannel>& channels, double sampleRate);
+    void close();
+    bool isOpen() const { return m_file.is_open(); }
+
+    // Encoding of the sample channels; measurements stay lossless unless Raw is chosen
+    void setCompression(WaveformEncoding encoding, double quantum = 0.0);
+
+    // Records the selected channels of every sample block and of each measurement update
+    void connect(MeteringEngine& engine);
+    void disconnect();
+
+    void append(TraceChannel channel, const double* values, size_t count);
+    uint64_t getValueCount() const { return m_valueCount; }
+
+private:
+    void flush(int slot);
+
+    std::ofstream m_file;
+    std::vector<TraceChannel> m_channels;
+    int m_slot[static_cast<int>(TraceChannel::Count)];  // channel -> buffer, -1 when not recorded
+    std::vector<std::vector<double>> m_buffers;
+    uint64_t m_valueCount;
+    WaveformCodec m_sampleCodec;
+    WaveformCodec m_measurementCodec;
+    std::vector<uint8_t> m_block;
+
+    MeteringEngine* m_engine;
+    int m_listenerId;
+    int m_subscriptionId;
+};
+
+// Pass when any of the three holds; all zero means bit-exact
+struct TraceTolerance {
+    double absolute;
+    double relative;   // of the larger magnitude
+    uint64_t ulps;
+};
+
+struct TraceChannelSummary {
+    std::string name;
+    uint64_t values;
+    double maxAbsoluteError;
+    uint64_t maxUlps;
+    uint64_t violations;
+};
+
+struct TraceComparison {
+    bool compatible;           // same channels in the same layout
+    bool passed;
+    std::string error;         // structural problem, if any
+
+    // First value out of tolerance
+    bool diverged;
+    std::string channel;
+    uint64_t index;            // value index within the channel
+    double time;               // seconds; -1 for measurements recorded without Time
+    double expected;
+    double actual;
+
+    uint64_t valuesCompared;
+    std::vector<TraceChannelSummary> channels;
+};
+
+// Streams two traces and diffs them channel by channel. Chunks are checked in
+// fixed-width strips with branch-free arithmetic so the compiler can vectorise
+// the hot loop; only a strip containing a violation is rescanned to locate it.
+class TraceComparator
+{
+public:
+    TraceComparator();
+
+    void setDefaultTolerance(const TraceTolerance& tolerance) { m_defaultTolerance = tolerance; }
+    void setTolerance(const std::string& channel, const TraceTolerance& tolerance) { m_tolerances[channel] = tolerance; }
+
+    TraceComparison compare(const std::string& expectedPath, const std::string& actualPath) const;
+
+    static uint64_t ulpDistance(double a, double b);
+
+private:
+    TraceTolerance toleranceFor(const std::string& channel) const;
+
+    TraceTolerance m_defaultTolerance;
+    std::map<std::string, TraceTolerance> m_tolerances;
+};
@@ -0,0 +1,224 @@
+
+#include "harmonic_analyzer.h"
+#include "metering_engine.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int CHANNELS = HarmonicGroupResult::CHANNELS;
+constexpr int MAX_ORDER = HarmonicGroupResult::MAX_ORDER;
+
+}
+
+HarmonicAnalyzer::HarmonicAnalyzer()
+    : m_windowLength(0)
+    , m_cycles(10)
+    , m_sampleRate(0.0)
+    , m_deferred(false)
+{
+    configure(50.0, 12800.0);
+}
+
+void HarmonicAnalyzer::configure(double nominalFrequency, double sampleRate)
+{
+    if (nominalFrequency <= 0.0 || sampleRate <= 0.0) {
+        return;
+    }
+
+    // 10 cycles on 50 Hz systems, 12 on 60 Hz: about 200 ms and 5 Hz bins either way
+    m_cycles = nominalFrequency > 55.0 ? 12 : 10;
+    m_sampleRate = sampleRate;
+    int length = static_cast<int>(std::lround(m_cycles * sampleRate / nominalFrequency));
+
+    if (length != m_windowLength) {
+        m_windowLength = length;
+        m_plan = FFTPlan::get(length);
+    }
+
+    // Squared RMS of every bin up to the highest one any group touches; 10 and 12 cycles
+    // can share a window length, so this follows the cycle count too
+    const int used = std::min(length / 2, (MAX_ORDER + 1) * m_cycles);
+    for (int c = 0; c < CHANNELS; c++) {
+        m_spectrum[c].assign(length / 2 + 1, 0.0);
+        m_power[c].assign(used + 1, 0.0);
+    }
+    for (int ph = 0; ph < 3; ph++) {
+        m_scratch[ph].assign(m_plan->realPairScratchSize(), 0.0);
+    }
+    reset();
+}
+
+void HarmonicAnalyzer::reset()
+{
+    for (int c = 0; c < CHANNELS; c++) {
+        m_filling[c].assign(m_windowLength, 0.0);
+        m_captured[c].assign(m_windowLength, 0.0);
+    }
+    m_fillCount = 0;
+    m_fillStartTime = 0.0;
+    m_capturedStartTime = 0.0;
+    m_capturedPhases = 1;
+    m_pending = false;
+    m_result = {};
+    m_windowCount = 0;
+}
+
+void HarmonicAnalyzer::process(const SampleBlock& block)
+{
+    int offset = 0;
+    while (offset < block.count) {
+        if (m_fillCount == 0) {
+            m_fillStartTime = block.startTime + offset / block.sampleRate;
+        }
+
+        int take = std::min(block.count - offset, m_windowLength - m_fillCount);
+        for (int ph = 0; ph < block.phases; ph++) {
+            std::copy(block.voltage[ph].begin() + offset, block.voltage[ph].begin() + offset + take,
+                      m_filling[ph].begin() + m_fillCount);
+            std::copy(block.current[ph].begin() + offset, block.current[ph].begin() + offset + take,
+                      m_filling[3 + ph].begin() + m_fillCount);
+        }
+        m_fillCount += take;
+        offset += take;
+
+        // Windows are back to back; an unconsumed deferred window is overwritten
+        if (m_fillCount == m_windowLength) {
+            for (int c = 0; c < CHANNELS; c++) {
+                m_captured[c].swap(m_filling[c]);
+            }
+            m_capturedStartTime = m_fillStartTime;
+            m_capturedPhases = block.phases;
+            m_fillCount = 0;
+            m_pending = true;
+
+            if (!m_deferred) {
+                analyzePending();
+            }
+        }
+    }
+}
+
+void HarmonicAnalyzer::analyzePending()
+{
+    if (!m_pending) return;
+
+    for (int ph = 0; ph < m_capturedPhases; ph++) {
+        analyzePair(ph);
+    }
+    completeWindow();
+}
+
+void HarmonicAnalyzer::completeWindow()
+{
+    // Phases absent from the window report zero
+    for (int ph = m_capturedPhases; ph < 3; ph++) {
+        for (int c : {ph, 3 + ph}) {
+            std::fill(m_result.group[c], m_result.group[c] + MAX_ORDER + 1, 0.0);
+            std::fill(m_result.subgroup[c], m_result.subgroup[c] + MAX_ORDER + 1, 0.0);
+            std::fill(m_result.interharmonicGroup[c], m_result.interharmonicGroup[c] + MAX_ORDER + 1, 0.0);
+            std::fill(m_result.interharmonicSubgroup[c], m_result.interharmonicSubgroup[c] + MAX_ORDER + 1, 0.0);
+            std::fill(m_result.phase[c], m_result.phase[c] + MAX_ORDER + 1, 0.0);
+            m_result.thdGroup[c] = 0.0;
+            m_result.thdSubgroup[c] = 0.0;
+        }
+    }
+
+    m_result.startTime = m_capturedStartTime;
+    m_result.cycles = m_cycles;
+    m_result.binWidth = m_sampleRate / m_windowLength;
+    m_pending = false;
+    m_windowCount++;
+}
+
+void HarmonicAnalyzer::analyzePair(int phase)
+{
+    m_plan->forwardRealPair(m_captured[phase].data(), m_captured[3 + phase].data(),
+                            m_spectrum[phase].data(), m_spectrum[3 + phase].data(), m_scratch[phase]);
+
+    groupSpectrum(phase, m_spectrum[phase].data());
+    groupSpectrum(3 + phase, m_spectrum[3 + phase].data());
+}
+
+void HarmonicAnalyzer::groupSpectrum(int channel, const std::complex<double>* spectrum)
+{
+    const int n = m_windowLength;
+    const int lastBin = n / 2;
+    const int b = m_cycles;
+    const int half = b / 2;
+
+    // Squared RMS per bin, as far as configure() sized the buffer
+    const int used = static_cast<int>(m_power[channel].size()) - 1;
+    double* power = m_power[channel].data();
+    power[0] = std::norm(spectrum[0]) / (double(n) * n);
+    for (int k = 1; k <= used; k++) {
+        power[k] = 2.0 * std::norm(spectrum[k]) / (double(n) * n);
+    }
+    auto bin = [&](int k) { return k >= 0 && k <= used ? power[k] : 0.0; };
+
+    double* group = m_result.group[channel];
+    double* subgroup = m_result.subgroup[channel];
+    double* interGroup = m_result.interharmonicGroup[channel];
+    double* interSubgroup = m_result.interharmonicSubgroup[channel];
+
+    group[0] = subgroup[0] = std::sqrt(power[0]);
+    m_result.phase[channel][0] = 0.0;
+
+    for (int h = 0; h <= MAX_ORDER; h++) {
+        const int k = h * b;
+
+        if (h > 0) {
+            double g = 0.5 * (bin(k - half) + bin(k + half));
+            for (int i = -half + 1; i <= half - 1; i++) {
+                g += bin(k + i);
+            }
+            group[h] = std::sqrt(g);
+            subgroup[h] = std::sqrt(bin(k - 1) + bin(k) + bin(k + 1));
+            m_result.phase[channel][h] = k <= lastBin ? std::arg(spectrum[k]) * 180.0 / M_PI : 0.0;
+        }
+
+        double ig = 0.0, isg = 0.0;
+        for (int i = 1; i <= b - 1; i++) {
+            ig += bin(k + i);
+            if (i >= 2 && i <= b - 2) {
+                isg += bin(k + i);
+            }
+        }
+        interGroup[h] = std::sqrt(ig);
+        interSubgroup[h] = std::sqrt(isg);
+    }
+
+    double groupSum = 0.0, subgroupSum = 0.0;
+    for (int h = 2; h <= MAX_ORDER; h++) {
+        groupSum += group[h] * group[h];
+        subgroupSum += subgroup[h] * subgroup[h];
+    }
+    m_result.thdGroup[channel] = group[1] > 0.0 ? std::sqrt(groupSum) / group[1] * 100.0 : 0.0;
+    m_result.thdSubgroup[channel] = subgroup[1] > 0.0 ? std::sqrt(subgroupSum) / subgroup[1] * 100.0 : 0.0;
+}
+
+void HarmonicAnalyzer::analyzeFleet(const std::vector<HarmonicAnalyzer*>& analyzers, unsigned int threadCount)
+{
+    // One job per phase pair of every pending window
+    std::vector<std::pair<HarmonicAnalyzer*, int>> jobs;
+    for (HarmonicAnalyzer* analyzer : analyzers) {
+        if (analyzer && analyzer->m_pending) {
+            for (int ph = 0; ph < analyzer->m_capturedPhases; ph++) {
+                jobs.push_back({analyzer, ph});
+            }
+        }
+    }
+    if (jobs.empty()) return;
+
+    // Jobs write disjoint channels of their analyser's result
+    parallelFor(jobs.size(), threadCount, [&](size_t i) {
+        jobs[i].first->analyzePair(jobs[i].second);
+    });
+
+    for (HarmonicAnalyzer* analyzer : analyzers) {
+        if (analyzer && analyzer->m_pending) {
+            analyzer->completeWindow();
+        }
+    }
+}
@@ -0,0 +1,92 @@
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <cstdint>
+#include "fft_plan.h"
+
+struct SampleBlock;
+
+// Results of one IEC 61000-4-7 window. Values are RMS; channels 0-2 are
+// voltages A-C, 3-5 currents A-C. Index h of the interharmonic arrays is the
+// band between orders h and h + 1.
+struct HarmonicGroupResult {
+    static constexpr int CHANNELS = 6;
+    static constexpr int MAX_ORDER = 50;
+
+    double startTime;
+    int cycles;                 // 10 at 50 Hz, 12 at 60 Hz
+    double binWidth;            // Hz, 5 for a 200 ms window
+
+    double group[CHANNELS][MAX_ORDER + 1];
+    double subgroup[CHANNELS][MAX_ORDER + 1];
+    double interharmonicGroup[CHANNELS][MAX_ORDER + 1];
+    double interharmonicSubgroup[CHANNELS][MAX_ORDER + 1];
+    double phase[CHANNELS][MAX_ORDER + 1];  // degrees, harmonic bin against a cosine at the window start
+
+    double thdGroup[CHANNELS];      // THDG, %
+    double thdSubgroup[CHANNELS];   // THDS, %
+};
+
+// Gapless 10/12-cycle rectangular-window analysis of the six channels of the
+// sample stream. The six real channels are transformed as three complex pairs
+// through one shared FFT plan. In deferred mode a completed window is only
+// captured, and analyzeFleet runs the pending windows of many meters on a pool
+// of worker threads.
+class HarmonicAnalyzer
+{
+public:
+    HarmonicAnalyzer();
+
+    void configure(double nominalFrequency, double sampleRate);
+    void reset();
+
+    void setDeferred(bool deferred) { m_deferred = deferred; }
+    bool isDeferred() const { return m_deferred; }
+
+    // Feed from a sample block listener
+    void process(const SampleBlock& block);
+
+    bool hasPending() const { return m_pending; }
+    void analyzePending();
+
+    static void analyzeFleet(const std::vector<HarmonicAnalyzer*>& analyzers, unsigned int threadCount = 0);
+
+    bool hasResult() const { return m_windowCount > 0; }
+    uint64_t getWindowCount() const { return m_windowCount; }
+    const HarmonicGroupResult& getResult() const { return m_result; }
+    int getWindowLength() const { return m_windowLength; }
+
+private:
+    // One complex transform carries the voltage and current of a phase, so a
+    // single-phase meter runs one transform per window
+    void analyzePair(int phase);
+    void groupSpectrum(int channel, const std::complex<double>* spectrum);
+    void completeWindow();
+
+    std::shared_ptr<const FFTPlan> m_plan;
+    int m_windowLength;
+    int m_cycles;
+    double m_sampleRate;
+    bool m_deferred;
+
+    // Window being filled, and the completed window awaiting analysis
+    std::vector<double> m_filling[HarmonicGroupResult::CHANNELS];
+    std::vector<double> m_captured[HarmonicGroupResult::CHANNELS];
+    int m_fillCount;
+    double m_fillStartTime;
+    double m_capturedStartTime;
+    int m_capturedPhases;
+    bool m_pending;
+
+    // Transform buffers, sized in configure(). Fleet jobs analyse the phases of one
+    // window concurrently, so each phase pair and channel has its own.
+    std::vector<std::complex<double>> m_spectrum[HarmonicGroupResult::CHANNELS];
+    std::vector<std::complex<double>> m_scratch[3];
+    std::vector<double> m_power[HarmonicGroupResult::CHANNELS];
+
+    HarmonicGroupResult m_result;
+    uint64_t m_windowCount;
+};
@@ -0,0 +1,113 @@
+
+#include "harmonic_synthesizer.h"
+#include <algorithm>
+#include <cmath>
+
+HarmonicSynthesizer::HarmonicSynthesizer()
+{
+    clear();
+}
+
+void HarmonicSynthesizer::setHarmonic(HarmonicChannel channel, unsigned phaseMask, int order,
+                                      double magnitude, double phase)
+{
+    if (order < 2 || order > MAX_ORDER) {
+        return;
+    }
+
+    int c = static_cast<int>(channel);
+    for (int ph = 0; ph < 3; ph++) {
+        if (phaseMask & (1u << ph)) {
+            m_spectra[c][ph].magnitude[order] = magnitude;
+            m_spectra[c][ph].phase[order] = magnitude != 0.0 ? phase : 0.0;
+            compile(ph);
+        }
+    }
+}
+
+void HarmonicSynthesizer::clear()
+{
+    for (int c = 0; c < 2; c++) {
+        for (int ph = 0; ph < 3; ph++) {
+            std::fill(m_spectra[c][ph].magnitude, m_spectra[c][ph].magnitude + MAX_ORDER + 1, 0.0);
+            std::fill(m_spectra[c][ph].phase, m_spectra[c][ph].phase + MAX_ORDER + 1, 0.0);
+        }
+    }
+    for (int ph = 0; ph < 3; ph++) {
+        compile(ph);
+    }
+}
+
+double HarmonicSynthesizer::getMagnitude(HarmonicChannel channel, int phase, int order) const
+{
+    if (order < 2 || order > MAX_ORDER || phase < 0 || phase > 2) return 0.0;
+    return m_spectra[static_cast<int>(channel)][phase].magnitude[order];
+}
+
+double HarmonicSynthesizer::getPhase(HarmonicChannel channel, int phase, int order) const
+{
+    if (order < 2 || order > MAX_ORDER || phase < 0 || phase > 2) return 0.0;
+    return m_spectra[static_cast<int>(channel)][phase].phase[order];
+}
+
+void HarmonicSynthesizer::compile(int phase)
+{
+    m_maxOrder[phase] = 0;
+
+    for (int c = 0; c < 2; c++) {
+        const Spectrum& spectrum = m_spectra[c][phase];
+        Compiled& compiled = m_compiled[c][phase];
+        compiled.order.clear();
+        compiled.inPhase.clear();
+        compiled.quadrature.clear();
+
+        // Peak amplitude per unit RMS, phase converted once here rather than per sample
+        for (int h = 2; h <= MAX_ORDER; h++) {
+            double magnitude = spectrum.magnitude[h];
+            if (magnitude == 0.0) continue;
+            double angle = spectrum.phase[h] * M_PI / 180.0;
+            compiled.order.push_back(h);
+            compiled.inPhase.push_back(std::sqrt(2.0) * magnitude * std::cos(angle));
+            compiled.quadrature.push_back(std::sqrt(2.0) * magnitude * std::sin(angle));
+            m_maxOrder[phase] = std::max(m_maxOrder[phase], h);
+        }
+    }
+
+    m_empty = m_maxOrder[0] == 0 && m_maxOrder[1] == 0 && m_maxOrder[2] == 0;
+}
+
+void HarmonicSynthesizer::synthesize(int phase, double sinTheta, double cosTheta,
+                                     double& voltage, double& current) const
+{
+    voltage = 0.0;
+    current = 0.0;
+
+    const int maxOrder = m_maxOrder[phase];
+    if (maxOrder == 0) {
+        return;
+    }
+
+    // cos(h theta), sin(h theta) as successive powers of exp(j theta)
+    double re[MAX_ORDER + 1], im[MAX_ORDER + 1];
+    re[1] = cosTheta;
+    im[1] = sinTheta;
+    for (int h = 2; h <= maxOrder; h++) {
+        re[h] = re[h - 1] * cosTheta - im[h - 1] * sinTheta;
+        im[h] = im[h - 1] * cosTheta + re[h - 1] * sinTheta;
+    }
+
+    double* outputs[2] = {&voltage, &current};
+    for (int c = 0; c < 2; c++) {
+        const Compiled& compiled = m_compiled[c][phase];
+        const int* order = compiled.order.data();
+        const double* a = compiled.inPhase.data();
+        const double* b = compiled.quadrature.data();
+        const size_t count = compiled.order.size();
+
+        double sum = 0.0;
+        for (size_t k = 0; k < count; k++) {
+            sum += a[k] * im[order[k]] + b[k] * re[order[k]];
+        }
+        *outputs[c] = sum;
+    }
+}
@@ -0,0 +1,55 @@
+
+#pragma once
+
+#include <vector>
+
+enum class HarmonicChannel {
+    Voltage,
+    Current
+};
+
+// Independent harmonic spectra for the voltage and current of each phase.
+// Spectra are edited as magnitude/phase per order and compiled, on change, into
+// contiguous in-phase/quadrature coefficient arrays holding only the active
+// orders. Per sample, the powers of the fundamental phasor are formed once per
+// phase by complex multiplication and shared by both channels, leaving one
+// multiply-add pair per active harmonic.
+class HarmonicSynthesizer
+{
+public:
+    static constexpr int MAX_ORDER = 50;
+
+    HarmonicSynthesizer();
+
+    // Magnitude relative to the fundamental, phase in degrees against the phase voltage fundamental;
+    // phaseMask uses the InjectionPhase bits. A zero magnitude removes the order.
+    void setHarmonic(HarmonicChannel channel, unsigned phaseMask, int order, double magnitude, double phase);
+    void clear();
+
+    double getMagnitude(HarmonicChannel channel, int phase, int order) const;
+    double getPhase(HarmonicChannel channel, int phase, int order) const;
+    bool isEmpty() const { return m_empty; }
+
+    // Harmonic content at fundamental angle theta, per unit of fundamental RMS
+    void synthesize(int phase, double sinTheta, double cosTheta, double& voltage, double& current) const;
+
+private:
+    struct Spectrum {
+        double magnitude[MAX_ORDER + 1];
+        double phase[MAX_ORDER + 1];
+    };
+
+    // Active orders only: x = sum(inPhase * sin(h theta) + quadrature * cos(h theta))
+    struct Compiled {
+        std::vector<int> order;
+        std::vector<double> inPhase;
+        std::vector<double> quadrature;
+    };
+
+    void compile(int phase);
+
+    Spectrum m_spectra[2][3];
+    Compiled m_compiled[2][3];
+    int m_maxOrder[3];
+    bool m_empty;
+};
@@ -0,0 +1,183 @@
+
+#include "injection_scheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double endTime(const SignalInjection& injection)
+{
+    return injection.startTime + injection.duration;
+}
+
+// Heap comparators: std heaps keep the largest element in front, so invert
+bool laterStart(const SignalInjection& a, const SignalInjection& b)
+{
+    return a.startTime > b.startTime;
+}
+
+bool laterEnd(const SignalInjection& a, const SignalInjection& b)
+{
+    return endTime(a) > endTime(b);
+}
+
+}
+
+InjectionScheduler::InjectionScheduler()
+    : m_nextEventTime(-std::numeric_limits<double>::infinity())
+    , m_rampActive(false)
+    , m_nextId(1)
+{
+    clear();
+}
+
+int InjectionScheduler::schedule(InjectionType type, double startTime, double duration, double magnitude,
+                                 double rampTime, unsigned phaseMask)
+{
+    if (duration <= 0.0) {
+        return 0;
+    }
+
+    SignalInjection injection;
+    injection.id = m_nextId++;
+    injection.type = type;
+    injection.startTime = startTime;
+    injection.duration = duration;
+    injection.magnitude = magnitude;
+    injection.rampTime = std::min(std::max(rampTime, 0.0), duration / 2.0);
+    injection.phaseMask = phaseMask & InjectionPhase::ALL;
+
+    m_pending.push_back(injection);
+    std::push_heap(m_pending.begin(), m_pending.end(), laterStart);
+
+    m_nextEventTime = std::min(m_nextEventTime, startTime);
+    return injection.id;
+}
+
+void InjectionScheduler::cancel(int id)
+{
+    auto matches = [id](const SignalInjection& injection) { return injection.id == id; };
+
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), matches), m_pending.end());
+    std::make_heap(m_pending.begin(), m_pending.end(), laterStart);
+
+    m_active.erase(std::remove_if(m_active.begin(), m_active.end(), matches), m_active.end());
+    std::make_heap(m_active.begin(), m_active.end(), laterEnd);
+
+    // Force the cached state to be rebuilt on the next sample
+    m_nextEventTime = -std::numeric_limits<double>::infinity();
+}
+
+void InjectionScheduler::clear()
+{
+    m_pending.clear();
+    m_active.clear();
+    m_rampActive = false;
+    m_nextEventTime = std::numeric_limits<double>::infinity();
+
+    for (int ph = 0; ph < 3; ph++) {
+        m_state.voltageScale[ph] = 1.0;
+        m_state.phaseOffset[ph] = 0.0;
+    }
+    m_state.frequencyDeviation = 0.0;
+}
+
+void InjectionScheduler::advanceTo(double time)
+{
+    while (!m_pending.empty() && m_pending.front().startTime <= time) {
+        std::pop_heap(m_pending.begin(), m_pending.end(), laterStart);
+        SignalInjection injection = m_pending.back();
+        m_pending.pop_back();
+
+        // Injections scheduled entirely in the past are dropped without activating
+        if (endTime(injection) > time) {
+            m_active.push_back(injection);
+            std::push_heap(m_active.begin(), m_active.end(), laterEnd);
+        }
+    }
+
+    while (!m_active.empty() && endTime(m_active.front()) <= time) {
+        std::pop_heap(m_active.begin(), m_active.end(), laterEnd);
+        m_active.pop_back();
+    }
+
+    evaluate(time);
+    updateNextEventTime(time);
+}
+
+void InjectionScheduler::evaluate(double time)
+{
+    InjectionState state;
+    for (int ph = 0; ph < 3; ph++) {
+        state.voltageScale[ph] = 1.0;
+        state.phaseOffset[ph] = 0.0;
+    }
+    state.frequencyDeviation = 0.0;
+
+    for (const auto& injection : m_active) {
+        double level = injection.magnitude * envelope(injection, time);
+
+        if (injection.type == InjectionType::FrequencyVariation) {
+            state.frequencyDeviation += level;
+            continue;
+        }
+
+        for (int ph = 0; ph < 3; ph++) {
+            if (!(injection.phaseMask & (1u << ph))) continue;
+
+            switch (injection.type) {
+            case InjectionType::VoltageDip:
+                state.voltageScale[ph] *= 1.0 - level;
+                break;
+            case InjectionType::VoltageSwell:
+            case InjectionType::VoltageRamp:
+                state.voltageScale[ph] *= 1.0 + level;
+                break;
+            case InjectionType::PhaseJump:
+                state.phaseOffset[ph] += level * M_PI / 180.0;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    m_state = state;
+}
+
+void InjectionScheduler::updateNextEventTime(double time)
+{
+    double next = m_pending.empty() ? std::numeric_limits<double>::infinity() : m_pending.front().startTime;
+    m_rampActive = false;
+
+    for (const auto& injection : m_active) {
+        double end = endTime(injection);
+        double riseEnd = injection.startTime + injection.rampTime;
+        double fallStart = end - injection.rampTime;
+
+        // Ramp corners are events too, so the plateau between them is not re-evaluated per sample
+        if (time < riseEnd) {
+            next = std::min(next, riseEnd);
+            m_rampActive = true;
+        } else if (time < fallStart) {
+            next = std::min(next, fallStart);
+        } else {
+            m_rampActive = m_rampActive || injection.rampTime > 0.0;
+        }
+        next = std::min(next, end);
+    }
+
+    m_nextEventTime = next;
+}
+
+double InjectionScheduler::envelope(const SignalInjection& injection, double time)
+{
+    if (injection.rampTime <= 0.0) {
+        return 1.0;
+    }
+
+    double sinceStart = time - injection.startTime;
+    double untilEnd = endTime(injection) - time;
+    double ramp = std::min(sinceStart, untilEnd) / injection.rampTime;
+    return std::min(std::max(ramp, 0.0), 1.0);
+}
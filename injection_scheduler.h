@@ -0,0 +1,86 @@
+
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+enum class InjectionType {
+    VoltageDip,          // voltage scaled by (1 - magnitude)
+    VoltageSwell,        // voltage scaled by (1 + magnitude)
+    VoltageRamp,         // voltage scaled by (1 + magnitude), signed, reached over rampTime
+    FrequencyVariation,  // frequency offset by magnitude Hz
+    PhaseJump            // phase angle offset by magnitude degrees
+};
+
+// Phase selection bits for per-phase targeting
+namespace InjectionPhase {
+    constexpr unsigned A = 1u << 0;
+    constexpr unsigned B = 1u << 1;
+    constexpr unsigned C = 1u << 2;
+    constexpr unsigned ALL = A | B | C;
+}
+
+struct SignalInjection {
+    int id;
+    InjectionType type;
+    double startTime;
+    double duration;
+    double magnitude;
+    double rampTime;     // linear rise at the start and fall at the end; 0 = step
+    unsigned phaseMask;  // InjectionPhase bits; frequency variations apply to all phases
+};
+
+// Combined effect of all active injections at one instant
+struct InjectionState {
+    double voltageScale[3];
+    double phaseOffset[3];      // radians
+    double frequencyDeviation;  // Hz
+};
+
+// Schedules signal injections by time. Pending injections are kept in a heap
+// ordered by start time and active ones in a heap ordered by end time, so
+// injections are activated and expired in order and the per-sample cost only
+// depends on what is currently active. Between events the combined state is
+// cached; it is only re-evaluated per sample while a ramp is in progress.
+class InjectionScheduler
+{
+public:
+    InjectionScheduler();
+
+    // Returns an id that can be passed to cancel()
+    int schedule(InjectionType type, double startTime, double duration, double magnitude,
+                 double rampTime = 0.0, unsigned phaseMask = InjectionPhase::ALL);
+    void cancel(int id);
+    void clear();
+
+    // Combined injection state at the given time; time must not go backwards
+    const InjectionState& stateAt(double time)
+    {
+        if (time >= m_nextEventTime) {
+            advanceTo(time);
+        }
+        if (m_rampActive) {
+            evaluate(time);
+        }
+        return m_state;
+    }
+
+    bool isIdle() const { return m_active.empty(); }
+    const std::vector<SignalInjection>& getActiveInjections() const { return m_active; }
+    size_t getPendingCount() const { return m_pending.size(); }
+
+private:
+    void advanceTo(double time);
+    void evaluate(double time);
+    void updateNextEventTime(double time);
+
+    static double envelope(const SignalInjection& injection, double time);
+
+    std::vector<SignalInjection> m_pending;  // min-heap on startTime
+    std::vector<SignalInjection> m_active;   // min-heap on end time
+    double m_nextEventTime;
+    bool m_rampActive;
+    int m_nextId;
+    InjectionState m_state;
+};
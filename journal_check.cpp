@@ -0,0 +1,235 @@
+// Register journal power-fail check: runs many write / power-fail / recover
+// cycles in a row on one simulated part and verifies after every power-up
+// that each register holds the last value whose write completed. A second pass
+// runs a metering engine on the journal, cuts the supply at a random instant,
+// powers a fresh engine up from the journal and checks its energy, tariff and
+// maximum demand registers against what the old engine held.
+//
+//   journal_check [cycles] [seed] [engine cycles]
+
+#include "register_journal.h"
+#include "metering_engine.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+
+namespace {
+
+constexpr int REGISTERS = 6;
+
+int run(int cycles, uint32_t seed)
+{
+    // A small sector so that compactions are cut off too
+    RegisterJournal journal(512, 8);
+    std::mt19937 random(seed);
+    std::map<uint16_t, double> acknowledged;
+    double next = 1.0;
+    int torn = 0;
+
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        // Run for a while, then lose the supply at a random byte of the remaining writes
+        const int writes = std::uniform_int_distribution<int>(1, 60)(random);
+        const int failAt = std::uniform_int_distribution<int>(0, writes - 1)(random);
+        uint16_t pendingId = 0;
+        double pendingValue = 0.0;
+
+        for (int w = 0; w < writes && journal.isPowered(); w++) {
+            if (w == failAt) {
+                journal.failAfter(std::uniform_int_distribution<size_t>(0, RegisterJournal::RECORD_SIZE * 2)(random));
+            }
+            const uint16_t id = static_cast<uint16_t>(1 + random() % REGISTERS);
+            if (journal.write(id, next)) {
+                acknowledged[id] = next;
+            } else {
+                pendingId = id;
+                pendingValue = next;
+            }
+            if (random() % 8 == 0) {
+                journal.logEvent(0x0100, next);
+            }
+            next += 1.0;
+        }
+
+        if (!journal.recover()) {
+            std::printf("cycle %d: no valid sector after power-up\n", cycle);
+            return 1;
+        }
+
+        // A write cut off after its last byte is durable although it was not acknowledged
+        for (const auto& entry : acknowledged) {
+            const double value = journal.read(entry.first, -1.0);
+            if (value != entry.second && !(entry.first == pendingId && value == pendingValue)) {
+                std::printf("cycle %d: register %u reads %.0f, expected %.0f\n",
+                            cycle, entry.first, value, entry.second);
+                return 1;
+            }
+        }
+        if (pendingId != 0) {
+            torn++;
+            if (journal.read(pendingId, -1.0) == pendingValue) {
+                acknowledged[pendingId] = pendingValue;
+            }
+        }
+    }
+
+    std::printf("%d power-fail cycles, %d cut off during a write, %llu records, %llu compactions: ok\n",
+                cycles, torn, static_cast<unsigned long long>(journal.getRecordCount()),
+                static_cast<unsigned long long>(journal.getCompactionCount()));
+    return 0;
+}
+
+constexpr double STEP = 0.001;
+constexpr double RESOLUTION = 0.01;  // Wh
+
+// The registers an engine would journal
+struct EngineRegisters {
+    double energy;
+    std::vector<double> tariffs;
+    std::vector<MaxDemandRegister> blockMD;
+    std::vector<MaxDemandRegister> slidingMD;
+    int resets;
+};
+
+EngineRegisters registersOf(const MeteringEngine& engine)
+{
+    return {engine.getMeasurements().energy, engine.getTOUEngine().getTariffRegisters(),
+            engine.getDemandEngine().getBlockMaxDemand(), engine.getDemandEngine().getSlidingMaxDemand(),
+            engine.getDemandEngine().getResetCount()};
+}
+
+// Power-up: the same part with nothing but the journal carried over
+std::unique_ptr<MeteringEngine> powerUp(RegisterJournal& journal)
+{
+    auto engine = std::make_unique<MeteringEngine>();
+    engine->configure(true, 230.0, 10.0, 50.0, 0.9);
+    engine->getDemandEngine().configure(0.2, 4, engine->getTOUEngine().getTariffCount());
+    engine->attachJournal(&journal, RESOLUTION);
+    return engine;
+}
+
+// An energy register is journaled once it moves by the resolution, so after the cut it
+// reads a value the engine held no more than the resolution before the last full update
+bool energyRestored(double restored, double before, double after, bool exact)
+{
+    if (exact) return restored == after;
+    return restored >= before - RESOLUTION && restored <= after;
+}
+
+// A maximum demand register is rewritten whenever it changes; a write cut off in the
+// last update leaves the value and timestamp that were current before it
+bool maxDemandRestored(const MaxDemandRegister& restored, const MaxDemandRegister& before,
+                       const MaxDemandRegister& after, bool exact)
+{
+    if (exact) return restored.value == after.value && restored.timestamp == after.timestamp;
+    return (restored.value == before.value || restored.value == after.value) &&
+           (restored.timestamp == before.timestamp || restored.timestamp == after.timestamp);
+}
+
+// Compares the restored engine against the registers before and after the last update
+// in which the journal still had power; exact when the hold-up write completed
+bool compare(int cycle, const EngineRegisters& restored, const EngineRegisters& before,
+             const EngineRegisters& after, bool exact)
+{
+    bool ok = energyRestored(restored.energy, before.energy, after.energy, exact);
+    if (!ok) {
+        std::printf("engine cycle %d: energy %.6f Wh, held %.6f..%.6f\n", cycle, restored.energy, before.energy, after.energy);
+    }
+    for (size_t t = 0; t < after.tariffs.size(); t++) {
+        if (!energyRestored(restored.tariffs[t], before.tariffs[t], after.tariffs[t], exact)) {
+            std::printf("engine cycle %d: tariff %zu %.6f Wh, held %.6f..%.6f\n",
+                        cycle, t, restored.tariffs[t], before.tariffs[t], after.tariffs[t]);
+            ok = false;
+        }
+    }
+    for (size_t t = 0; t < after.blockMD.size(); t++) {
+        if (!maxDemandRestored(restored.blockMD[t], before.blockMD[t], after.blockMD[t], exact) ||
+            !maxDemandRestored(restored.slidingMD[t], before.slidingMD[t], after.slidingMD[t], exact)) {
+            std::printf("engine cycle %d: tariff %zu MD %.3f / %.3f W, held %.3f / %.3f W\n", cycle, t,
+                        restored.blockMD[t].value, restored.slidingMD[t].value, after.blockMD[t].value, after.slidingMD[t].value);
+            ok = false;
+        }
+    }
+    if (restored.resets != after.resets && (exact || restored.resets != before.resets)) {
+        std::printf("engine cycle %d: %d demand resets, held %d\n", cycle, restored.resets, after.resets);
+        ok = false;
+    }
+    return ok;
+}
+
+int runEngine(int cycles, uint32_t seed)
+{
+    RegisterJournal journal(512, 8);
+    std::mt19937 random(seed);
+    std::unique_ptr<MeteringEngine> engine = powerUp(journal);
+    int whileRunning = 0, duringHoldUp = 0;
+
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        // A new load, and now and then a billing reset, so the MD registers keep moving.
+        // The reset is journaled by the next update, so until then the registers before it count
+        EngineRegisters before = registersOf(*engine), after = before;
+        for (int ph = 0; ph < 3; ph++) {
+            engine->setPhaseLoad(ph, std::uniform_real_distribution<double>(0.1, 1.5)(random));
+        }
+        if (random() % 16 == 0) {
+            engine->getDemandEngine().resetMaxDemand(engine->getSimulationTime());
+        }
+
+        // The supply fails at a random step; the byte budget left decides whether the
+        // journal dies in that update or part-way through the hold-up write after it
+        const int steps = std::uniform_int_distribution<int>(1, 400)(random);
+        const int failAt = std::uniform_int_distribution<int>(0, steps - 1)(random);
+        for (int step = 0; step < steps && journal.isPowered(); step++) {
+            if (step == failAt) {
+                journal.failAfter(std::uniform_int_distribution<size_t>(0, RegisterJournal::RECORD_SIZE * 24)(random));
+            }
+            before = after;
+            engine->update(STEP);
+            after = registersOf(*engine);
+        }
+        if (journal.isPowered()) {
+            before = after;
+            engine->powerFail();
+            duringHoldUp++;
+        } else {
+            whileRunning++;
+        }
+        const bool exact = journal.isPowered();
+
+        if (!journal.recover()) {
+            std::printf("engine cycle %d: no valid sector after power-up\n", cycle);
+            return 1;
+        }
+        engine = powerUp(journal);
+        if (!engine->restoreRegisters()) {
+            // Nothing journaled yet is only right before the first resolution step
+            if (after.energy >= RESOLUTION && before.energy >= RESOLUTION) {
+                std::printf("engine cycle %d: no energy register after %.6f Wh\n", cycle, after.energy);
+                return 1;
+            }
+            continue;
+        }
+        if (!compare(cycle, registersOf(*engine), before, after, exact)) {
+            return 1;
+        }
+    }
+
+    std::printf("%d engine power-fail cycles, %d while running, %d during the hold-up write, %.3f Wh: ok\n",
+                cycles, whileRunning, duringHoldUp, engine->getMeasurements().energy);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    const int cycles = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const uint32_t seed = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 0)) : 1;
+    const int engineCycles = argc > 3 ? std::atoi(argv[3]) : 500;
+    if (run(cycles, seed) != 0) {
+        return 1;
+    }
+    return runEngine(engineCycles, seed);
+}
@@ -0,0 +1,405 @@
+
+#include "load_library.h"
+#include "noise_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr int TYPE_COUNT = 6;
+constexpr double INFINITE_TIME = std::numeric_limits<double>::infinity();
+
+// Starting lasts this many inrush time constants, leaving under 1 % of the excess
+constexpr double INRUSH_SPAN = 5.0;
+
+std::vector<ApplianceSignature> buildCatalogue()
+{
+    std::vector<ApplianceSignature> catalogue(TYPE_COUNT);
+
+    // Capacitor-input rectifier: narrow pulses at the voltage peak, odd harmonics alternating in sign
+    catalogue[0] = {ApplianceType::SwitchedModePSU, "Switched-mode PSU", LoadModel::ConstantPower, -8.0,
+                    {{3, 0.81, 180.0}, {5, 0.60, 0.0}, {7, 0.37, 180.0}, {9, 0.16, 0.0},
+                     {11, 0.06, 180.0}, {13, 0.05, 0.0}, {15, 0.04, 180.0}},
+                    20.0, 0.004, -60.0, 0.0};
+
+    // Six-pulse drive with DC choke, soft-started by the drive itself
+    catalogue[1] = {ApplianceType::VariableFrequencyDrive, "Variable-frequency drive", LoadModel::ConstantPower, 5.0,
+                    {{5, 0.33, 180.0}, {7, 0.11, 180.0}, {11, 0.08, 0.0}, {13, 0.05, 0.0},
+                     {17, 0.03, 180.0}, {19, 0.02, 180.0}},
+                    1.0, 0.0, 5.0, 2.0};
+
+    // Low-cost LED driver without PFC: capacitive and strongly distorted
+    catalogue[2] = {ApplianceType::LEDDriver, "LED driver", LoadModel::ConstantPower, -25.0,
+                    {{3, 0.86, 180.0}, {5, 0.66, 0.0}, {7, 0.45, 180.0}, {9, 0.28, 0.0},
+                     {11, 0.16, 180.0}, {13, 0.10, 0.0}},
+                    12.0, 0.002, -70.0, 0.0};
+
+    // Active-PFC charger, ramps up to full power after the pilot handshake
+    catalogue[3] = {ApplianceType::EVCharger, "EV charger", LoadModel::ConstantPower, 3.0,
+                    {{3, 0.03, 180.0}, {5, 0.02, 0.0}, {7, 0.01, 180.0}},
+                    1.0, 0.0, 3.0, 5.0};
+
+    // Resistive element; cold resistance is slightly lower
+    catalogue[4] = {ApplianceType::Heater, "Heater", LoadModel::ConstantImpedance, 0.0,
+                    {},
+                    1.1, 1.5, 0.0, 0.0};
+
+    // Direct-on-line induction motor: locked-rotor current at low power factor
+    catalogue[5] = {ApplianceType::Motor, "Induction motor", LoadModel::ConstantCurrent, 36.87,
+                    {{3, 0.02, 0.0}, {5, 0.015, 180.0}, {7, 0.01, 0.0}},
+                    6.0, 0.25, 72.5, 0.0};
+
+    return catalogue;
+}
+
+const std::vector<ApplianceSignature>& catalogue()
+{
+    static const std::vector<ApplianceSignature> entries = buildCatalogue();
+    return entries;
+}
+
+// One cycle of the current, indexed by the voltage angle, with a 1 A RMS fundamental.
+// The whole waveform is delayed by the displacement, so harmonic h shifts by h times it.
+std::vector<double> renderCycle(const ApplianceSignature& signature, double displacement)
+{
+    std::vector<double> table(LoadMix::TABLE_SIZE + 1);
+    const double delta = displacement * M_PI / 180.0;
+
+    for (int k = 0; k <= LoadMix::TABLE_SIZE; k++) {
+        double theta = 2.0 * M_PI * k / LoadMix::TABLE_SIZE;
+        double value = std::sin(theta - delta);
+        for (const auto& harmonic : signature.harmonics) {
+            value += harmonic.magnitude *
+                     std::sin(harmonic.order * (theta - delta) + harmonic.phase * M_PI / 180.0);
+        }
+        table[k] = std::sqrt(2.0) * value;
+    }
+    return table;
+}
+
+struct CycleTables {
+    std::vector<double> run[TYPE_COUNT];
+    std::vector<double> start[TYPE_COUNT];
+
+    CycleTables()
+    {
+        for (int t = 0; t < TYPE_COUNT; t++) {
+            const ApplianceSignature& signature = catalogue()[t];
+            run[t] = renderCycle(signature, signature.displacement);
+            start[t] = renderCycle(signature, signature.startDisplacement);
+        }
+    }
+};
+
+const CycleTables& cycleTables()
+{
+    static const CycleTables tables;
+    return tables;
+}
+
+// Linear interpolation into a table with a duplicated end point
+inline double lookup(const double* table, int index, double fraction)
+{
+    return table[index] + (table[index + 1] - table[index]) * fraction;
+}
+
+}
+
+LoadMix::LoadMix()
+    : m_nominalVoltage(230.0)
+    , m_nextEventTime(INFINITE_TIME)
+    , m_nextId(1)
+{
+    for (auto& tables : m_tables) {
+        tables.impedance.assign(TABLE_SIZE + 1, 0.0);
+        tables.current.assign(TABLE_SIZE + 1, 0.0);
+        tables.power.assign(TABLE_SIZE + 1, 0.0);
+    }
+}
+
+const ApplianceSignature& LoadMix::signature(ApplianceType type)
+{
+    return catalogue()[static_cast<int>(type)];
+}
+
+const std::vector<double>& LoadMix::runTable(ApplianceType type)
+{
+    return cycleTables().run[static_cast<int>(type)];
+}
+
+const std::vector<double>& LoadMix::startTable(ApplianceType type)
+{
+    return cycleTables().start[static_cast<int>(type)];
+}
+
+void LoadMix::setNominalVoltage(double voltage)
+{
+    if (voltage > 0.0 && voltage != m_nominalVoltage) {
+        m_nominalVoltage = voltage;
+        rebuildTables();
+    }
+}
+
+int LoadMix::addAppliance(ApplianceType type, double ratedPower, int phase)
+{
+    Appliance appliance;
+    appliance.id = m_nextId++;
+    appliance.type = type;
+    appliance.phase = std::min(std::max(phase, 0), 2);
+    appliance.ratedPower = std::max(ratedPower, 0.0);
+    appliance.state = ApplianceState::Off;
+    appliance.stateTime = 0.0;
+    appliance.nextEvent = INFINITE_TIME;
+    appliance.onDuration = 0.0;
+    appliance.offDuration = 0.0;
+    appliance.pendingSwitch = std::numeric_limits<double>::quiet_NaN();
+    appliance.pendingOn = false;
+    m_appliances.push_back(appliance);
+    return appliance.id;
+}
+
+void LoadMix::removeAppliance(int id)
+{
+    m_appliances.erase(std::remove_if(m_appliances.begin(), m_appliances.end(),
+                                      [id](const Appliance& a) { return a.id == id; }),
+                       m_appliances.end());
+    rebuildTables();
+    updateNextEventTime();
+}
+
+void LoadMix::clear()
+{
+    m_appliances.clear();
+    rebuildTables();
+    m_nextEventTime = INFINITE_TIME;
+}
+
+void LoadMix::switchOn(int id, double time)
+{
+    for (auto& appliance : m_appliances) {
+        if (appliance.id == id) {
+            appliance.onDuration = 0.0;
+            appliance.pendingSwitch = time;
+            appliance.pendingOn = true;
+            appliance.nextEvent = std::min(appliance.nextEvent, time);
+        }
+    }
+    updateNextEventTime();
+}
+
+void LoadMix::switchOff(int id, double time)
+{
+    for (auto& appliance : m_appliances) {
+        if (appliance.id == id) {
+            appliance.onDuration = 0.0;
+            appliance.pendingSwitch = time;
+            appliance.pendingOn = false;
+            appliance.nextEvent = std::min(appliance.nextEvent, time);
+        }
+    }
+    updateNextEventTime();
+}
+
+void LoadMix::setDutyCycle(int id, double onDuration, double offDuration, double firstSwitchOn)
+{
+    for (auto& appliance : m_appliances) {
+        if (appliance.id == id) {
+            appliance.onDuration = std::max(onDuration, 0.0);
+            appliance.offDuration = std::max(offDuration, 0.0);
+            appliance.pendingSwitch = firstSwitchOn;
+            appliance.pendingOn = true;
+            appliance.nextEvent = std::min(appliance.nextEvent, firstSwitchOn);
+        }
+    }
+    updateNextEventTime();
+}
+
+void LoadMix::buildRandomMix(uint64_t seed, int phases, int applianceCount)
+{
+    // Typical rating range and duty cycle (on, off seconds) per appliance type
+    struct Profile { double minPower, maxPower, onTime, offTime; };
+    static const Profile profiles[TYPE_COUNT] = {
+        {30.0, 300.0, 0.0, 0.0},        // always-on electronics
+        {500.0, 2200.0, 600.0, 900.0},  // heat pump compressor drive
+        {5.0, 60.0, 0.0, 0.0},
+        {3700.0, 7400.0, 3600.0, 7200.0},
+        {1000.0, 3000.0, 120.0, 240.0}, // thermostat cycling
+        {250.0, 1500.0, 300.0, 600.0}
+    };
+
+    NoiseGenerator random(seed);
+    clear();
+    phases = std::min(std::max(phases, 1), 3);
+
+    for (int i = 0; i < applianceCount; i++) {
+        int type = static_cast<int>(random.nextUInt64() % TYPE_COUNT);
+        int phase = static_cast<int>(random.nextUInt64() % phases);
+        const Profile& profile = profiles[type];
+        double power = profile.minPower + (profile.maxPower - profile.minPower) * random.nextUniform();
+        int id = addAppliance(static_cast<ApplianceType>(type), power, phase);
+
+        if (profile.onTime > 0.0) {
+            double onTime = profile.onTime * (0.5 + random.nextUniform());
+            double offTime = profile.offTime * (0.5 + random.nextUniform());
+            setDutyCycle(id, onTime, offTime, (onTime + offTime) * random.nextUniform());
+        } else {
+            switchOn(id, 0.0);
+        }
+    }
+}
+
+double LoadMix::fundamentalAmplitude(const Appliance& appliance) const
+{
+    // Rated power is drawn at nominal voltage; harmonic currents carry no active power
+    // against a sinusoidal supply, so only the fundamental in phase with it counts
+    const ApplianceSignature& entry = signature(appliance.type);
+    return appliance.ratedPower / (m_nominalVoltage * std::cos(entry.displacement * M_PI / 180.0));
+}
+
+void LoadMix::enterState(Appliance& appliance, ApplianceState state, double time)
+{
+    const ApplianceSignature& entry = signature(appliance.type);
+    appliance.state = state;
+    appliance.stateTime = time;
+
+    if (state == ApplianceState::Starting) {
+        double span = entry.rampTime > 0.0 ? entry.rampTime : INRUSH_SPAN * entry.inrushTimeConstant;
+        if (span <= 0.0) {
+            appliance.state = ApplianceState::On;
+        } else {
+            appliance.nextEvent = time + span;
+        }
+    }
+
+    // Next duty-cycle toggle, unless a manual switch comes first
+    if (appliance.state != ApplianceState::Starting) {
+        appliance.nextEvent = INFINITE_TIME;
+        if (appliance.onDuration > 0.0) {
+            bool running = appliance.state == ApplianceState::On;
+            appliance.pendingSwitch = appliance.stateTime + (running ? appliance.onDuration : appliance.offDuration);
+            appliance.pendingOn = !running;
+        }
+    }
+    if (!std::isnan(appliance.pendingSwitch)) {
+        appliance.nextEvent = std::min(appliance.nextEvent, appliance.pendingSwitch);
+    }
+}
+
+void LoadMix::advanceTo(double time)
+{
+    bool changed = false;
+
+    // Several events of one appliance may fall inside a block; replay them in order
+    for (auto& appliance : m_appliances) {
+        while (appliance.nextEvent <= time) {
+            double eventTime = appliance.nextEvent;
+            if (!std::isnan(appliance.pendingSwitch) && appliance.pendingSwitch <= eventTime) {
+                bool on = appliance.pendingOn;
+                appliance.pendingSwitch = std::numeric_limits<double>::quiet_NaN();
+                if (on && appliance.state == ApplianceState::Off) {
+                    enterState(appliance, ApplianceState::Starting, eventTime);
+                } else if (!on && appliance.state != ApplianceState::Off) {
+                    enterState(appliance, ApplianceState::Off, eventTime);
+                } else {
+                    enterState(appliance, appliance.state, appliance.stateTime);
+                }
+            } else if (appliance.state == ApplianceState::Starting) {
+                enterState(appliance, ApplianceState::On, eventTime);
+            } else {
+                appliance.nextEvent = INFINITE_TIME;
+            }
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        rebuildTables();
+    }
+    updateNextEventTime();
+}
+
+void LoadMix::rebuildTables()
+{
+    for (auto& tables : m_tables) {
+        std::fill(tables.impedance.begin(), tables.impedance.end(), 0.0);
+        std::fill(tables.current.begin(), tables.current.end(), 0.0);
+        std::fill(tables.power.begin(), tables.power.end(), 0.0);
+    }
+    m_starting.clear();
+
+    for (size_t i = 0; i < m_appliances.size(); i++) {
+        const Appliance& appliance = m_appliances[i];
+        if (appliance.state == ApplianceState::Starting) {
+            m_starting.push_back(static_cast<int>(i));
+            continue;
+        }
+        if (appliance.state != ApplianceState::On) continue;
+
+        PhaseTables& tables = m_tables[appliance.phase];
+        std::vector<double>* target = &tables.current;
+        switch (signature(appliance.type).model) {
+        case LoadModel::ConstantImpedance: target = &tables.impedance; break;
+        case LoadModel::ConstantPower: target = &tables.power; break;
+        default: break;
+        }
+
+        const double scale = fundamentalAmplitude(appliance);
+        const std::vector<double>& shape = runTable(appliance.type);
+        for (int k = 0; k <= TABLE_SIZE; k++) {
+            (*target)[k] += scale * shape[k];
+        }
+    }
+}
+
+void LoadMix::updateNextEventTime()
+{
+    m_nextEventTime = INFINITE_TIME;
+    for (const auto& appliance : m_appliances) {
+        m_nextEventTime = std::min(m_nextEventTime, appliance.nextEvent);
+    }
+}
+
+double LoadMix::sample(int phase, double theta, double voltageScale, double time) const
+{
+    double position = theta * (TABLE_SIZE / (2.0 * M_PI));
+    position -= std::floor(position / TABLE_SIZE) * TABLE_SIZE;
+    int index = std::min(static_cast<int>(position), TABLE_SIZE - 1);
+    double fraction = position - index;
+
+    // ZIP scaling: impedance loads follow the voltage, constant-power loads draw more as it sags
+    const PhaseTables& tables = m_tables[phase];
+    const double scale = std::max(voltageScale, 0.1);
+    double value = lookup(tables.impedance.data(), index, fraction) * voltageScale +
+                   lookup(tables.current.data(), index, fraction) +
+                   lookup(tables.power.data(), index, fraction) / scale;
+
+    for (int i : m_starting) {
+        const Appliance& appliance = m_appliances[i];
+        if (appliance.phase != phase) continue;
+
+        const ApplianceSignature& entry = signature(appliance.type);
+        double elapsed = std::max(time - appliance.stateTime, 0.0);
+        double run = lookup(runTable(appliance.type).data(), index, fraction);
+
+        double envelope;
+        if (entry.rampTime > 0.0) {
+            envelope = std::min(elapsed / entry.rampTime, 1.0) * run;
+        } else {
+            // Inrush blends from the starting spectrum into the running one as it decays
+            double decay = std::exp(-elapsed / entry.inrushTimeConstant);
+            double start = lookup(startTable(appliance.type).data(), index, fraction);
+            envelope = (1.0 + (entry.inrushMultiplier - 1.0) * decay) * (decay * start + (1.0 - decay) * run);
+        }
+
+        double amplitude = fundamentalAmplitude(appliance);
+        switch (entry.model) {
+        case LoadModel::ConstantImpedance: amplitude *= voltageScale; break;
+        case LoadModel::ConstantPower: amplitude /= scale; break;
+        default: break;
+        }
+        value += amplitude * envelope;
+    }
+
+    return value;
+}
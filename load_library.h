@@ -0,0 +1,131 @@
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+enum class ApplianceType {
+    SwitchedModePSU,
+    VariableFrequencyDrive,
+    LEDDriver,
+    EVCharger,
+    Heater,
+    Motor
+};
+
+// How the drawn current follows the supply voltage (ZIP load model)
+enum class LoadModel {
+    ConstantImpedance,
+    ConstantCurrent,
+    ConstantPower
+};
+
+enum class ApplianceState {
+    Off,
+    Starting,
+    On
+};
+
+struct HarmonicComponent {
+    int order;
+    double magnitude;  // relative to the fundamental
+    double phase;      // degrees, relative to the appliance's own fundamental
+};
+
+// Catalogue entry: steady-state spectrum plus start-up behaviour
+struct ApplianceSignature {
+    ApplianceType type;
+    std::string name;
+    LoadModel model;
+    double displacement;       // degrees the fundamental lags the voltage while running
+    std::vector<HarmonicComponent> harmonics;
+
+    // Start-up: inrush decays as 1 + (k - 1) exp(-t / tau) from the starting spectrum,
+    // or a soft-start ramps linearly from zero over rampTime
+    double inrushMultiplier;
+    double inrushTimeConstant;
+    double startDisplacement;  // degrees, fundamental angle at the instant of switch-on
+    double rampTime;
+};
+
+struct Appliance {
+    int id;
+    ApplianceType type;
+    int phase;
+    double ratedPower;         // W at nominal voltage
+    ApplianceState state;
+    double stateTime;          // when the current state was entered
+    double nextEvent;          // next state change; infinity if none
+    double onDuration;         // duty cycle; 0 = switched manually
+    double offDuration;
+    double pendingSwitch;      // manual switch time; NaN if none
+    bool pendingOn;
+};
+
+// Mix of appliances on up to three phases. Each appliance type has its current
+// waveform precomputed over one voltage cycle. Running appliances are folded
+// into per-phase aggregate tables (one per ZIP class) that are rebuilt only
+// when the running set changes, so a sample costs three table lookups per
+// phase plus one term per appliance that is still starting.
+class LoadMix
+{
+public:
+    static constexpr int TABLE_SIZE = 512;
+
+    LoadMix();
+
+    static const ApplianceSignature& signature(ApplianceType type);
+
+    void setNominalVoltage(double voltage);
+    double getNominalVoltage() const { return m_nominalVoltage; }
+
+    int addAppliance(ApplianceType type, double ratedPower, int phase = 0);
+    void removeAppliance(int id);
+    void clear();
+
+    // Switching; times are simulation seconds
+    void switchOn(int id, double time);
+    void switchOff(int id, double time);
+    void setDutyCycle(int id, double onDuration, double offDuration, double firstSwitchOn);
+
+    // Random household-style mix for fleet diversity
+    void buildRandomMix(uint64_t seed, int phases, int applianceCount);
+
+    bool isEmpty() const { return m_appliances.empty(); }
+    const std::vector<Appliance>& getAppliances() const { return m_appliances; }
+
+    // Advances the state machines; call once per block with the block start time
+    void update(double time)
+    {
+        if (time >= m_nextEventTime) {
+            advanceTo(time);
+        }
+    }
+
+    // Instantaneous current on a phase for the phase voltage angle theta (radians)
+    double sample(int phase, double theta, double voltageScale, double time) const;
+
+private:
+    struct PhaseTables {
+        std::vector<double> impedance;
+        std::vector<double> current;
+        std::vector<double> power;
+    };
+
+    void advanceTo(double time);
+    void enterState(Appliance& appliance, ApplianceState state, double time);
+    void rebuildTables();
+    void updateNextEventTime();
+    double fundamentalAmplitude(const Appliance& appliance) const;
+
+    static const std::vector<double>& runTable(ApplianceType type);
+    static const std::vector<double>& startTable(ApplianceType type);
+
+    double m_nominalVoltage;
+    std::vector<Appliance> m_appliances;
+    std::vector<int> m_starting;  // indices of appliances in the Starting state
+    PhaseTables m_tables[3];
+    double m_nextEventTime;
+    int m_nextId;
+};
@@ -650,7 +650,7 @@ void SmartMeterSimulator::setupMeasurementTab()
         if (!m_simulationRunning) return;
 
         // Update oscilloscope with voltage/current waveforms
-        auto measurements = m_meteringEngine->getMeasurements();
+        auto measurements = m_meteringEngine->getBasicMeasurements();
         std::vector<double> voltageData;
         std::vector<double> currentData;
         
@@ -669,6 +669,11 @@ void SmartMeterSimulator::setupMeasurementTab()
         m_measurementTools->getMultimeter()->updateReading("Current", measurements.currentRMS, "A");
         m_measurementTools->getMultimeter()->updateReading("Power", measurements.activePower, "W");
         m_measurementTools->getMultimeter()->updateReading("Frequency", measurements.frequency, "Hz");
+        
+        // Pulse output over the last second at 1 ms resolution
+        std::vector<bool> pulseLevels;
+        m_meteringEngine->getPulseOutput().render(m_meteringEngine->getSimulationTime() - 1.0, 1e-3, 1000, pulseLevels);
+        m_measurementTools->getLogicAnalyzer()->updateChannel("Energy Pulse", pulseLevels);
     });
 }
 
@@ -692,7 +697,7 @@ void SmartMeterSimulator::updateDisplay()
     if (!m_simulationRunning) return;
 
     // Update metering values
-    auto measurements = m_meteringEngine->getMeasurements();
+    auto measurements = m_meteringEngine->getBasicMeasurements();
     
     if (m_meteringDisplay->item(0, 1)) {
         m_meteringDisplay->item(0, 1)->setText(QString::number(measurements.voltageRMS, 'f', 2) + " V");
@@ -800,7 +805,7 @@ void SmartMeterSimulator::exportResults()
         if (file.is_open()) {
             file << "Timestamp,Parameter,Value\n";
             // Export measurement data
-            auto measurements = m_meteringEngine->getMeasurements();
+            auto measurements = m_meteringEngine->getBasicMeasurements();
             file << QDateTime::currentDateTime().toString().toStdString() << ",Voltage," << measurements.voltageRMS << "\n";
             file << QDateTime::currentDateTime().toString().toStdString() << ",Current," << measurements.currentRMS << "\n";
             file << QDateTime::currentDateTime().toString().toStdString() << ",Power," << measurements.activePower << "\n";
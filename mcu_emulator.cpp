@@ -9,6 +9,7 @@
 MCUEmulator::MCUEmulator()
     : m_running(false)
     , m_programCounter(0)
+    , m_spiTransfers(0)
     , m_cycleTime(0)
     , m_totalCycles(0)
 {
@@ -71,6 +72,7 @@ void MCUEmulator::reset()
     m_running = false;
     m_programCounter = 0;
     m_totalCycles = 0;
+    m_spiTransfers = 0;
     m_cycleTime = 0;
     
     // Clear memory
@@ -80,6 +82,8 @@ void MCUEmulator::reset()
     for (auto& pin : m_gpioPins) {
         pin.state = false;
         pin.isOutput = false;
+        pin.risingEdges = 0;
+        pin.fallingEdges = 0;
     }
     
     for (auto& adc : m_adcChannels) {
@@ -128,6 +132,8 @@ void MCUEmulator::initializeMCU()
         pin.isOutput = false;
         pin.state = false;
         pin.function = "GPIO";
+        pin.risingEdges = 0;
+        pin.fallingEdges = 0;
         m_gpioPins.push_back(pin);
     }
     
@@ -139,6 +145,7 @@ void MCUEmulator::initializeMCU()
         adc.voltage = 0.0;
         adc.digitalValue = 0;
         adc.enabled = true;
+        adc.external = false;
         m_adcChannels.push_back(adc);
     }
     
@@ -179,10 +186,10 @@ void MCUEmulator::executeFirmware(double deltaTime)
         
         // Convert analog voltages to digital values
         for (auto& adc : m_adcChannels) {
-            if (adc.enabled) {
+            if (adc.enabled && !adc.external) {
                 // 12-bit ADC, 3.3V reference
-                adc.digitalValue = static_cast<uint16_t>((adc.voltage / 3.3) * 4095);
-                adc.digitalValue = std::min(adc.digitalValue, static_cast<uint16_t>(4095));
+                adc.digitalValue = static_cast<uint32_t>(std::max(adc.voltage / 3.3, 0.0) * 4095);
+                adc.digitalValue = std::min<uint32_t>(adc.digitalValue, 4095);
             }
         }
     }
@@ -340,6 +347,15 @@ void MCUEmulator::setADCValue(int channel, double voltage)
     }
 }
 
+void MCUEmulator::setADCSample(int channel, double voltage, uint32_t code)
+{
+    if (channel >= 0 && channel < static_cast<int>(m_adcChannels.size())) {
+        m_adcChannels[channel].voltage = voltage;
+        m_adcChannels[channel].digitalValue = code;
+        m_adcChannels[channel].external = true;
+    }
+}
+
 double MCUEmulator::getADCValue(int channel)
 {
     if (channel >= 0 && channel < static_cast<int>(m_adcChannels.size())) {
@@ -351,7 +367,11 @@ double MCUEmulator::getADCValue(int channel)
 void MCUEmulator::setGPIOState(int pin, bool state)
 {
     if (pin >= 0 && pin < static_cast<int>(m_gpioPins.size())) {
-        m_gpioPins[pin].state = state;
+        GPIOPin& gpio = m_gpioPins[pin];
+        if (state != gpio.state) {
+            (state ? gpio.risingEdges : gpio.fallingEdges)++;
+        }
+        gpio.state = state;
     }
 }
 
@@ -397,3 +417,25 @@ std::string MCUEmulator::receiveUARTData()
     m_uartTxBuffer.clear();
     return data;
 }
+
+void MCUEmulator::attachSPIDevice(int chipSelect, SPIDevice device)
+{
+    m_spiDevices[chipSelect] = device;
+}
+
+void MCUEmulator::detachSPIDevice(int chipSelect)
+{
+    m_spiDevices.erase(chipSelect);
+}
+
+std::vector<uint8_t> MCUEmulator::spiTransfer(int chipSelect, const std::vector<uint8_t>& tx)
+{
+    m_spiTransfers++;
+    auto device = m_spiDevices.find(chipSelect);
+    if (device == m_spiDevices.end() || !device->second) {
+        return std::vector<uint8_t>(tx.size(), 0xFF);
+    }
+    std::vector<uint8_t> rx = device->second(tx);
+    rx.resize(tx.size(), 0xFF);
+    return rx;
+}
@@ -6,6 +6,10 @@
 #include <map>
 #include <memory>
 #include <functional>
+#include <cstdint>
+
+// Full-duplex SPI slave: returns the bytes it shifts out while tx is clocked in
+using SPIDevice = std::function<std::vector<uint8_t>(const std::vector<uint8_t>& tx)>;
 
 struct MCUConfig {
     std::string family;
@@ -24,13 +28,16 @@ struct GPIOPin {
     bool isOutput;
     bool state;
     std::string function;
+    uint64_t risingEdges;   // transitions seen, including pulses shorter than an update step
+    uint64_t fallingEdges;
 };
 
 struct ADCChannel {
     int channel;
     double voltage;
-    uint16_t digitalValue;
+    uint32_t digitalValue;  // unsigned code; external converters may be wider than 16 bits
     bool enabled;
+    bool external;  // converted by an external acquisition model rather than the firmware loop
 };
 
 struct TimerChannel {
@@ -61,6 +68,7 @@ public:
     
     // Peripheral access
     void setADCValue(int channel, double voltage);
+    void setADCSample(int channel, double voltage, uint32_t code);
     double getADCValue(int channel);
     void setGPIOState(int pin, bool state);
     bool getGPIOState(int pin);
@@ -74,6 +82,13 @@ public:
     void sendUARTData(const std::string& data);
     std::string receiveUARTData();
     
+    // SPI bus: external chips are wired to a chip select and answer each transfer;
+    // with nothing selected the data line floats high and reads back 0xFF
+    void attachSPIDevice(int chipSelect, SPIDevice device);
+    void detachSPIDevice(int chipSelect);
+    std::vector<uint8_t> spiTransfer(int chipSelect, const std::vector<uint8_t>& tx);
+    uint64_t getSPITransferCount() const { return m_spiTransfers; }
+    
     // Status
     bool isRunning() const { return m_running; }
     uint32_t getProgramCounter() const { return m_programCounter; }
@@ -110,6 +125,8 @@ private:
     // Communication
     std::string m_uartTxBuffer;
     std::string m_uartRxBuffer;
+    std::map<int, SPIDevice> m_spiDevices;
+    uint64_t m_spiTransfers;
     
     // Simulation state
     double m_cycleTime;
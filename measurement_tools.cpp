@@ -278,6 +278,9 @@ MeasurementTools::MeasurementTools(QWidget* parent)
     // Initialize oscilloscope traces
     m_oscilloscope->addTrace("Voltage", Qt::blue);
     m_oscilloscope->addTrace("Current", Qt::red);
+    
+    // Logic analyzer channels
+    m_logicAnalyzer->addChannel("Energy Pulse", Qt::green);
 }
 
 // Simplified VirtualLogicAnalyzer implementation
@@ -1,8 +1,8 @@
 
 #include "metering_engine.h"
+#include "register_journal.h"
 #include <cmath>
 #include <algorithm>
-#include <random>
 #include <iostream>
 #include <complex>
 #include <numeric>
@@ -13,13 +13,51 @@ MeteringEngine::MeteringEngine()
     , m_configCurrent(5.0)
     , m_configFrequency(50.0)
     , m_configPowerFactor(0.95)
+    , m_staleGroups(MeasurementGroup::All)
     , m_simulationTime(0.0)
     , m_phaseAngle(0.0)
+    , m_sampleCount(0)
+    , m_sampleTarget(0)
+    , m_sampleRemainder(0.0)
+    , m_nextListenerId(0)
+    , m_referenceCount(0)
+    , m_nextSubscriptionId(0)
+    , m_frequencyPhase(0.0)
     , m_totalEnergy(0.0)
     , m_lastPowerSample(0.0)
+    , m_sampleEnergy(0.0)
+    , m_energyScale(1.0)
+    , m_journal(nullptr)
+    , m_journalResolution(0.01)
+    , m_journaledEnergy(0.0)
+    , m_journaledResets(0)
     , m_relayConnected(true)
+    , m_harmonicAnalysisEnabled(false)
+    , m_frequencyLocked(false)
+    , m_harmonicSpectrum{}
+    , m_tddLoadCurrent(0.0)
     , m_noiseAmplitude(0.0)
+    , m_dcCurrent(0.0)
+    , m_phaseLoad{1.0, 1.0, 1.0}
+    , m_neutralReturnFraction(1.0)
+    , m_neutralCurrent(0.0)
+    , m_neutralPhase(0.0)
+    , m_neutralOpen(false)
+    , m_neutralMismatchFraction(0.1)
+    , m_neutralMismatchMinimum(0.05)
 {
+    m_sampleBlock.startTime = 0.0;
+    m_sampleBlock.sampleRate = SAMPLE_RATE;
+    m_sampleBlock.count = 0;
+    m_sampleBlock.phases = 1;
+    m_referenceHistory.resize(REFERENCE_HISTORY);
+    for (int ph = 0; ph < 3; ph++) {
+        m_sampleBlock.voltage[ph].assign(SAMPLES_PER_CYCLE, 0.0);
+        m_sampleBlock.current[ph].assign(SAMPLES_PER_CYCLE, 0.0);
+        m_noiseBlock[ph].assign(SAMPLES_PER_CYCLE, 0.0);
+    }
+    m_sampleBlock.neutral.assign(SAMPLES_PER_CYCLE, 0.0);
+    
     reset();
 }
 
@@ -32,6 +70,16 @@ void MeteringEngine::configure(bool threePhase, double voltage, double current,
     m_configCurrent = current;
     m_configFrequency = frequency;
     m_configPowerFactor = powerFactor;
+    m_loadMix.setNominalVoltage(voltage);
+    m_resampler.configure(frequency, SAMPLES_PER_CYCLE);
+    m_powerAccumulator.configure(static_cast<int>(std::lround(SAMPLE_RATE / frequency)));
+    m_harmonicAnalyzer.configure(frequency, m_frequencyLocked ? SAMPLES_PER_CYCLE * frequency : SAMPLE_RATE);
+    m_staleGroups = MeasurementGroup::All;
+    
+    for (auto& generator : m_noiseGenerators) {
+        generator.setSampleRate(SAMPLE_RATE);
+        generator.setHumFrequency(frequency);
+    }
     
     // Initialize waveform arrays
     m_voltageWaveform.resize(SAMPLES_PER_CYCLE);
@@ -51,9 +99,19 @@ void MeteringEngine::reset()
 {
     m_simulationTime = 0.0;
     m_phaseAngle = 0.0;
+    m_sampleCount = 0;
+    m_sampleTarget = 0;
+    m_sampleRemainder = 0.0;
+    m_sampleBlock.count = 0;
+    m_referenceCount = 0;
     m_totalEnergy = 0.0;
     m_lastPowerSample = 0.0;
+    m_sampleEnergy = 0.0;
+    m_energyScale = 1.0;
     m_relayConnected = true;
+    m_demandEngine.reset();
+    m_touEngine.resetRegisters();
+    m_pulseOutput.reset();
     
     // Clear measurements
     m_measurements = {};
@@ -74,12 +132,34 @@ void MeteringEngine::reset()
     m_tamperEvents.clear();
     
     // Clear signal injections
-    m_injections.clear();
+    m_injectionScheduler.clear();
+    m_frequencyPhase = 0.0;
+    m_transientGenerator.clear();
+    m_resampler.reset();
     
     // Clear harmonics
     m_harmonics.clear();
     m_interharmonics.clear();
     m_noiseAmplitude = 0.0;
+    m_dcCurrent = 0.0;
+    m_neutralReturnFraction = 1.0;
+    m_neutralCurrent = 0.0;
+    m_neutralPhase = 0.0;
+    m_neutralOpen = false;
+    for (double& load : m_phaseLoad) {
+        load = 1.0;
+    }
+    
+    m_transducer.setExternalFlux(0.0);
+    m_transducer.reset();
+    m_powerAccumulator.reset();
+    m_loadMix.clear();
+    m_harmonicAnalyzer.reset();
+    m_staleGroups = MeasurementGroup::All;
+    for (auto& subscription : m_subscriptions) {
+        subscription.second.lastTime = 0.0;
+        subscription.second.lastBoundary = 0;
+    }
 }
 
 void MeteringEngine::update(double deltaTime)
@@ -95,9 +175,95 @@ void MeteringEngine::update(double deltaTime)
     // Process tamper events
     processTamperEvents();
     
-    // Update energy measurement
-    m_totalEnergy += m_measurements.activePower * deltaTime / 3600.0; // Wh
+    // Energy is integrated from every sample, not from the last cycle's power
+    double sampleEnergy = m_powerAccumulator.getEnergy();
+    double deltaEnergy = (sampleEnergy - m_sampleEnergy) * m_energyScale / 3600.0; // Wh
+    m_sampleEnergy = sampleEnergy;
+    m_totalEnergy += deltaEnergy;
     m_measurements.energy = m_totalEnergy;
+    
+    // Book the energy to the tariff register(s) active during this step
+    m_touEngine.accumulate(m_simulationTime - deltaTime, m_simulationTime, deltaEnergy);
+    
+    // Demand is integrated from the energy register
+    m_demandEngine.setActiveTariff(m_touEngine.getActiveTariff());
+    m_demandEngine.update(m_simulationTime, m_totalEnergy);
+    
+    if (m_journal) {
+        journalRegisters(false);
+    }
+    
+    if (!m_subscriptions.empty()) {
+        notifySubscribers();
+    }
+}
+
+const MeteringMeasurements& MeteringEngine::getMeasurements() const
+{
+    refreshDerived(MeasurementGroup::All);
+    return m_measurements;
+}
+
+const HarmonicSpectrum& MeteringEngine::getHarmonicSpectrum() const
+{
+    refreshDerived(MeasurementGroup::Harmonics);
+    return m_harmonicSpectrum;
+}
+
+void MeteringEngine::refreshDerived(unsigned groups) const
+{
+    unsigned stale = groups & m_staleGroups;
+    if (stale & MeasurementGroup::Harmonics) {
+        calculateHarmonics();
+        calculatePowerQuality();
+    }
+    if (stale & MeasurementGroup::Phasors) {
+        calculatePhasors();
+    }
+    m_staleGroups &= ~stale;
+}
+
+int MeteringEngine::subscribeMeasurements(unsigned groups, MeasurementListener listener, double interval)
+{
+    int id = m_nextSubscriptionId++;
+    m_subscriptions[id] = {groups, listener, std::max(interval, 0.0), m_simulationTime, boundaryCount(groups)};
+    return id;
+}
+
+void MeteringEngine::unsubscribeMeasurements(int id)
+{
+    m_subscriptions.erase(id);
+}
+
+uint64_t MeteringEngine::boundaryCount(unsigned groups) const
+{
+    // Harmonics aggregate over the analysis window when one is running, everything else per mains cycle
+    if ((groups & MeasurementGroup::Harmonics) && m_harmonicAnalysisEnabled) {
+        return m_harmonicAnalyzer.getWindowCount();
+    }
+    return m_sampleCount / SAMPLES_PER_CYCLE;
+}
+
+void MeteringEngine::notifySubscribers()
+{
+    for (auto& entry : m_subscriptions) {
+        MeasurementSubscription& subscription = entry.second;
+        bool due;
+        if (subscription.interval > 0.0) {
+            // Tolerance absorbs the rounding of the accumulated simulation time
+            due = m_simulationTime - subscription.lastTime >= subscription.interval - 1e-9;
+        } else {
+            uint64_t boundary = boundaryCount(subscription.groups);
+            due = boundary != subscription.lastBoundary;
+            subscription.lastBoundary = boundary;
+        }
+        
+        if (due) {
+            subscription.lastTime = m_simulationTime;
+            refreshDerived(subscription.groups);
+            subscription.listener(m_measurements);
+        }
+    }
 }
 
 void MeteringEngine::updateWaveforms(double deltaTime)
@@ -109,59 +275,165 @@ void MeteringEngine::updateWaveforms(double deltaTime)
         m_phaseAngle -= 2.0 * M_PI;
     }
     
-    // Generate one cycle of samples
-    for (int i = 0; i < SAMPLES_PER_CYCLE; i++) {
-        double t = i / SAMPLE_RATE;
-        generateSignals(m_simulationTime + t);
+    // Generate every sample due since the last update, at most one cycle per block.
+    // The sample clock counts whole samples and carries the fraction, so rounding
+    // in the accumulated simulation time never drops one.
+    double due = m_sampleRemainder + std::max(deltaTime, 0.0) * SAMPLE_RATE;
+    uint64_t whole = static_cast<uint64_t>(std::floor(due + 1e-6));
+    m_sampleRemainder = due - static_cast<double>(whole);
+    m_sampleTarget += whole;
+    uint64_t targetSample = m_sampleTarget;
+    
+    while (m_sampleCount < targetSample) {
+        int count = static_cast<int>(std::min<uint64_t>(targetSample - m_sampleCount, SAMPLES_PER_CYCLE));
+        int phases = m_isThreePhase ? 3 : 1;
+        
+        m_sampleBlock.startTime = m_sampleCount / SAMPLE_RATE;
+        m_sampleBlock.count = count;
+        m_sampleBlock.phases = phases;
+        
+        // Appliance switching is resolved at block granularity
+        m_loadMix.update(m_sampleBlock.startTime);
+        
+        // Signal state at the block start for the reference history
+        {
+            const InjectionState& injection = m_injectionScheduler.stateAt(m_sampleBlock.startTime);
+            ReferenceRecord& record = m_referenceHistory[m_referenceCount % REFERENCE_HISTORY];
+            record.startTime = m_sampleBlock.startTime;
+            record.frequencyPhase = m_frequencyPhase;
+            record.frequencyDeviation = injection.frequencyDeviation;
+            loadVoltages(injection, record.across);
+            for (int ph = 0; ph < 3; ph++) {
+                record.phaseOffset[ph] = injection.phaseOffset[ph];
+                record.load[ph] = m_isThreePhase ? m_phaseLoad[ph] : 1.0;
+            }
+            m_referenceCount++;
+        }
+        
+        // Pre-fill the noise for the whole block
+        if (m_noiseAmplitude > 0.0) {
+            for (int ph = 0; ph < phases; ph++) {
+                m_noiseGenerators[ph].fill(m_noiseBlock[ph].data(), count);
+            }
+        }
+        
+        for (int i = 0; i < count; i++) {
+            generateSignals((m_sampleCount + i) / SAMPLE_RATE, i);
+        }
+        m_sampleCount += count;
+        
+        // Oversampled transients; returns immediately when none is in flight
+        m_transientGenerator.process(m_sampleBlock);
+        
+        // Neutral conductor: the return of the conductor currents plus the independent current
+        // already in the channel. An open neutral carries nothing; in three phase the floating
+        // star then also cancels the zero-sequence current the sources left (harmonics, appliances)
+        {
+            const double returnFraction = m_neutralOpen ? 0.0 : m_neutralReturnFraction;
+            const double independent = m_neutralOpen ? 0.0 : 1.0;
+            const double zeroSequence = m_neutralOpen && phases == 3 ? 1.0 / 3.0 : 0.0;
+            double* neutral = m_sampleBlock.neutral.data();
+            for (int i = 0; i < count; i++) {
+                double sum = 0.0;
+                for (int ph = 0; ph < phases; ph++) {
+                    sum += m_sampleBlock.current[ph][i];
+                }
+                for (int ph = 0; ph < phases; ph++) {
+                    m_sampleBlock.current[ph][i] -= zeroSequence * sum;
+                }
+                neutral[i] = independent * neutral[i] + returnFraction * sum;
+            }
+        }
+        
+        // Current sensor response; the ideal sensor leaves the block untouched
+        double* currents[3] = {m_sampleBlock.current[0].data(), m_sampleBlock.current[1].data(),
+                               m_sampleBlock.current[2].data()};
+        m_transducer.process(currents, phases, count, SAMPLE_RATE);
+        
+        // Measurements follow the sensed signals, as a meter sees them
+        m_powerAccumulator.process(m_sampleBlock);
+        
+        // Pulses follow the measured (post-sensor) energy, sample by sample
+        m_pulseOutput.process(m_sampleBlock);
+        
+        if (m_frequencyLocked) {
+            m_resampler.process(m_sampleBlock);
+            while (m_resampler.nextCycle(m_lockedCycle)) {
+                if (m_harmonicAnalysisEnabled) {
+                    m_harmonicAnalyzer.process(m_lockedCycle);
+                }
+            }
+        } else if (m_harmonicAnalysisEnabled) {
+            m_harmonicAnalyzer.process(m_sampleBlock);
+        }
+        
+        for (const auto& listener : m_sampleListeners) {
+            listener.second(m_sampleBlock);
+        }
     }
 }
 
-void MeteringEngine::generateSignals(double time)
+void MeteringEngine::loadVoltages(const InjectionState& injection, std::complex<double> across[3]) const
 {
-    double omega = 2.0 * M_PI * m_configFrequency;
-    double phase = omega * time;
-    
-    // Apply signal injections
-    double voltageScale = 1.0;
-    double frequencyDeviation = 0.0;
+    for (int ph = 0; ph < 3; ph++) {
+        across[ph] = injection.voltageScale[ph];
+    }
+    if (!m_isThreePhase || !m_neutralOpen || !m_relayConnected) {
+        return;
+    }
     
-    for (auto& injection : m_injections) {
-        if (injection.active && 
-            time >= injection.startTime && 
-            time < injection.startTime + injection.duration) {
-            
-            if (injection.type == "voltage_dip") {
-                voltageScale *= (1.0 - injection.magnitude);
-            } else if (injection.type == "frequency_variation") {
-                frequencyDeviation = injection.magnitude;
-            }
-        }
+    // With the neutral open the loads form a floating star, acting as impedances; its
+    // point settles where their fundamental currents sum to zero
+    std::complex<double> weighted = 0.0;
+    double admittance = 0.0;
+    for (int ph = 0; ph < 3; ph++) {
+        weighted += m_phaseLoad[ph] * std::polar(injection.voltageScale[ph],
+                                                 ph * 2.0 * M_PI / 3.0 + injection.phaseOffset[ph]);
+        admittance += m_phaseLoad[ph];
     }
+    if (admittance <= 0.0) {
+        return;
+    }
+    const std::complex<double> starPoint = weighted / admittance;
+    for (int ph = 0; ph < 3; ph++) {
+        across[ph] -= starPoint * std::polar(1.0, -(ph * 2.0 * M_PI / 3.0 + injection.phaseOffset[ph]));
+    }
+}
+
+void MeteringEngine::generateSignals(double time, int sampleIndex)
+{
+    // Combined effect of the injections active at this sample
+    const InjectionState& injection = m_injectionScheduler.stateAt(time);
     
-    // Update frequency with deviation
-    double currentFreq = m_configFrequency + frequencyDeviation;
-    omega = 2.0 * M_PI * currentFreq;
-    phase = omega * time;
+    // Frequency deviations are integrated so the phase stays continuous
+    double currentFreq = m_configFrequency + injection.frequencyDeviation;
+    double phase = 2.0 * M_PI * m_configFrequency * time + m_frequencyPhase;
+    m_frequencyPhase += 2.0 * M_PI * injection.frequencyDeviation / SAMPLE_RATE;
     
-    // Generate noise
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::normal_distribution<> noise(0.0, 1.0);
+    // Independent neutral current; the return of the phase currents is added per block
+    m_sampleBlock.neutral[sampleIndex] = m_neutralCurrent != 0.0
+        ? m_neutralCurrent * sqrt(2.0) * sin(phase + m_neutralPhase) : 0.0;
     
     if (m_isThreePhase) {
+        const bool floating = m_neutralOpen && m_relayConnected;
+        std::complex<double> acrossLoad[3];
+        loadVoltages(injection, acrossLoad);
+        
         // Three-phase signals
         for (int ph = 0; ph < 3; ph++) {
-            double phaseShift = ph * 2.0 * M_PI / 3.0;
+            double phaseShift = ph * 2.0 * M_PI / 3.0 + injection.phaseOffset[ph];
+            const std::complex<double> across = acrossLoad[ph];
             
             // Voltage waveform with harmonics and noise
-            double voltage = m_configVoltage * sqrt(2.0) * voltageScale * sin(phase + phaseShift);
+            double sinTheta = sin(phase + phaseShift);
+            double cosTheta = floating || !m_harmonics.isEmpty() ? cos(phase + phaseShift) : 0.0;
+            double voltage = m_configVoltage * sqrt(2.0) * (across.real() * sinTheta + across.imag() * cosTheta);
             
-            // Add harmonics with phase information
-            for (const auto& harmonic : m_harmonics) {
-                double harmonic_magnitude = harmonic.second.first;
-                double harmonic_phase = harmonic.second.second * M_PI / 180.0; // Convert to radians
-                voltage += m_configVoltage * sqrt(2.0) * harmonic_magnitude * 
-                          sin(harmonic.first * (phase + phaseShift) + harmonic_phase);
+            // Add the phase's own voltage and current harmonics
+            double voltageHarmonics = 0.0, currentHarmonics = 0.0;
+            if (!m_harmonics.isEmpty()) {
+                m_harmonics.synthesize(ph, sinTheta, cosTheta, voltageHarmonics, currentHarmonics);
+                voltage += m_configVoltage * voltageHarmonics;
             }
             
             // Add interharmonics
@@ -172,30 +444,40 @@ void MeteringEngine::generateSignals(double time)
             }
             
             // Add noise
-            voltage += m_noiseAmplitude * noise(gen);
+            if (m_noiseAmplitude > 0.0) {
+                voltage += m_noiseAmplitude * m_noiseBlock[ph][sampleIndex];
+            }
             
-            // Current waveform with power factor
+            // Current waveform with power factor, scaled by the phase's share of the load
             double powerFactorAngle = acos(m_configPowerFactor);
-            double current = m_configCurrent * sqrt(2.0) * sin(phase + phaseShift - powerFactorAngle);
+            double fundamental = sin(phase + phaseShift - powerFactorAngle);
+            if (floating) {
+                fundamental = across.real() * fundamental + across.imag() * cos(phase + phaseShift - powerFactorAngle);
+            }
+            double current = m_configCurrent * m_phaseLoad[ph] * (sqrt(2.0) * fundamental + currentHarmonics) + m_dcCurrent;
+            if (!m_loadMix.isEmpty()) {
+                current += m_loadMix.sample(ph, phase + phaseShift, injection.voltageScale[ph], time);
+            }
             
             // Apply relay state
             if (!m_relayConnected) {
                 current = 0.0;
             }
             
-            m_measurements.voltage[ph] = voltage / sqrt(2.0); // RMS
-            m_measurements.current[ph] = current / sqrt(2.0); // RMS
+            m_sampleBlock.voltage[ph][sampleIndex] = voltage;
+            m_sampleBlock.current[ph][sampleIndex] = current;
         }
     } else {
         // Single-phase signals
-        double voltage = m_configVoltage * sqrt(2.0) * voltageScale * sin(phase);
+        phase += injection.phaseOffset[0];
+        double sinTheta = sin(phase);
+        double voltage = m_configVoltage * sqrt(2.0) * injection.voltageScale[0] * sinTheta;
         
-        // Add harmonics with phase information
-        for (const auto& harmonic : m_harmonics) {
-            double harmonic_magnitude = harmonic.second.first;
-            double harmonic_phase = harmonic.second.second * M_PI / 180.0; // Convert to radians
-            voltage += m_configVoltage * sqrt(2.0) * harmonic_magnitude * 
-                      sin(harmonic.first * phase + harmonic_phase);
+        // Add voltage and current harmonics
+        double voltageHarmonics = 0.0, currentHarmonics = 0.0;
+        if (!m_harmonics.isEmpty()) {
+            m_harmonics.synthesize(0, sinTheta, cos(phase), voltageHarmonics, currentHarmonics);
+            voltage += m_configVoltage * voltageHarmonics;
         }
         
         // Add interharmonics
@@ -206,19 +488,29 @@ void MeteringEngine::generateSignals(double time)
         }
         
         // Add noise
-        voltage += m_noiseAmplitude * noise(gen);
+        if (m_noiseAmplitude > 0.0) {
+            voltage += m_noiseAmplitude * m_noiseBlock[0][sampleIndex];
+        }
         
         // Current waveform with power factor
         double powerFactorAngle = acos(m_configPowerFactor);
-        double current = m_configCurrent * sqrt(2.0) * sin(phase - powerFactorAngle);
+        double current = m_configCurrent * (sqrt(2.0) * sin(phase - powerFactorAngle) + currentHarmonics) + m_dcCurrent;
+        if (!m_loadMix.isEmpty()) {
+            current += m_loadMix.sample(0, phase, injection.voltageScale[0], time);
+        }
         
         // Apply relay state
         if (!m_relayConnected) {
             current = 0.0;
         }
         
+        m_sampleBlock.voltage[0][sampleIndex] = voltage;
+        m_sampleBlock.current[0][sampleIndex] = current;
+        
         // Store in waveform arrays (simplified - using instantaneous values)
-        int index = static_cast<int>((phase / (2.0 * M_PI)) * SAMPLES_PER_CYCLE) % SAMPLES_PER_CYCLE;
+        // Phase jumps and negative frequency deviations can push the phase below zero
+        double cycles = phase / (2.0 * M_PI);
+        int index = static_cast<int>((cycles - std::floor(cycles)) * SAMPLES_PER_CYCLE) % SAMPLES_PER_CYCLE;
         m_voltageWaveform[index] = voltage;
         m_currentWaveform[index] = current;
     }
@@ -228,55 +520,53 @@ void MeteringEngine::generateSignals(double time)
 
 void MeteringEngine::calculateMeasurements()
 {
-    if (m_isThreePhase) {
-        // Three-phase calculations
-        double totalVoltageRMS = 0.0;
-        double totalCurrentRMS = 0.0;
-        double totalActivePower = 0.0;
-        
-        for (int ph = 0; ph < 3; ph++) {
-            double voltageRMS = std::abs(m_measurements.voltage[ph]);
-            double currentRMS = std::abs(m_measurements.current[ph]);
-            
-            totalVoltageRMS += voltageRMS * voltageRMS;
-            totalCurrentRMS += currentRMS * currentRMS;
-            totalActivePower += voltageRMS * currentRMS * m_configPowerFactor;
-        }
-        
-        m_measurements.voltageRMS = sqrt(totalVoltageRMS / 3.0);
-        m_measurements.currentRMS = sqrt(totalCurrentRMS / 3.0);
-        m_measurements.activePower = totalActivePower;
+    // Per-phase values of the last complete cycle; totals are arithmetic sums and the
+    // RMS summaries the quadratic mean over the phases
+    const int phases = m_isThreePhase ? 3 : 1;
+    double sumVoltage = 0.0, sumCurrent = 0.0;
+    double active = 0.0, reactive = 0.0, apparent = 0.0, fundamentalReactive = 0.0;
+    for (int ph = 0; ph < 3; ph++) {
+        const PhasePower& power = m_powerAccumulator.getPhase(ph);
+        const bool used = ph < phases;
+        m_measurements.voltage[ph] = used ? power.voltageRMS : 0.0;
+        m_measurements.current[ph] = used ? power.currentRMS : 0.0;
+        if (!used) continue;
         
-    } else {
-        // Single-phase calculations
-        m_measurements.voltageRMS = m_configVoltage;
-        m_measurements.currentRMS = m_relayConnected ? m_configCurrent : 0.0;
-        m_measurements.activePower = m_measurements.voltageRMS * m_measurements.currentRMS * m_configPowerFactor;
+        sumVoltage += power.voltageRMS * power.voltageRMS;
+        sumCurrent += power.currentRMS * power.currentRMS;
+        active += power.activePower;
+        reactive += power.reactivePower;
+        apparent += power.apparentPower;
+        fundamentalReactive += power.fundamentalReactive;
     }
     
-    // Common calculations
-    m_measurements.apparentPower = m_measurements.voltageRMS * m_measurements.currentRMS;
-    m_measurements.reactivePower = m_measurements.apparentPower * sin(acos(m_configPowerFactor));
-    m_measurements.powerFactor = m_configPowerFactor;
+    m_measurements.voltageRMS = std::sqrt(sumVoltage / phases);
+    m_measurements.currentRMS = std::sqrt(sumCurrent / phases);
+    m_measurements.activePower = active;
+    m_measurements.reactivePower = reactive;
+    m_measurements.apparentPower = apparent;
+    m_measurements.fundamentalReactivePower = fundamentalReactive;
+    m_measurements.nonactivePower = std::sqrt(std::max(apparent * apparent - active * active, 0.0));
+    m_measurements.distortionPower = std::sqrt(std::max(apparent * apparent - active * active - reactive * reactive, 0.0));
+    m_measurements.powerFactor = apparent > 0.0 ? active / apparent : 1.0;
+    m_measurements.neutralCurrent = m_powerAccumulator.getNeutral().measuredRMS;
+    m_measurements.calculatedNeutralCurrent = m_powerAccumulator.getNeutral().calculatedRMS;
     
     // Apply tamper effects
+    const double measuredPower = m_measurements.activePower;
     for (const auto& tamper : m_tamperEvents) {
-        if (tamper.second.active) {
+        if (tamper.second.active && !tamper.second.detected) {
             if (tamper.first == "Magnet Tamper") {
-                // Magnetic field affects current measurement
-                m_measurements.currentRMS *= 0.8;
-                m_measurements.activePower *= 0.8;
+                // Modelled sensors respond in the sample stream (a CT saturates, air-cored
+                // and resistive sensors are immune); otherwise approximate the loss
+                if (m_transducer.getType() == TransducerType::Ideal) {
+                    m_measurements.currentRMS *= 0.8;
+                    m_measurements.activePower *= 0.8;
+                }
             } else if (tamper.first == "Reverse Current") {
                 // Reverse energy flow
                 m_measurements.activePower *= -1.0;
                 m_measurements.currentRMS *= -1.0;
-            } else if (tamper.first == "Neutral Missing") {
-                // Voltage imbalance in 3-phase
-                if (m_isThreePhase) {
-                    m_measurements.voltage[0] *= 1.2;
-                    m_measurements.voltage[1] *= 0.8;
-                    m_measurements.voltage[2] *= 0.8;
-                }
             } else if (tamper.first == "Phase Loss") {
                 // One phase voltage drops to zero
                 if (m_isThreePhase) {
@@ -290,56 +580,45 @@ void MeteringEngine::calculateMeasurements()
         }
     }
     
-    // Calculate harmonics and phasors
-    calculateHarmonics();
-    calculatePhasors();
-    calculateCrestFactor();
-    calculateKFactor();
-    calculatePowerFactorComponents();
-    
-    // Calculate THD from harmonic data
-    double thd_v_squared = 0.0;
-    double thd_i_squared = 0.0;
-    
-    for (int h = 1; h < 33; h++) { // 2nd to 33rd harmonic
-        thd_v_squared += m_measurements.voltageHarmonics[h].magnitude * m_measurements.voltageHarmonics[h].magnitude;
-        thd_i_squared += m_measurements.currentHarmonics[h].magnitude * m_measurements.currentHarmonics[h].magnitude;
-    }
-    
-    double fundamental_v = m_measurements.voltageHarmonics[0].magnitude; // 1st harmonic (fundamental)
-    double fundamental_i = m_measurements.currentHarmonics[0].magnitude;
+    // Energy registration follows the tamper effects on the active power
+    m_energyScale = measuredPower != 0.0 ? m_measurements.activePower / measuredPower : 1.0;
     
-    m_measurements.thd_voltage = (fundamental_v > 0) ? sqrt(thd_v_squared) / fundamental_v * 100.0 : 0.0;
-    m_measurements.thd_current = (fundamental_i > 0) ? sqrt(thd_i_squared) / fundamental_i * 100.0 : 0.0;
+    // Harmonics, phasors and the indices derived from them are computed when someone asks
+    m_staleGroups = MeasurementGroup::All;
 }
 
 void MeteringEngine::processTamperEvents()
 {
-    // Check for automatic tamper detection based on measurements
+    // Check for automatic tamper detection based on measurements, once there are any
+    if (m_powerAccumulator.getCycleCount() == 0) return;
     
     // Over/under voltage detection
-    if (m_measurements.voltageRMS > m_configVoltage * 1.1) {
-        if (m_tamperEvents.find("Over Voltage") == m_tamperEvents.end()) {
-            injectTamperEvent("Over Voltage");
-        }
-    } else if (m_measurements.voltageRMS < m_configVoltage * 0.9) {
-        if (m_tamperEvents.find("Under Voltage") == m_tamperEvents.end()) {
-            injectTamperEvent("Under Voltage");
-        }
-    }
+    detectTamper("Over Voltage", m_measurements.voltageRMS > m_configVoltage * 1.1);
+    detectTamper("Under Voltage", m_measurements.voltageRMS < m_configVoltage * 0.9);
     
     // Frequency deviation detection
-    if (std::abs(m_measurements.frequency - 50.0) > 1.0) {
-        if (m_tamperEvents.find("Frequency Deviation") == m_tamperEvents.end()) {
-            injectTamperEvent("Frequency Deviation");
-        }
-    }
+    detectTamper("Frequency Deviation", std::abs(m_measurements.frequency - 50.0) > 1.0);
+    
+    // Neutral current against the vector sum of the phase currents
+    const NeutralCurrent& neutral = m_powerAccumulator.getNeutral();
+    double mismatchLimit = std::max(m_neutralMismatchFraction * std::max(neutral.measuredRMS, neutral.calculatedRMS),
+                                    m_neutralMismatchMinimum);
+    detectTamper("Neutral Mismatch", neutral.mismatchRMS > mismatchLimit);
     
     // Reverse power flow detection
-    if (m_measurements.activePower < -10.0) {
-        if (m_tamperEvents.find("Reverse Power Flow") == m_tamperEvents.end()) {
-            injectTamperEvent("Reverse Power Flow");
-        }
+    detectTamper("Reverse Power Flow", m_measurements.activePower < -10.0);
+}
+
+void MeteringEngine::detectTamper(const std::string& type, bool condition)
+{
+    // A detected event follows its condition; one injected by the user is left alone
+    auto it = m_tamperEvents.find(type);
+    const bool active = it != m_tamperEvents.end() && it->second.active;
+    if (condition && !active) {
+        injectTamperEvent(type);
+        m_tamperEvents[type].detected = true;
+    } else if (!condition && active && it->second.detected) {
+        clearTamperEvent(type);
     }
 }
 
@@ -349,18 +628,145 @@ void MeteringEngine::injectTamperEvent(const std::string& type)
     event.type = type;
     event.timestamp = std::chrono::system_clock::now();
     event.active = true;
+    event.detected = false;
     
     m_tamperEvents[type] = event;
+    if (m_journal) {
+        m_journal->logEvent(NVEvent::Tamper + tamperEventCode(type), m_simulationTime);
+    }
+    
+    if (type == "Magnet Tamper") {
+        m_transducer.setExternalFlux(MAGNET_CORE_FRACTION * m_transducer.getCTParameters().kneeFlux);
+    } else if (type == "Neutral Missing") {
+        m_neutralOpen = true;
+    }
     
     std::cout << "Tamper event injected: " << type << std::endl;
 }
 
+uint16_t MeteringEngine::tamperEventCode(const std::string& type)
+{
+    static const char* const TYPES[] = {
+        "Magnet Tamper", "Reverse Current", "Neutral Missing", "Phase Loss",
+        "Over Voltage", "Under Voltage", "Frequency Deviation", "Reverse Power Flow", "Neutral Mismatch"
+    };
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); i++) {
+        if (type == TYPES[i]) return static_cast<uint16_t>(i + 1);
+    }
+    return 0;
+}
+
+void MeteringEngine::attachJournal(RegisterJournal* journal, double energyResolution)
+{
+    // Nothing is written here, so a journal from an earlier run survives until restoreRegisters()
+    m_journal = journal;
+    m_journalResolution = energyResolution;
+    m_journaledEnergy = m_totalEnergy;
+    m_journaledTariffs = m_touEngine.getTariffRegisters();
+    m_journaledBlockMD = m_demandEngine.getBlockMaxDemand();
+    m_journaledSlidingMD = m_demandEngine.getSlidingMaxDemand();
+    m_journaledResets = m_demandEngine.getResetCount();
+}
+
+void MeteringEngine::journalRegisters(bool force)
+{
+    if (force || std::abs(m_totalEnergy - m_journaledEnergy) >= m_journalResolution) {
+        m_journal->write(NVRegister::TotalEnergy, m_totalEnergy);
+        m_journaledEnergy = m_totalEnergy;
+    }
+
+    const std::vector<double>& tariffs = m_touEngine.getTariffRegisters();
+    m_journaledTariffs.resize(tariffs.size(), 0.0);
+    for (size_t t = 0; t < tariffs.size(); t++) {
+        if (force || std::abs(tariffs[t] - m_journaledTariffs[t]) >= m_journalResolution) {
+            m_journal->write(NVRegister::TariffEnergy + t, tariffs[t]);
+            m_journaledTariffs[t] = tariffs[t];
+        }
+    }
+
+    // MD registers change rarely; any new maximum is written with its timestamp
+    auto journalMaxDemand = [&](const std::vector<MaxDemandRegister>& registers,
+                                std::vector<MaxDemandRegister>& journaled, uint16_t base) {
+        journaled.resize(registers.size(), {0.0, 0.0});
+        for (size_t t = 0; t < registers.size(); t++) {
+            if (force || registers[t].value != journaled[t].value || registers[t].timestamp != journaled[t].timestamp) {
+                m_journal->write(base + t, registers[t].value);
+                m_journal->write(base + 0x80 + t, registers[t].timestamp);
+                journaled[t] = registers[t];
+            }
+        }
+    };
+    journalMaxDemand(m_demandEngine.getBlockMaxDemand(), m_journaledBlockMD, NVRegister::BlockMaxDemand);
+    journalMaxDemand(m_demandEngine.getSlidingMaxDemand(), m_journaledSlidingMD, NVRegister::SlidingMaxDemand);
+
+    if (force || m_demandEngine.getResetCount() != m_journaledResets) {
+        m_journal->write(NVRegister::DemandResets, m_demandEngine.getResetCount());
+        m_journaledResets = m_demandEngine.getResetCount();
+    }
+}
+
+void MeteringEngine::powerFail()
+{
+    if (!m_journal) return;
+    journalRegisters(true);  // energy first: the hold-up budget may end mid-way
+    m_journal->logEvent(NVEvent::PowerFail, m_simulationTime);
+}
+
+bool MeteringEngine::restoreRegisters()
+{
+    if (!m_journal || !m_journal->has(NVRegister::TotalEnergy)) {
+        return false;
+    }
+
+    m_totalEnergy = m_journal->read(NVRegister::TotalEnergy);
+    m_measurements.energy = m_totalEnergy;
+    m_journaledEnergy = m_totalEnergy;
+
+    std::vector<double> tariffs(m_touEngine.getTariffCount());
+    for (size_t t = 0; t < tariffs.size(); t++) {
+        tariffs[t] = m_journal->read(NVRegister::TariffEnergy + t);
+    }
+    m_touEngine.setTariffRegisters(tariffs);
+    m_journaledTariffs = tariffs;
+
+    std::vector<MaxDemandRegister> block(m_demandEngine.getTariffCount()), sliding(block.size());
+    for (size_t t = 0; t < block.size(); t++) {
+        block[t] = {m_journal->read(NVRegister::BlockMaxDemand + t), m_journal->read(NVRegister::BlockMaxDemand + 0x80 + t)};
+        sliding[t] = {m_journal->read(NVRegister::SlidingMaxDemand + t), m_journal->read(NVRegister::SlidingMaxDemand + 0x80 + t)};
+    }
+    m_journaledResets = static_cast<int>(m_journal->read(NVRegister::DemandResets));
+    m_demandEngine.restoreMaxDemand(block, sliding, m_journaledResets);
+    m_journaledBlockMD = block;
+    m_journaledSlidingMD = sliding;
+
+    m_journal->logEvent(NVEvent::PowerUp, m_simulationTime);
+    return true;
+}
+
 void MeteringEngine::clearTamperEvent(const std::string& type)
 {
     auto it = m_tamperEvents.find(type);
     if (it != m_tamperEvents.end()) {
         it->second.active = false;
     }
+    
+    if (type == "Magnet Tamper") {
+        m_transducer.setExternalFlux(0.0);
+    } else if (type == "Neutral Missing") {
+        m_neutralOpen = false;
+    }
+}
+
+void MeteringEngine::setNeutralCurrent(double amps, double phaseDegrees)
+{
+    m_neutralCurrent = amps;
+    m_neutralPhase = phaseDegrees * M_PI / 180.0;
+}
+
+void MeteringEngine::setNeutralMismatchThreshold(double fraction, double minimumAmps)
+{
+    m_neutralMismatchFraction = fraction;
+    m_neutralMismatchMinimum = minimumAmps;
 }
 
 std::vector<TamperEvent> MeteringEngine::getActiveTamperEvents() const
@@ -384,35 +790,123 @@ std::vector<double> MeteringEngine::getCurrentWaveform() const
     return m_currentWaveform;
 }
 
-void MeteringEngine::injectVoltageDip(double magnitude, double duration)
+bool MeteringEngine::getSignalReference(double time, SignalReference& reference) const
 {
-    SignalInjection injection;
-    injection.active = true;
-    injection.startTime = m_simulationTime;
-    injection.duration = duration;
-    injection.magnitude = magnitude;
-    injection.type = "voltage_dip";
+    // Newest record starting at or before the requested instant
+    const uint64_t available = std::min<uint64_t>(m_referenceCount, REFERENCE_HISTORY);
+    const ReferenceRecord* record = nullptr;
+    const ReferenceRecord* previous = nullptr;
+    for (uint64_t back = 1; back <= available; back++) {
+        const ReferenceRecord& candidate = m_referenceHistory[(m_referenceCount - back) % REFERENCE_HISTORY];
+        if (candidate.startTime <= time) {
+            record = &candidate;
+            if (back < available) {
+                previous = &m_referenceHistory[(m_referenceCount - back - 1) % REFERENCE_HISTORY];
+            }
+            break;
+        }
+    }
+    if (!record || time > m_sampleCount / SAMPLE_RATE) {
+        return false;
+    }
+    
+    // Generated phase is 2 pi f t + integrated deviation; sin(x) is a cosine phasor at x - pi/2
+    const double frequencyPhase = record->frequencyPhase + 2.0 * M_PI * record->frequencyDeviation * (time - record->startTime);
+    const double lag = acos(m_configPowerFactor);
+    const int phases = m_isThreePhase ? 3 : 1;
     
-    m_injections.push_back(injection);
+    for (int ph = 0; ph < 3; ph++) {
+        if (ph >= phases) {
+            reference.voltage[ph] = reference.current[ph] = 0.0;
+            continue;
+        }
+        double angle = frequencyPhase + ph * 2.0 * M_PI / 3.0 + record->phaseOffset[ph] - M_PI / 2.0;
+        reference.voltage[ph] = m_configVoltage * record->across[ph] * std::polar(1.0, angle);
+        reference.current[ph] = m_relayConnected
+            ? m_configCurrent * record->load[ph] * record->across[ph] * std::polar(1.0, angle - lag) : 0.0;
+    }
+    
+    reference.frequency = m_configFrequency + record->frequencyDeviation;
+    reference.rocof = 0.0;
+    if (previous && record->startTime > previous->startTime) {
+        reference.rocof = (record->frequencyDeviation - previous->frequencyDeviation) /
+                          (record->startTime - previous->startTime);
+    }
+    return true;
 }
 
-void MeteringEngine::injectFrequencyVariation(double deviation, double duration)
+int MeteringEngine::addSampleBlockListener(SampleBlockListener listener)
 {
-    SignalInjection injection;
-    injection.active = true;
-    injection.startTime = m_simulationTime;
-    injection.duration = duration;
-    injection.magnitude = deviation;
-    injection.type = "frequency_variation";
-    
-    m_injections.push_back(injection);
+    int id = m_nextListenerId++;
+    m_sampleListeners[id] = listener;
+    return id;
+}
+
+void MeteringEngine::removeSampleBlockListener(int id)
+{
+    m_sampleListeners.erase(id);
+}
+
+int MeteringEngine::injectVoltageDip(double magnitude, double duration, unsigned phaseMask)
+{
+    return m_injectionScheduler.schedule(InjectionType::VoltageDip, m_simulationTime, duration,
+                                         magnitude, 0.0, phaseMask);
+}
+
+int MeteringEngine::injectVoltageSwell(double magnitude, double duration, unsigned phaseMask)
+{
+    return m_injectionScheduler.schedule(InjectionType::VoltageSwell, m_simulationTime, duration,
+                                         magnitude, 0.0, phaseMask);
+}
+
+int MeteringEngine::injectVoltageRamp(double change, double rampTime, double duration, unsigned phaseMask)
+{
+    return m_injectionScheduler.schedule(InjectionType::VoltageRamp, m_simulationTime, duration,
+                                         change, rampTime, phaseMask);
+}
+
+int MeteringEngine::injectFrequencyVariation(double deviation, double duration, double rampTime)
+{
+    return m_injectionScheduler.schedule(InjectionType::FrequencyVariation, m_simulationTime, duration,
+                                         deviation, rampTime);
+}
+
+int MeteringEngine::injectPhaseJump(double degrees, double duration, unsigned phaseMask)
+{
+    return m_injectionScheduler.schedule(InjectionType::PhaseJump, m_simulationTime, duration,
+                                         degrees, 0.0, phaseMask);
+}
+
+void MeteringEngine::injectOscillatoryTransient(double amplitude, double frequency, double decay, unsigned phaseMask)
+{
+    m_transientGenerator.schedule({TransientType::Oscillatory, TransientChannel::Voltage, m_simulationTime,
+                                   amplitude, frequency, decay, 0.0, phaseMask});
+}
+
+void MeteringEngine::injectImpulse(double amplitude, double frontTime, double tailTime, unsigned phaseMask)
+{
+    m_transientGenerator.schedule({TransientType::Impulse, TransientChannel::Voltage, m_simulationTime,
+                                   amplitude, 0.0, tailTime, frontTime, phaseMask});
+}
+
+void MeteringEngine::injectInrush(double peakCurrent, double decay, unsigned phaseMask)
+{
+    m_transientGenerator.schedule({TransientType::Inrush, TransientChannel::Current, m_simulationTime,
+                                   peakCurrent, m_configFrequency, decay, 0.0, phaseMask});
 }
 
 void MeteringEngine::injectHarmonics(int harmonic, double magnitude, double phase)
 {
-    if (harmonic >= 1 && harmonic <= 33) {
-        m_harmonics[harmonic] = std::make_pair(magnitude, phase);
-    }
+    m_harmonics.setHarmonic(HarmonicChannel::Voltage, InjectionPhase::ALL, harmonic, magnitude, phase);
+    m_harmonics.setHarmonic(HarmonicChannel::Current, InjectionPhase::ALL, harmonic, magnitude, phase);
+    m_staleGroups |= MeasurementGroup::Harmonics;
+}
+
+void MeteringEngine::setHarmonic(HarmonicChannel channel, int harmonic, double magnitude, double phase,
+                                 unsigned phaseMask)
+{
+    m_harmonics.setHarmonic(channel, phaseMask, harmonic, magnitude, phase);
+    m_staleGroups |= MeasurementGroup::Harmonics;
 }
 
 void MeteringEngine::injectInterharmonics(double frequency, double magnitude)
@@ -425,6 +919,21 @@ void MeteringEngine::injectNoise(double amplitude)
     m_noiseAmplitude = amplitude;
 }
 
+void MeteringEngine::setNoiseType(NoiseType type)
+{
+    for (auto& generator : m_noiseGenerators) {
+        generator.setType(type);
+    }
+}
+
+void MeteringEngine::setNoiseSeed(uint64_t seed)
+{
+    // Derive distinct streams per phase from the one engine seed
+    for (int ph = 0; ph < 3; ph++) {
+        m_noiseGenerators[ph].seed(seed + 0x9E3779B97F4A7C15ULL * ph);
+    }
+}
+
 double MeteringEngine::calculateRMS(const std::vector<double>& samples)
 {
     double sum = 0.0;
@@ -441,43 +950,111 @@ double MeteringEngine::calculateTHD(const std::vector<double>& samples)
     return 0.0;
 }
 
-void MeteringEngine::calculateHarmonics()
+void MeteringEngine::setHarmonicAnalysisEnabled(bool enabled)
+{
+    if (enabled && !m_harmonicAnalysisEnabled) {
+        m_harmonicAnalyzer.reset();
+    }
+    m_harmonicAnalysisEnabled = enabled;
+}
+
+void MeteringEngine::setFrequencyLockedAnalysis(bool enabled)
+{
+    if (enabled == m_frequencyLocked) return;
+    
+    // The locked stream runs at SAMPLES_PER_CYCLE per cycle, so the window spans whole cycles
+    m_frequencyLocked = enabled;
+    m_resampler.reset();
+    m_harmonicAnalyzer.configure(m_configFrequency, enabled ? SAMPLES_PER_CYCLE * m_configFrequency : SAMPLE_RATE);
+    m_staleGroups = MeasurementGroup::All;
+}
+
+void MeteringEngine::calculateHarmonics() const
 {
-    // Simulate harmonic analysis based on injected harmonics
-    // In a real implementation, this would use FFT on the waveform samples
+    HarmonicSpectrum& spectrum = m_harmonicSpectrum;
     
-    // Set fundamental (1st harmonic)
-    m_measurements.voltageHarmonics[0].magnitude = m_measurements.voltageRMS;
-    m_measurements.voltageHarmonics[0].phase = 0.0;
-    m_measurements.voltageHarmonics[0].percentage = 100.0;
+    // Harmonic groups of phase A from the latest analysis window
+    if (m_harmonicAnalysisEnabled && m_harmonicAnalyzer.hasResult()) {
+        const HarmonicGroupResult& result = m_harmonicAnalyzer.getResult();
+        for (int h = 0; h < HarmonicSpectrum::ORDERS; h++) {
+            spectrum.voltageMagnitude[h] = result.group[0][h + 1];
+            spectrum.voltagePhase[h] = result.phase[0][h + 1];
+            spectrum.currentMagnitude[h] = result.group[3][h + 1];
+            spectrum.currentPhase[h] = result.phase[3][h + 1];
+        }
+        return;
+    }
     
-    m_measurements.currentHarmonics[0].magnitude = m_measurements.currentRMS;
-    m_measurements.currentHarmonics[0].phase = -acos(m_configPowerFactor) * 180.0 / M_PI;
-    m_measurements.currentHarmonics[0].percentage = 100.0;
+    // Otherwise report the injected phase A spectra, which are relative to the fundamental,
+    // scaled to phase A's measured fundamental rather than the total RMS of all phases
+    const PhasePower& phaseA = m_powerAccumulator.getPhase(0);
+    const double fundamentalV = std::abs(phaseA.voltagePhasor);
+    const double fundamentalI = std::abs(phaseA.currentPhasor);
+    spectrum.voltageMagnitude[0] = fundamentalV;
+    spectrum.voltagePhase[0] = 0.0;
+    spectrum.currentMagnitude[0] = fundamentalI;
+    spectrum.currentPhase[0] = -acos(m_configPowerFactor) * 180.0 / M_PI;
     
-    // Set harmonics based on injected values
-    for (int h = 1; h < 33; h++) {
+    for (int h = 1; h < HarmonicSpectrum::ORDERS; h++) {
         int harmonic_order = h + 1; // h=0 is fundamental, h=1 is 2nd harmonic, etc.
         
-        if (m_harmonics.find(harmonic_order) != m_harmonics.end()) {
-            auto harmonic_data = m_harmonics[harmonic_order];
-            
-            m_measurements.voltageHarmonics[h].magnitude = m_measurements.voltageRMS * harmonic_data.first;
-            m_measurements.voltageHarmonics[h].phase = harmonic_data.second;
-            m_measurements.voltageHarmonics[h].percentage = harmonic_data.first * 100.0;
-            
-            m_measurements.currentHarmonics[h].magnitude = m_measurements.currentRMS * harmonic_data.first;
-            m_measurements.currentHarmonics[h].phase = harmonic_data.second;
-            m_measurements.currentHarmonics[h].percentage = harmonic_data.first * 100.0;
-        } else {
-            m_measurements.voltageHarmonics[h] = {0.0, 0.0, 0.0};
-            m_measurements.currentHarmonics[h] = {0.0, 0.0, 0.0};
-        }
+        spectrum.voltageMagnitude[h] = fundamentalV *
+                                       m_harmonics.getMagnitude(HarmonicChannel::Voltage, 0, harmonic_order);
+        spectrum.voltagePhase[h] = m_harmonics.getPhase(HarmonicChannel::Voltage, 0, harmonic_order);
+        spectrum.currentMagnitude[h] = fundamentalI *
+                                       m_harmonics.getMagnitude(HarmonicChannel::Current, 0, harmonic_order);
+        spectrum.currentPhase[h] = m_harmonics.getPhase(HarmonicChannel::Current, 0, harmonic_order);
     }
 }
 
-void MeteringEngine::calculatePhasors()
+void MeteringEngine::calculatePowerQuality() const
 {
+    const HarmonicSpectrum& spectrum = m_harmonicSpectrum;
+    double demandCurrent = m_tddLoadCurrent > 0.0 ? m_tddLoadCurrent : m_configCurrent;
+    PowerQualityIndices indices = computePowerQuality(spectrum, m_measurements.voltageRMS,
+                                                      m_measurements.currentRMS, demandCurrent);
+    
+    m_measurements.thd_voltage = indices.thdVoltage;
+    m_measurements.thd_current = indices.thdCurrent;
+    m_measurements.crest_factor_voltage = indices.crestFactorVoltage;
+    m_measurements.crest_factor_current = indices.crestFactorCurrent;
+    m_measurements.k_factor = indices.kFactor;
+    m_measurements.displacement_pf = m_configPowerFactor;
+    m_measurements.distortion_pf = indices.distortionPF;
+    m_measurements.tdd = indices.tdd;
+    
+    // Array-of-structs view kept for existing readers of MeteringMeasurements
+    const double fundamentalV = spectrum.voltageMagnitude[0];
+    const double fundamentalI = spectrum.currentMagnitude[0];
+    for (int h = 0; h < HarmonicSpectrum::ORDERS; h++) {
+        m_measurements.voltageHarmonics[h] = {spectrum.voltageMagnitude[h], spectrum.voltagePhase[h],
+                                              fundamentalV != 0.0 ? spectrum.voltageMagnitude[h] / fundamentalV * 100.0 : 0.0};
+        m_measurements.currentHarmonics[h] = {spectrum.currentMagnitude[h], spectrum.currentPhase[h],
+                                              fundamentalI != 0.0 ? spectrum.currentMagnitude[h] / fundamentalI * 100.0 : 0.0};
+    }
+}
+
+void MeteringEngine::calculatePhasors() const
+{
+    if (m_frequencyLocked && m_resampler.getCycleCount() > 0) {
+        // Measured fundamentals of the latest locked cycle, angles relative to the phase A voltage
+        const int phases = m_isThreePhase ? 3 : 1;
+        const std::complex<double> reference = std::polar(1.0, -std::arg(m_resampler.getFundamental(0)));
+        auto assign = [](PhasorData& data, std::complex<double> value) {
+            data = {std::abs(value), std::arg(value) * 180.0 / M_PI, value.real(), value.imag()};
+        };
+        for (int ph = 0; ph < 3; ph++) {
+            if (ph < phases) {
+                assign(m_measurements.voltagePhasor[ph], m_resampler.getFundamental(ph) * reference);
+                assign(m_measurements.currentPhasor[ph], m_resampler.getFundamental(3 + ph) * reference);
+            } else {
+                m_measurements.voltagePhasor[ph] = {0.0, 0.0, 0.0, 0.0};
+                m_measurements.currentPhasor[ph] = {0.0, 0.0, 0.0, 0.0};
+            }
+        }
+        return;
+    }
+    
     if (m_isThreePhase) {
         // Three-phase phasors
         for (int ph = 0; ph < 3; ph++) {
@@ -521,58 +1098,9 @@ void MeteringEngine::calculatePhasors()
     }
 }
 
-void MeteringEngine::calculateCrestFactor()
-{
-    // Simplified crest factor calculation
-    // Crest factor = Peak value / RMS value
-    double voltage_peak = m_measurements.voltageRMS * sqrt(2.0);
-    double current_peak = m_measurements.currentRMS * sqrt(2.0);
-    
-    // Add effect of harmonics to peak value
-    for (int h = 1; h < 33; h++) {
-        voltage_peak += m_measurements.voltageHarmonics[h].magnitude * sqrt(2.0);
-        current_peak += m_measurements.currentHarmonics[h].magnitude * sqrt(2.0);
-    }
-    
-    m_measurements.crest_factor_voltage = (m_measurements.voltageRMS > 0) ? voltage_peak / m_measurements.voltageRMS : 0.0;
-    m_measurements.crest_factor_current = (m_measurements.currentRMS > 0) ? current_peak / m_measurements.currentRMS : 0.0;
-}
-
-void MeteringEngine::calculateKFactor()
-{
-    // K-factor calculation for transformer derating
-    double k_factor = 1.0; // Fundamental contributes 1
-    
-    for (int h = 1; h < 33; h++) {
-        int harmonic_order = h + 1;
-        double harmonic_percentage = m_measurements.currentHarmonics[h].percentage / 100.0;
-        k_factor += harmonic_order * harmonic_order * harmonic_percentage * harmonic_percentage;
-    }
-    
-    m_measurements.k_factor = k_factor;
-}
-
-void MeteringEngine::calculatePowerFactorComponents()
-{
-    // Displacement power factor (fundamental component only)
-    m_measurements.displacement_pf = m_configPowerFactor;
-    
-    // Distortion power factor (effect of harmonics)
-    double total_rms_squared = m_measurements.currentHarmonics[0].magnitude * m_measurements.currentHarmonics[0].magnitude;
-    double harmonic_rms_squared = 0.0;
-    
-    for (int h = 1; h < 33; h++) {
-        double harmonic_rms = m_measurements.currentHarmonics[h].magnitude;
-        harmonic_rms_squared += harmonic_rms * harmonic_rms;
-        total_rms_squared += harmonic_rms * harmonic_rms;
-    }
-    
-    double fundamental_rms = m_measurements.currentHarmonics[0].magnitude;
-    m_measurements.distortion_pf = (total_rms_squared > 0) ? fundamental_rms / sqrt(total_rms_squared) : 1.0;
-}
-
 std::vector<HarmonicData> MeteringEngine::getVoltageHarmonics() const
 {
+    refreshDerived(MeasurementGroup::Harmonics);
     std::vector<HarmonicData> harmonics;
     for (int i = 0; i < 33; i++) {
         harmonics.push_back(m_measurements.voltageHarmonics[i]);
@@ -582,6 +1110,7 @@ std::vector<HarmonicData> MeteringEngine::getVoltageHarmonics() const
 
 std::vector<HarmonicData> MeteringEngine::getCurrentHarmonics() const
 {
+    refreshDerived(MeasurementGroup::Harmonics);
     std::vector<HarmonicData> harmonics;
     for (int i = 0; i < 33; i++) {
         harmonics.push_back(m_measurements.currentHarmonics[i]);
@@ -591,6 +1120,7 @@ std::vector<HarmonicData> MeteringEngine::getCurrentHarmonics() const
 
 std::vector<PhasorData> MeteringEngine::getVoltagePhasors() const
 {
+    refreshDerived(MeasurementGroup::Phasors);
     std::vector<PhasorData> phasors;
     for (int i = 0; i < 3; i++) {
         phasors.push_back(m_measurements.voltagePhasor[i]);
@@ -600,6 +1130,7 @@ std::vector<PhasorData> MeteringEngine::getVoltagePhasors() const
 
 std::vector<PhasorData> MeteringEngine::getCurrentPhasors() const
 {
+    refreshDerived(MeasurementGroup::Phasors);
     std::vector<PhasorData> phasors;
     for (int i = 0; i < 3; i++) {
         phasors.push_back(m_measurements.currentPhasor[i]);
@@ -5,6 +5,24 @@
 #include <string>
 #include <map>
 #include <chrono>
+#include <complex>
+#include <functional>
+#include <cstdint>
+#include "noise_generator.h"
+#include "demand_engine.h"
+#include "tou_engine.h"
+#include "injection_scheduler.h"
+#include "transient_generator.h"
+#include "current_transducer.h"
+#include "load_library.h"
+#include "harmonic_synthesizer.h"
+#include "harmonic_analyzer.h"
+#include "frequency_locked_resampler.h"
+#include "pulse_output.h"
+#include "power_quality.h"
+#include "power_accumulator.h"
+
+class RegisterJournal;
 
 struct PhasorData {
     double magnitude;
@@ -26,10 +44,15 @@ struct MeteringMeasurements {
     double reactivePower;
     double apparentPower;
     double powerFactor;
+    double fundamentalReactivePower;  // Q1 (IEEE 1459); reactivePower is Budeanu's
+    double nonactivePower;            // N = sqrt(S^2 - P^2) (Fryze, IEEE 1459)
+    double distortionPower;           // Budeanu D = sqrt(S^2 - P^2 - Q^2)
     double frequency;
     double energy;
     double voltage[3];  // Phase voltages for 3-phase
     double current[3];  // Phase currents for 3-phase
+    double neutralCurrent;            // measured in the neutral conductor
+    double calculatedNeutralCurrent;  // vector sum of the phase currents
     double thd_voltage;
     double thd_current;
     
@@ -47,12 +70,67 @@ struct MeteringMeasurements {
     double k_factor;               // K-factor for transformer derating
     double displacement_pf;        // Displacement power factor (fundamental)
     double distortion_pf;         // Distortion power factor
+    double tdd;                   // Total demand distortion, %
+};
+
+// Block of instantaneous samples produced by the signal generator.
+// Single-phase configurations only fill channel 0.
+struct SampleBlock {
+    double startTime;             // time of the first sample in seconds
+    double sampleRate;            // samples per second
+    int count;                    // valid samples in each channel
+    int phases;                   // 1 or 3
+    std::vector<double> voltage[3];
+    std::vector<double> current[3];
+    std::vector<double> neutral;  // neutral conductor current
+};
+
+using SampleBlockListener = std::function<void(const SampleBlock&)>;
+
+// Ideal fundamentals of the generated signals at an instant, for estimator self-evaluation
+struct SignalReference {
+    std::complex<double> voltage[3];  // RMS phasors against a cosine at the configured frequency
+    std::complex<double> current[3];  // configured fundamental with the phase loads; load mix and harmonics are not included
+    double frequency;
+    double rocof;
 };
 
+// Derived measurements that are computed on demand rather than on every update
+namespace MeasurementGroup {
+    enum : unsigned {
+        Harmonics = 1,  // harmonic spectra, THD, crest factor, K-factor, PF components, TDD
+        Phasors = 2,
+        All = 3
+    };
+}
+
+using MeasurementListener = std::function<void(const MeteringMeasurements&)>;
+
+// Register ids the engine keeps in a RegisterJournal
+namespace NVRegister {
+    enum : uint16_t {
+        TotalEnergy = 0x0001,       // Wh
+        DemandResets = 0x0002,
+        TariffEnergy = 0x0100,      // + tariff, Wh
+        BlockMaxDemand = 0x0200,    // + tariff, W; timestamp at + 0x80
+        SlidingMaxDemand = 0x0300   // + tariff, W; timestamp at + 0x80
+    };
+}
+
+// Event codes in the journal; tamper events add their tamperEventCode()
+namespace NVEvent {
+    enum : uint16_t {
+        Tamper = 0x0000,
+        PowerFail = 0x0100,
+        PowerUp = 0x0101
+    };
+}
+
 struct TamperEvent {
     std::string type;
     std::chrono::system_clock::time_point timestamp;
     bool active;
+    bool detected;  // raised by the engine's own checks; reports only, cleared when the condition ends
     std::map<std::string, double> parameters;
 };
 
@@ -66,11 +144,28 @@ public:
     void reset();
     void update(double deltaTime);
     
-    // Measurements
-    const MeteringMeasurements& getMeasurements() const { return m_measurements; }
+    // Measurements. Stale derived groups are computed on read and cached until new samples arrive;
+    // the basic view (RMS, power, energy, frequency) never triggers that work.
+    const MeteringMeasurements& getMeasurements() const;
+    const MeteringMeasurements& getBasicMeasurements() const { return m_measurements; }
+    unsigned getStaleGroups() const { return m_staleGroups; }
+    
+    // The listener receives the measurements with the subscribed groups fresh every interval
+    // seconds, or at the groups' natural boundary (analysis window, else mains cycle) when 0
+    int subscribeMeasurements(unsigned groups, MeasurementListener listener, double interval = 0.0);
+    void unsubscribeMeasurements(int id);
     std::vector<double> getVoltageWaveform() const;
     std::vector<double> getCurrentWaveform() const;
     
+    // Sample stream
+    int addSampleBlockListener(SampleBlockListener listener);
+    void removeSampleBlockListener(int id);
+    const SampleBlock& getLastSampleBlock() const { return m_sampleBlock; }
+    
+    // Reference for any instant within the last few hundred sample blocks
+    bool getSignalReference(double time, SignalReference& reference) const;
+    double getSampleRate() const { return SAMPLE_RATE; }
+    
     // Tamper events
     void injectTamperEvent(const std::string& type);
     void clearTamperEvent(const std::string& type);
@@ -82,31 +177,125 @@ public:
     void setFrequency(double frequency) { m_configFrequency = frequency; }
     void setPowerFactor(double pf) { m_configPowerFactor = pf; }
     void setPhaseConfiguration(bool threePhase) { m_isThreePhase = threePhase; }
+    bool isThreePhase() const { return m_isThreePhase; }
+    double getNominalFrequency() const { return m_configFrequency; }
     
-    // Signal injection
-    void injectVoltageDip(double magnitude, double duration);
-    void injectFrequencyVariation(double deviation, double duration);
+    // Signal injection; the returned id can be passed to cancelInjection()
+    int injectVoltageDip(double magnitude, double duration, unsigned phaseMask = InjectionPhase::ALL);
+    int injectVoltageSwell(double magnitude, double duration, unsigned phaseMask = InjectionPhase::ALL);
+    int injectVoltageRamp(double change, double rampTime, double duration, unsigned phaseMask = InjectionPhase::ALL);
+    int injectFrequencyVariation(double deviation, double duration, double rampTime = 0.0);
+    int injectPhaseJump(double degrees, double duration, unsigned phaseMask = InjectionPhase::ALL);
+    void cancelInjection(int id) { m_injectionScheduler.cancel(id); }
+    const InjectionScheduler& getInjectionScheduler() const { return m_injectionScheduler; }
+    
+    // Fast transients, rendered oversampled and decimated into the sample stream
+    void injectOscillatoryTransient(double amplitude, double frequency, double decay,
+                                    unsigned phaseMask = InjectionPhase::ALL);
+    void injectImpulse(double amplitude, double frontTime = 0.405e-6, double tailTime = 68.2e-6,
+                       unsigned phaseMask = InjectionPhase::ALL);
+    void injectInrush(double peakCurrent, double decay, unsigned phaseMask = InjectionPhase::ALL);
+    void setTransientOversampling(int factor) { m_transientGenerator.configure(SAMPLE_RATE, factor); }
+    TransientGenerator& getTransientGenerator() { return m_transientGenerator; }
+    // Sets the order on voltage and current of every phase; use setHarmonic for independent spectra
     void injectHarmonics(int harmonic, double magnitude, double phase = 0.0);
+    void setHarmonic(HarmonicChannel channel, int harmonic, double magnitude, double phase = 0.0,
+                     unsigned phaseMask = InjectionPhase::ALL);
+    void clearHarmonics() { m_harmonics.clear(); m_staleGroups |= MeasurementGroup::Harmonics; }
+    const HarmonicSynthesizer& getHarmonicSynthesizer() const { return m_harmonics; }
     void injectNoise(double amplitude);
+    void injectDCCurrent(double amps) { m_dcCurrent = amps; }
+    void setNoiseType(NoiseType type);
+    void setNoiseSeed(uint64_t seed);
     void injectInterharmonics(double frequency, double magnitude);
     
     // Harmonics and phasor analysis
-    void calculateHarmonics();
-    void calculatePhasors();
+    void calculateHarmonics() const;
+    
+    // IEC 61000-4-7 windowed analysis of the sample stream; when enabled it feeds the harmonic measurements
+    void setHarmonicAnalysisEnabled(bool enabled);
+    bool isHarmonicAnalysisEnabled() const { return m_harmonicAnalysisEnabled; }
+    HarmonicAnalyzer& getHarmonicAnalyzer() { return m_harmonicAnalyzer; }
+    const HarmonicAnalyzer& getHarmonicAnalyzer() const { return m_harmonicAnalyzer; }
+    const HarmonicSpectrum& getHarmonicSpectrum() const;
+    
+    // Feeds the analysis window and the phasors from a stream resampled to exactly
+    // SAMPLES_PER_CYCLE samples per measured cycle, so they stay coherent off nominal frequency
+    void setFrequencyLockedAnalysis(bool enabled);
+    bool isFrequencyLockedAnalysis() const { return m_frequencyLocked; }
+    FrequencyLockedResampler& getResampler() { return m_resampler; }
+    const FrequencyLockedResampler& getResampler() const { return m_resampler; }
+    
+    // Maximum demand load current for TDD; 0 uses the configured current
+    void setTDDLoadCurrent(double amps) { m_tddLoadCurrent = amps; m_staleGroups |= MeasurementGroup::Harmonics; }
+    void calculatePhasors() const;
     std::vector<HarmonicData> getVoltageHarmonics() const;
     std::vector<HarmonicData> getCurrentHarmonics() const;
     std::vector<PhasorData> getVoltagePhasors() const;
     std::vector<PhasorData> getCurrentPhasors() const;
     
+    // Per-phase RMS and power of the last complete cycle, measured from the samples
+    const PhasePower& getPhasePower(int phase) const { return m_powerAccumulator.getPhase(phase); }
+    
+    // Share of the configured current drawn on each phase in three-phase mode
+    void setPhaseLoad(int phase, double scale) { if (phase >= 0 && phase < 3) m_phaseLoad[phase] = scale; }
+    double getPhaseLoad(int phase) const { return m_phaseLoad[phase]; }
+    
+    // Neutral conductor (3P4W, or the return conductor in single phase). It carries
+    // returnFraction of the phase currents' return, the rest leaking to earth or
+    // bypassing the meter, plus an independent fundamental current. An injected
+    // "Neutral Missing" opens it: single-phase load current then returns through
+    // earth, while three-phase loads float as a star whose point shifts with their
+    // imbalance, moving the phase voltages. Its sensor is ideal, so a mismatch against the
+    // sum of the sensed phase currents, over fraction of the larger of the two and
+    // at least minimumAmps RMS, raises "Neutral Mismatch".
+    void setNeutralReturnFraction(double fraction) { m_neutralReturnFraction = fraction; }
+    void setNeutralCurrent(double amps, double phaseDegrees = 0.0);
+    void setNeutralMismatchThreshold(double fraction, double minimumAmps);
+    const NeutralCurrent& getNeutralCurrent() const { return m_powerAccumulator.getNeutral(); }
+    
+    // Current sensor model on the current channels
+    void setTransducerType(TransducerType type) { m_transducer.setType(type); }
+    CurrentTransducer& getTransducer() { return m_transducer; }
+    const CurrentTransducer& getTransducer() const { return m_transducer; }
+    
+    // Appliance loads, added to the configured current; set the current to 0 for a pure appliance mix
+    LoadMix& getLoadMix() { return m_loadMix; }
+    const LoadMix& getLoadMix() const { return m_loadMix; }
+    
+    // Calibration LED / S0 pulse output, driven by the energy of the sample stream
+    PulseOutput& getPulseOutput() { return m_pulseOutput; }
+    const PulseOutput& getPulseOutput() const { return m_pulseOutput; }
+    
     // Relay control
     void setRelayState(bool connected) { m_relayConnected = connected; }
     bool getRelayState() const { return m_relayConnected; }
+    
+    // Demand and maximum demand registers
+    DemandEngine& getDemandEngine() { return m_demandEngine; }
+    const DemandEngine& getDemandEngine() const { return m_demandEngine; }
+    
+    // Time-of-use tariff registers
+    TOUEngine& getTOUEngine() { return m_touEngine; }
+    const TOUEngine& getTOUEngine() const { return m_touEngine; }
+    double getSimulationTime() const { return m_simulationTime; }
+    
+    // Non-volatile persistence of the energy, tariff and demand registers. Registers are
+    // journaled while running once they move by energyResolution Wh (MD registers whenever
+    // replaced), so each update costs at most a few record appends. At power-up attach the
+    // journal, then call restoreRegisters() before the first update.
+    void attachJournal(RegisterJournal* journal, double energyResolution = 0.01);
+    void powerFail();            // hold-up write of every register, as on supply loss
+    bool restoreRegisters();     // power-up: registers as last journaled
+    static uint16_t tamperEventCode(const std::string& type);  // 0 for unknown types
 
 private:
     void calculateMeasurements();
     void updateWaveforms(double deltaTime);
     void processTamperEvents();
-    void generateSignals(double time);
+    void detectTamper(const std::string& type, bool condition);
+    void loadVoltages(const InjectionState& injection, std::complex<double> across[3]) const;
+    void generateSignals(double time, int sampleIndex);
     
     double calculateRMS(const std::vector<double>& samples);
     double calculateTHD(const std::vector<double>& samples);
@@ -119,7 +308,8 @@ private:
     double m_configPowerFactor;
     
     // Current measurements
-    MeteringMeasurements m_measurements;
+    mutable MeteringMeasurements m_measurements;  // derived groups are filled lazily
+    mutable unsigned m_staleGroups;
     
     // Waveform data
     std::vector<double> m_voltageWaveform;
@@ -130,37 +320,113 @@ private:
     // Simulation state
     double m_simulationTime;
     double m_phaseAngle;
+    uint64_t m_sampleCount;  // samples generated since reset
+    uint64_t m_sampleTarget; // samples due since reset
+    double m_sampleRemainder; // fraction of a sample due but not yet counted
     static constexpr int SAMPLES_PER_CYCLE = 256;
     static constexpr double SAMPLE_RATE = 12800.0; // 256 samples * 50Hz
     
+    // Sample stream
+    SampleBlock m_sampleBlock;
+    std::map<int, SampleBlockListener> m_sampleListeners;
+    int m_nextListenerId;
+    
+    // Signal state at the start of each recent block, for getSignalReference
+    struct ReferenceRecord {
+        double startTime;
+        double frequencyPhase;
+        double frequencyDeviation;
+        std::complex<double> across[3];  // fundamental across each load per unit, see loadVoltages()
+        double phaseOffset[3];
+        double load[3];                  // share of the configured current
+    };
+    static constexpr int REFERENCE_HISTORY = 512;
+    std::vector<ReferenceRecord> m_referenceHistory;
+    uint64_t m_referenceCount;
+    
+    // Measurement subscriptions
+    struct MeasurementSubscription {
+        unsigned groups;
+        MeasurementListener listener;
+        double interval;
+        double lastTime;
+        uint64_t lastBoundary;
+    };
+    std::map<int, MeasurementSubscription> m_subscriptions;
+    int m_nextSubscriptionId;
+    uint64_t boundaryCount(unsigned groups) const;
+    void refreshDerived(unsigned groups) const;
+    void notifySubscribers();
+    
     // Tamper events
     std::map<std::string, TamperEvent> m_tamperEvents;
     
     // Signal injection
-    struct SignalInjection {
-        bool active;
-        double startTime;
-        double duration;
-        double magnitude;
-        std::string type;
-    };
-    std::vector<SignalInjection> m_injections;
+    InjectionScheduler m_injectionScheduler;
+    double m_frequencyPhase;  // phase accumulated from frequency deviations (radians)
+    TransientGenerator m_transientGenerator;
     
     // Energy measurement
     double m_totalEnergy;
     double m_lastPowerSample;
+    double m_sampleEnergy;   // accumulator energy (J) booked so far
+    double m_energyScale;    // tamper effect on the registered energy
+    DemandEngine m_demandEngine;
+    TOUEngine m_touEngine;
+    
+    // Register persistence; the last journaled values decide when to write again
+    void journalRegisters(bool force);
+    RegisterJournal* m_journal;
+    double m_journalResolution;
+    double m_journaledEnergy;
+    std::vector<double> m_journaledTariffs;
+    std::vector<MaxDemandRegister> m_journaledBlockMD;
+    std::vector<MaxDemandRegister> m_journaledSlidingMD;
+    int m_journaledResets;
     
     // Relay state
     bool m_relayConnected;
     
-    // Harmonics with phase information
-    std::map<int, std::pair<double, double>> m_harmonics; // harmonic number -> (magnitude, phase)
+    // Per-phase voltage and current harmonic spectra
+    HarmonicSynthesizer m_harmonics;
+    HarmonicAnalyzer m_harmonicAnalyzer;
+    bool m_harmonicAnalysisEnabled;
+    FrequencyLockedResampler m_resampler;
+    SampleBlock m_lockedCycle;  // latest resampled cycle
+    bool m_frequencyLocked;
+    mutable HarmonicSpectrum m_harmonicSpectrum;  // phase A results; the measurement arrays are a view of it
+    double m_tddLoadCurrent;
     std::map<double, double> m_interharmonics; // frequency -> magnitude
     double m_noiseAmplitude;
+    double m_dcCurrent;
+    
+    // Neutral conductor
+    double m_phaseLoad[3];
+    double m_neutralReturnFraction;
+    double m_neutralCurrent;        // independent component, RMS
+    double m_neutralPhase;          // radians against phase A voltage
+    bool m_neutralOpen;
+    double m_neutralMismatchFraction;
+    double m_neutralMismatchMinimum;
+    
+    // RMS and power over each cycle of the sensed sample stream
+    PowerAccumulator m_powerAccumulator;
+    
+    // Current sensor
+    CurrentTransducer m_transducer;
+    static constexpr double MAGNET_CORE_FRACTION = 0.99;  // share of the CT knee flux taken by a tamper magnet
+    
+    // Appliance load signatures
+    LoadMix m_loadMix;
+    
+    // Metrology pulse output
+    PulseOutput m_pulseOutput;
+    
+    // Per-phase noise sources, filled one block ahead of signal generation
+    NoiseGenerator m_noiseGenerators[3];
+    std::vector<double> m_noiseBlock[3];
     
     // FFT and analysis
     void performFFT(const std::vector<double>& samples, std::vector<std::complex<double>>& fft_result);
-    void calculateCrestFactor();
-    void calculateKFactor();
-    void calculatePowerFactorComponents();
+    void calculatePowerQuality() const;
 };
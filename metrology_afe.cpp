@@ -0,0 +1,381 @@
+
+#include "metrology_afe.h"
+#include "metering_engine.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+constexpr int64_t MODULATOR_FULL_SCALE = 1 << 23;   // feedback level of the 1-bit DAC
+constexpr double CODES_PER_VOLT = 4194304.0;         // 1 V peak at the pin = 2^22 codes
+constexpr int64_t INPUT_LIMIT = (MODULATOR_FULL_SCALE * 3) / 4;
+constexpr int CODE_MAX = (1 << 23) - 1;
+constexpr int CODE_MIN = -(1 << 23);
+
+constexpr int HPF_SHIFT = 11;      // corner ~ fs / (2 pi 2^11) = 1 Hz at 12.8 kS/s
+constexpr int RMS_SHIFT = 12;      // ~0.3 s time constant
+constexpr int WATT_SHIFT = 12;
+constexpr int GAIN_SHIFT = 27;     // xGAIN: gain = 1 + reg / 2^27
+constexpr int POWER_SHIFT = 23;    // instantaneous power = v * i / 2^23
+
+inline int32_t saturate24(int64_t value)
+{
+    return static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(value, CODE_MIN), CODE_MAX));
+}
+
+}
+
+MetrologyAFE::MetrologyAFE()
+    : m_voltageScale(1.0 / 1001.0)  // 1 MOhm / 1 kOhm divider
+    , m_currentScale(0.00408)       // 2500:1 CT into 2 x 5.1 Ohm burden
+    , m_oversamplingRatio(64)
+    , m_decimationShift(18)
+{
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        m_analogGain[ch] = 1.0;
+        m_analogOffset[ch] = 0.0;
+        m_analogDelay[ch] = 0.0;
+    }
+    reset();
+}
+
+void MetrologyAFE::setAnalogTolerance(int lane, double gainError, double offsetVolts, double delaySeconds)
+{
+    if (lane >= 0 && lane < CHANNELS) {
+        m_analogGain[lane] = 1.0 + gainError;
+        m_analogOffset[lane] = offsetVolts;
+        m_analogDelay[lane] = delaySeconds;
+    }
+}
+
+double MetrologyAFE::codesPerUnit(int lane) const
+{
+    double scale = (lane >= CH_VA) ? m_voltageScale : m_currentScale;
+    return scale * pgaFactor(lane) * CODES_PER_VOLT;
+}
+
+void MetrologyAFE::reset()
+{
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        m_mod1[ch] = 0;
+        m_mod2[ch] = 0;
+        m_feedback[ch] = MODULATOR_FULL_SCALE;
+        for (int s = 0; s < 3; s++) {
+            m_cicInt[s][ch] = 0;
+            m_cicComb[s][ch] = 0;
+        }
+        m_hpfAcc[ch] = 0;
+        m_hpfPrev[ch] = 0;
+        m_prevCode[ch] = 0;
+        m_pcf[ch] = 0;
+        m_rmsAcc[ch] = 0;
+
+        m_previousAnalog[ch] = 0.0;
+        m_blockCodes[ch].clear();
+
+        m_gain[ch] = 0;
+        m_phaseCal[ch] = 0;
+        m_rmsOffset[ch] = 0;
+    }
+
+    for (int ph = 0; ph < 3; ph++) {
+        m_wattFiltered[ph] = 0;
+        m_energyAcc[ph] = 0;
+        m_wattHours[ph] = 0;
+        m_powerGain[ph] = 0;
+        m_wattOffset[ph] = 0;
+    }
+
+    m_config0 = 0;
+    m_wthr = 0x00400000;
+    m_pgaGain = 0;
+}
+
+void MetrologyAFE::setOversamplingRatio(int ratio)
+{
+    // Power of two between 16 and 256 keeps the sinc3 normalisation a pure shift
+    int shift = 0;
+    while ((1 << shift) < ratio) {
+        shift++;
+    }
+    shift = std::min(std::max(shift, 4), 8);
+
+    m_oversamplingRatio = 1 << shift;
+    m_decimationShift = 3 * shift;
+}
+
+int MetrologyAFE::connect(MeteringEngine& engine)
+{
+    return engine.addSampleBlockListener([this](const SampleBlock& block) {
+        processBlock(block);
+    });
+}
+
+void MetrologyAFE::processBlock(const SampleBlock& block)
+{
+    int32_t x[CHANNELS];
+    int32_t codes[CHANNELS];
+
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        m_blockCodes[ch].resize(block.count);
+    }
+
+    for (int i = 0; i < block.count; i++) {
+        quantizeInputs(block, i, block.sampleRate, x);
+        sigmaDelta(x, codes);
+
+        if (!(m_config0 & AFERegister::CONFIG0_HPFDIS)) {
+            highPassFilter(codes);
+        }
+
+        applyCalibration(codes);
+        accumulate(codes);
+
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            m_blockCodes[ch][i] = codes[ch];
+        }
+    }
+}
+
+void MetrologyAFE::quantizeInputs(const SampleBlock& block, int index, double sampleRate, int32_t* x)
+{
+    double analog[CHANNELS] = {};
+    for (int ph = 0; ph < block.phases; ph++) {
+        analog[CH_IA + ph] = block.current[ph][index] * m_currentScale;
+        analog[CH_VA + ph] = block.voltage[ph][index] * m_voltageScale;
+    }
+    if (block.neutral.size() >= static_cast<size_t>(block.count)) {
+        analog[CH_IN] = block.neutral[index] * m_currentScale;
+    }
+
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        // The RC delay is well below a sample period, so linear interpolation models it
+        double input = analog[ch];
+        double delayed = input + (m_previousAnalog[ch] - input) * m_analogDelay[ch] * sampleRate;
+        m_previousAnalog[ch] = input;
+        double pin = delayed * m_analogGain[ch] + m_analogOffset[ch];
+
+        int64_t code = std::llround(pin * pgaFactor(ch) * CODES_PER_VOLT);
+        x[ch] = static_cast<int32_t>(std::min(std::max(code, -INPUT_LIMIT), INPUT_LIMIT));
+    }
+}
+
+void MetrologyAFE::sigmaDelta(const int32_t* x, int32_t* out)
+{
+    // Second-order single-bit modulator running at R times the output rate,
+    // followed by a sinc3 (CIC) decimator. The CIC registers use unsigned
+    // wrap-around arithmetic, exactly as the hardware accumulators do.
+    for (int r = 0; r < m_oversamplingRatio; r++) {
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            m_mod1[ch] += x[ch] - m_feedback[ch];
+            m_mod2[ch] += m_mod1[ch] - 2 * m_feedback[ch];
+            m_feedback[ch] = (m_mod2[ch] >= 0) ? MODULATOR_FULL_SCALE : -MODULATOR_FULL_SCALE;
+
+            m_cicInt[0][ch] += static_cast<uint64_t>(m_feedback[ch]);
+            m_cicInt[1][ch] += m_cicInt[0][ch];
+            m_cicInt[2][ch] += m_cicInt[1][ch];
+        }
+    }
+
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        uint64_t d0 = m_cicInt[2][ch] - m_cicComb[0][ch];
+        m_cicComb[0][ch] = m_cicInt[2][ch];
+        uint64_t d1 = d0 - m_cicComb[1][ch];
+        m_cicComb[1][ch] = d0;
+        uint64_t d2 = d1 - m_cicComb[2][ch];
+        m_cicComb[2][ch] = d1;
+
+        out[ch] = saturate24(static_cast<int64_t>(d2) >> m_decimationShift);
+    }
+}
+
+void MetrologyAFE::highPassFilter(int32_t* x)
+{
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        int64_t diff = static_cast<int64_t>(x[ch]) - m_hpfPrev[ch];
+        m_hpfPrev[ch] = x[ch];
+        m_hpfAcc[ch] += (diff << 8) - (m_hpfAcc[ch] >> HPF_SHIFT);
+        x[ch] = saturate24(m_hpfAcc[ch] >> 8);
+    }
+}
+
+void MetrologyAFE::applyCalibration(int32_t* x)
+{
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        int64_t code = x[ch];
+
+        // Phase compensation as a fractional-sample delay: PHCAL / 2^27 of a sample
+        int64_t delayed = code + (((static_cast<int64_t>(m_prevCode[ch]) - code) * m_phaseCal[ch]) >> GAIN_SHIFT);
+        m_prevCode[ch] = x[ch];
+
+        int64_t gained = delayed + ((delayed * m_gain[ch]) >> GAIN_SHIFT);
+        x[ch] = saturate24(gained);
+        m_pcf[ch] = x[ch];
+    }
+}
+
+void MetrologyAFE::accumulate(const int32_t* x)
+{
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        uint64_t square = static_cast<uint64_t>(static_cast<int64_t>(x[ch]) * x[ch]);
+        m_rmsAcc[ch] += (square >> RMS_SHIFT) - (m_rmsAcc[ch] >> RMS_SHIFT);
+    }
+
+    const int64_t threshold = m_wthr;
+    for (int ph = 0; ph < 3; ph++) {
+        int64_t power = (static_cast<int64_t>(x[CH_IA + ph]) * x[CH_VA + ph]) >> POWER_SHIFT;
+        power += (power * m_powerGain[ph]) >> GAIN_SHIFT;
+        power += m_wattOffset[ph];
+
+        m_wattFiltered[ph] += (power - m_wattFiltered[ph]) >> WATT_SHIFT;
+
+        // Energy register increments every time the accumulator crosses WTHR
+        m_energyAcc[ph] += power;
+        int64_t counts = m_energyAcc[ph] / threshold;
+        m_wattHours[ph] += counts;
+        m_energyAcc[ph] -= counts * threshold;
+    }
+}
+
+double MetrologyAFE::pgaFactor(int lane) const
+{
+    // Two PGA bits per channel: 00 = x1, 01 = x2, 1x = x4
+    int bits = (m_pgaGain >> (2 * lane)) & 0x3;
+    return (bits == 0) ? 1.0 : (bits == 1 ? 2.0 : 4.0);
+}
+
+double MetrologyAFE::wattHourPerCount(double sampleRate) const
+{
+    // One watt at the phase A terminals produces this many power codes per sample
+    double codesPerWatt = (m_currentScale * pgaFactor(CH_IA) * CODES_PER_VOLT) *
+                          (m_voltageScale * pgaFactor(CH_VA) * CODES_PER_VOLT) / std::ldexp(1.0, POWER_SHIFT);
+
+    return static_cast<double>(m_wthr) / (codesPerWatt * sampleRate) / 3600.0;
+}
+
+uint64_t MetrologyAFE::isqrt(uint64_t value)
+{
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(value)));
+    while (root * root > value) root--;
+    while ((root + 1) * (root + 1) <= value) root++;
+    return root;
+}
+
+uint32_t MetrologyAFE::readRegister(uint16_t address) const
+{
+    // Per-phase calibration block
+    if (address < 0x060) {
+        int ph = address / AFERegister::PHASE_STRIDE;
+        switch (address % AFERegister::PHASE_STRIDE) {
+        case AFERegister::AIGAIN:  return static_cast<uint32_t>(m_gain[CH_IA + ph]);
+        case AFERegister::APHCAL0: return static_cast<uint32_t>(m_phaseCal[CH_IA + ph]);
+        case AFERegister::AVGAIN:  return static_cast<uint32_t>(m_gain[CH_VA + ph]);
+        case AFERegister::AIRMSOS: return static_cast<uint32_t>(m_rmsOffset[CH_IA + ph]);
+        case AFERegister::AVRMSOS: return static_cast<uint32_t>(m_rmsOffset[CH_VA + ph]);
+        case AFERegister::APGAIN:  return static_cast<uint32_t>(m_powerGain[ph]);
+        case AFERegister::AWATTOS: return static_cast<uint32_t>(m_wattOffset[ph]);
+        default: return 0;
+        }
+    }
+
+    // Per-phase results
+    if (address >= AFERegister::AI_PCF && address < AFERegister::AI_PCF + 3 * AFERegister::PHASE_STRIDE) {
+        int ph = (address - AFERegister::AI_PCF) / AFERegister::PHASE_STRIDE;
+        uint16_t offset = address - ph * AFERegister::PHASE_STRIDE;
+        switch (offset) {
+        case AFERegister::AI_PCF: return static_cast<uint32_t>(m_pcf[CH_IA + ph]);
+        case AFERegister::AV_PCF: return static_cast<uint32_t>(m_pcf[CH_VA + ph]);
+        case AFERegister::AIRMS:
+            return static_cast<uint32_t>(isqrt(m_rmsAcc[CH_IA + ph]) + m_rmsOffset[CH_IA + ph]);
+        case AFERegister::AVRMS:
+            return static_cast<uint32_t>(isqrt(m_rmsAcc[CH_VA + ph]) + m_rmsOffset[CH_VA + ph]);
+        case AFERegister::AWATT: return static_cast<uint32_t>(m_wattFiltered[ph]);
+        default: break;
+        }
+    }
+
+    // Energy registers
+    for (int ph = 0; ph < 3; ph++) {
+        uint16_t base = AFERegister::AWATTHR_LO + ph * AFERegister::ENERGY_STRIDE;
+        if (address == base) {
+            return static_cast<uint32_t>(static_cast<uint64_t>(m_wattHours[ph]) & 0xFFFFFFFFu);
+        }
+        if (address == base + 1) {
+            return static_cast<uint32_t>(static_cast<uint64_t>(m_wattHours[ph]) >> 32);
+        }
+    }
+
+    switch (address) {
+    case AFERegister::NIGAIN:   return static_cast<uint32_t>(m_gain[CH_IN]);
+    case AFERegister::NIRMSOS:  return static_cast<uint32_t>(m_rmsOffset[CH_IN]);
+    case AFERegister::NI_PCF:   return static_cast<uint32_t>(m_pcf[CH_IN]);
+    case AFERegister::NIRMS:    return static_cast<uint32_t>(isqrt(m_rmsAcc[CH_IN]) + m_rmsOffset[CH_IN]);
+    case AFERegister::CONFIG0:  return m_config0;
+    case AFERegister::WTHR:     return m_wthr;
+    case AFERegister::PGA_GAIN: return m_pgaGain;
+    case AFERegister::VERSION:  return 0x000000FE;
+    default: return 0;
+    }
+}
+
+void MetrologyAFE::writeRegister(uint16_t address, uint32_t value)
+{
+    int32_t signedValue = static_cast<int32_t>(value);
+
+    if (address < 0x060) {
+        int ph = address / AFERegister::PHASE_STRIDE;
+        switch (address % AFERegister::PHASE_STRIDE) {
+        case AFERegister::AIGAIN:  m_gain[CH_IA + ph] = signedValue; break;
+        case AFERegister::APHCAL0: m_phaseCal[CH_IA + ph] = signedValue; break;
+        case AFERegister::AVGAIN:  m_gain[CH_VA + ph] = signedValue; break;
+        case AFERegister::AIRMSOS: m_rmsOffset[CH_IA + ph] = signedValue; break;
+        case AFERegister::AVRMSOS: m_rmsOffset[CH_VA + ph] = signedValue; break;
+        case AFERegister::APGAIN:  m_powerGain[ph] = signedValue; break;
+        case AFERegister::AWATTOS: m_wattOffset[ph] = signedValue; break;
+        default: break;
+        }
+        return;
+    }
+
+    // Energy registers are read-to-clear style: any write resets the phase's count
+    for (int ph = 0; ph < 3; ph++) {
+        uint16_t base = AFERegister::AWATTHR_LO + ph * AFERegister::ENERGY_STRIDE;
+        if (address == base || address == base + 1) {
+            m_wattHours[ph] = 0;
+            m_energyAcc[ph] = 0;
+            return;
+        }
+    }
+
+    switch (address) {
+    case AFERegister::NIGAIN:   m_gain[CH_IN] = signedValue; break;
+    case AFERegister::NIRMSOS:  m_rmsOffset[CH_IN] = signedValue; break;
+    case AFERegister::CONFIG0:  m_config0 = value; break;
+    case AFERegister::WTHR:     m_wthr = std::max<uint32_t>(value, 1); break;
+    case AFERegister::PGA_GAIN: m_pgaGain = value; break;
+    default: break;
+    }
+}
+
+std::vector<uint8_t> MetrologyAFE::spiTransfer(const std::vector<uint8_t>& tx)
+{
+    std::vector<uint8_t> rx(tx.size(), 0x00);
+    if (tx.size() < 2) return rx;
+
+    uint16_t header = static_cast<uint16_t>((tx[0] << 8) | tx[1]);
+    uint16_t address = header >> 4;
+    bool read = (header & 0x0008) != 0;
+
+    if (read) {
+        uint32_t value = readRegister(address);
+        for (size_t i = 0; i < 4 && i + 2 < rx.size(); i++) {
+            rx[i + 2] = static_cast<uint8_t>(value >> (24 - 8 * i));
+        }
+    } else if (tx.size() >= 6) {
+        uint32_t value = (static_cast<uint32_t>(tx[2]) << 24) | (static_cast<uint32_t>(tx[3]) << 16) |
+                         (static_cast<uint32_t>(tx[4]) << 8) | tx[5];
+        writeRegister(address, value);
+    }
+
+    return rx;
+}
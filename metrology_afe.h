@@ -0,0 +1,151 @@
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class MeteringEngine;
+struct SampleBlock;
+
+// Register addresses, following the ADE9000 layout for the registers modelled
+namespace AFERegister {
+    // Calibration (per phase: A = base, B = base + 0x20, C = base + 0x40)
+    constexpr uint16_t AIGAIN   = 0x000;
+    constexpr uint16_t APHCAL0  = 0x006;
+    constexpr uint16_t AVGAIN   = 0x00B;
+    constexpr uint16_t AIRMSOS  = 0x00C;
+    constexpr uint16_t AVRMSOS  = 0x00D;
+    constexpr uint16_t APGAIN   = 0x00E;
+    constexpr uint16_t AWATTOS  = 0x00F;
+    constexpr uint16_t NIGAIN   = 0x060;
+    constexpr uint16_t NIRMSOS  = 0x06C;
+    constexpr uint16_t PHASE_STRIDE = 0x020;
+
+    // Instantaneous and filtered results (per phase stride 0x20)
+    constexpr uint16_t AI_PCF   = 0x20A;
+    constexpr uint16_t AV_PCF   = 0x20B;
+    constexpr uint16_t AIRMS    = 0x20C;
+    constexpr uint16_t AVRMS    = 0x20D;
+    constexpr uint16_t AWATT    = 0x210;
+    constexpr uint16_t NI_PCF   = 0x265;
+    constexpr uint16_t NIRMS    = 0x266;
+
+    // Energy registers (per phase stride 0x3C)
+    constexpr uint16_t AWATTHR_LO = 0x2E6;
+    constexpr uint16_t AWATTHR_HI = 0x2E7;
+    constexpr uint16_t ENERGY_STRIDE = 0x03C;
+
+    // Configuration
+    constexpr uint16_t CONFIG0  = 0x420;
+    constexpr uint16_t WTHR     = 0x42C;
+    constexpr uint16_t PGA_GAIN = 0x4B9;
+    constexpr uint16_t VERSION  = 0x4FE;
+
+    constexpr uint32_t CONFIG0_HPFDIS = 1u << 3;
+}
+
+// Metrology front end in the style of the ADE9000. Consumes the analog
+// sample stream of a MeteringEngine and runs a fixed-point pipeline per
+// channel: second-order sigma-delta modulator with sinc3 decimation to
+// 24-bit codes, DC-removal HPF, gain/phase calibration, RMS filters and
+// active energy accumulation. Results are exposed as a register map that
+// firmware models can read directly or through SPI frames.
+class MetrologyAFE
+{
+public:
+    // Channel lanes: currents A, B, C, N then voltages A, B, C; the eighth lane is padding
+    static constexpr int CHANNELS = 8;
+    static constexpr int CH_IA = 0;
+    static constexpr int CH_IN = 3;
+    static constexpr int CH_VA = 4;
+
+    MetrologyAFE();
+
+    void reset();
+
+    // Analog scaling from line quantities to ADC input volts
+    void setVoltageScale(double voltsPerVolt) { m_voltageScale = voltsPerVolt; }
+    void setCurrentScale(double voltsPerAmp) { m_currentScale = voltsPerAmp; }
+    void setOversamplingRatio(int ratio);
+    int getOversamplingRatio() const { return m_oversamplingRatio; }
+    
+    // Component tolerances ahead of the modulator: gain error, offset at the pin
+    // and the anti-alias RC delay. These are what calibration has to remove.
+    void setAnalogTolerance(int lane, double gainError, double offsetVolts, double delaySeconds);
+    
+    // Nominal decimated code per line volt (voltage lanes) or amp (current lanes)
+    double codesPerUnit(int lane) const;
+
+    // Register interface
+    uint32_t readRegister(uint16_t address) const;
+    void writeRegister(uint16_t address, uint32_t value);
+
+    // ADE9000 SPI framing: 16-bit command header (address << 4, bit 3 = read) + 32-bit data
+    std::vector<uint8_t> spiTransfer(const std::vector<uint8_t>& tx);
+
+    // Sample stream input
+    void processBlock(const SampleBlock& block);
+    int connect(MeteringEngine& engine);
+
+    // Wh represented by one count of the xWATTHR registers at the current settings
+    double wattHourPerCount(double sampleRate) const;
+
+    // Most recent decimated 24-bit code per lane
+    int32_t getCode(int lane) const { return m_pcf[lane]; }
+    
+    // Calibrated codes of every sample of the last processed block
+    const std::vector<int32_t>& getBlockCodes(int lane) const { return m_blockCodes[lane]; }
+
+private:
+    void quantizeInputs(const SampleBlock& block, int index, double sampleRate, int32_t* x);
+    void sigmaDelta(const int32_t* x, int32_t* out);
+    void highPassFilter(int32_t* x);
+    void applyCalibration(int32_t* x);
+    void accumulate(const int32_t* x);
+
+    double pgaFactor(int lane) const;
+    static uint64_t isqrt(uint64_t value);
+
+    double m_voltageScale;
+    double m_currentScale;
+    int m_oversamplingRatio;
+    int m_decimationShift;
+
+    // Analog front-end tolerances and the previous input for the RC delay
+    double m_analogGain[CHANNELS];
+    double m_analogOffset[CHANNELS];
+    double m_analogDelay[CHANNELS];
+    double m_previousAnalog[CHANNELS];
+    
+    // Sigma-delta modulator integrators and sinc3 decimator state (wrap-around arithmetic)
+    int64_t m_mod1[CHANNELS];
+    int64_t m_mod2[CHANNELS];
+    int64_t m_feedback[CHANNELS];
+    uint64_t m_cicInt[3][CHANNELS];
+    uint64_t m_cicComb[3][CHANNELS];
+
+    // HPF state (8 extra fractional bits)
+    int64_t m_hpfAcc[CHANNELS];
+    int32_t m_hpfPrev[CHANNELS];
+
+    // Phase compensation delay line
+    int32_t m_prevCode[CHANNELS];
+
+    // Filtered outputs
+    int32_t m_pcf[CHANNELS];
+    std::vector<int32_t> m_blockCodes[CHANNELS];
+    uint64_t m_rmsAcc[CHANNELS];
+    int64_t m_wattFiltered[3];
+    int64_t m_energyAcc[3];
+    int64_t m_wattHours[3];
+
+    // Calibration registers
+    int32_t m_gain[CHANNELS];
+    int32_t m_phaseCal[CHANNELS];
+    int32_t m_rmsOffset[CHANNELS];
+    int32_t m_powerGain[3];
+    int32_t m_wattOffset[3];
+    uint32_t m_config0;
+    uint32_t m_wthr;
+    uint32_t m_pgaGain;
+};
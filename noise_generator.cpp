@@ -0,0 +1,160 @@
+
+#include "noise_generator.h"
+#include <cmath>
+#include <algorithm>
+#include <random>
+
+namespace {
+
+inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+inline uint64_t splitMix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+constexpr size_t CHUNK_SIZE = 64;
+
+}
+
+NoiseGenerator::NoiseGenerator()
+    : NoiseGenerator((static_cast<uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}())
+{
+}
+
+NoiseGenerator::NoiseGenerator(uint64_t seed)
+    : m_type(NoiseType::White)
+    , m_sampleRate(12800.0)
+    , m_humFrequency(50.0)
+    , m_humPhase(0.0)
+{
+    this->seed(seed);
+}
+
+void NoiseGenerator::seed(uint64_t seed)
+{
+    // Expand the seed with SplitMix64 as recommended for xoshiro generators
+    for (auto& word : m_state) {
+        word = splitMix64(seed);
+    }
+
+    for (auto& b : m_pink) {
+        b = 0.0;
+    }
+    m_humPhase = 0.0;
+}
+
+uint64_t NoiseGenerator::nextUInt64()
+{
+    const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+    const uint64_t t = m_state[1] << 17;
+
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 45);
+
+    return result;
+}
+
+double NoiseGenerator::nextUniform()
+{
+    // 53 random bits mapped to (0, 1] so the log in Box-Muller never sees zero
+    return ((nextUInt64() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+void NoiseGenerator::fill(double* out, size_t count)
+{
+    switch (m_type) {
+    case NoiseType::White:
+        fillGaussian(out, count);
+        break;
+    case NoiseType::Pink:
+        fillGaussian(out, count);
+        applyPinkFilter(out, count);
+        break;
+    case NoiseType::MainsHum:
+        fillGaussian(out, count);
+        addMainsHum(out, count);
+        break;
+    }
+}
+
+void NoiseGenerator::fillGaussian(double* out, size_t count)
+{
+    // Box-Muller in chunks: draw all uniforms first, then transform them in a
+    // dependency-free loop the compiler can vectorize
+    double u1[CHUNK_SIZE / 2];
+    double u2[CHUNK_SIZE / 2];
+
+    while (count > 0) {
+        size_t n = std::min(count, CHUNK_SIZE);
+        size_t pairs = (n + 1) / 2;
+
+        for (size_t i = 0; i < pairs; i++) {
+            u1[i] = nextUniform();
+            u2[i] = nextUniform();
+        }
+
+        double radius[CHUNK_SIZE / 2];
+        double angle[CHUNK_SIZE / 2];
+        for (size_t i = 0; i < pairs; i++) {
+            radius[i] = std::sqrt(-2.0 * std::log(u1[i]));
+            angle[i] = 2.0 * M_PI * u2[i];
+        }
+
+        for (size_t i = 0; i < n / 2; i++) {
+            out[2 * i] = radius[i] * std::cos(angle[i]);
+            out[2 * i + 1] = radius[i] * std::sin(angle[i]);
+        }
+        if (n & 1) {
+            out[n - 1] = radius[pairs - 1] * std::cos(angle[pairs - 1]);
+        }
+
+        out += n;
+        count -= n;
+    }
+}
+
+void NoiseGenerator::applyPinkFilter(double* samples, size_t count)
+{
+    // -3 dB/octave approximation, scaled back to roughly unit RMS
+    double* b = m_pink;
+    for (size_t i = 0; i < count; i++) {
+        double white = samples[i];
+        b[0] = 0.99886 * b[0] + white * 0.0555179;
+        b[1] = 0.99332 * b[1] + white * 0.0750759;
+        b[2] = 0.96900 * b[2] + white * 0.1538520;
+        b[3] = 0.86650 * b[3] + white * 0.3104856;
+        b[4] = 0.55000 * b[4] + white * 0.5329522;
+        b[5] = -0.7616 * b[5] - white * 0.0168980;
+        double pink = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362;
+        b[6] = white * 0.115926;
+        samples[i] = pink * 0.327;
+    }
+}
+
+void NoiseGenerator::addMainsHum(double* samples, size_t count)
+{
+    // Hum at the mains fundamental and its third harmonic over a small broadband floor;
+    // the weights keep the total at unit RMS
+    const double humWeight = 0.95;
+    const double floorWeight = std::sqrt(1.0 - humWeight * humWeight);
+    const double step = 2.0 * M_PI * m_humFrequency / m_sampleRate;
+
+    for (size_t i = 0; i < count; i++) {
+        double phase = m_humPhase + step * i;
+        double hum = std::sqrt(2.0) * (0.8 * std::sin(phase) + 0.6 * std::sin(3.0 * phase));
+        samples[i] = humWeight * hum + floorWeight * samples[i];
+    }
+
+    m_humPhase = std::fmod(m_humPhase + step * count, 2.0 * M_PI);
+}
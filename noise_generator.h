@@ -0,0 +1,50 @@
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+enum class NoiseType {
+    White,
+    Pink,
+    MainsHum
+};
+
+// Block-oriented Gaussian noise source with a xoshiro256** core.
+// Each MeteringEngine owns its own instances, so no state is shared between engines.
+class NoiseGenerator
+{
+public:
+    NoiseGenerator();
+    explicit NoiseGenerator(uint64_t seed);
+
+    void seed(uint64_t seed);
+    void setType(NoiseType type) { m_type = type; }
+    NoiseType getType() const { return m_type; }
+
+    // Hum profile: fundamental of the interfering mains and the sample rate it is rendered at
+    void setHumFrequency(double frequency) { m_humFrequency = frequency; }
+    void setSampleRate(double sampleRate) { m_sampleRate = sampleRate; }
+
+    // Fills count samples of unit-RMS noise of the configured type
+    void fill(double* out, size_t count);
+
+    uint64_t nextUInt64();
+    double nextUniform(); // (0, 1]
+
+private:
+    void fillGaussian(double* out, size_t count);
+    void applyPinkFilter(double* samples, size_t count);
+    void addMainsHum(double* samples, size_t count);
+
+    // xoshiro256** state
+    uint64_t m_state[4];
+
+    NoiseType m_type;
+    double m_sampleRate;
+    double m_humFrequency;
+    double m_humPhase;
+
+    // Pink filter state (Paul Kellett's refined filter)
+    double m_pink[7];
+};
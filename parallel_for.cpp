@@ -0,0 +1,32 @@
+#include "parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void parallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t)>& body)
+{
+    if (count == 0) return;
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = static_cast<unsigned int>(std::min<size_t>(threadCount, count));
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
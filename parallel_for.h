@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Runs body(0) .. body(count - 1) on a pool of threadCount workers (0 = hardware
+// concurrency, never more than count), the calling thread being one of them.
+// Workers pull the next index from a shared counter, so uneven jobs balance
+// themselves; body must only touch state owned by its index. Returns once every
+// index is done.
+void parallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t)>& body);
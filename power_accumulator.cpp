@@ -0,0 +1,232 @@
+
+#include "power_accumulator.h"
+#include "metering_engine.h"
+#include "fft_plan.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+struct SegmentSums {
+    double vv[3];
+    double ii[3];
+    double vi[3];
+    double nn;  // measured neutral squared
+    double cc;  // calculated neutral (sum of the phase currents) squared
+    double dd;  // their difference squared
+};
+
+// Sums of v^2, i^2 and v*i of every phase, and of the neutral quantities, over a
+// segment in one pass of four independent lanes
+template <int PHASES>
+void accumulateSegment(const double* const* v, const double* const* i, const double* n, int count, SegmentSums& sums)
+{
+    double sumVV[PHASES][4] = {};
+    double sumII[PHASES][4] = {};
+    double sumVI[PHASES][4] = {};
+    double sumNN[4] = {0.0, 0.0, 0.0, 0.0};
+    double sumCC[4] = {0.0, 0.0, 0.0, 0.0};
+    double sumDD[4] = {0.0, 0.0, 0.0, 0.0};
+
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            double calculated = 0.0;
+            for (int ph = 0; ph < PHASES; ph++) {
+                const double x = v[ph][k + lane];
+                const double y = i[ph][k + lane];
+                sumVV[ph][lane] += x * x;
+                sumII[ph][lane] += y * y;
+                sumVI[ph][lane] += x * y;
+                calculated += y;
+            }
+            const double measured = n[k + lane];
+            const double difference = measured - calculated;
+            sumNN[lane] += measured * measured;
+            sumCC[lane] += calculated * calculated;
+            sumDD[lane] += difference * difference;
+        }
+    }
+    for (; k < count; k++) {
+        double calculated = 0.0;
+        for (int ph = 0; ph < PHASES; ph++) {
+            sumVV[ph][0] += v[ph][k] * v[ph][k];
+            sumII[ph][0] += i[ph][k] * i[ph][k];
+            sumVI[ph][0] += v[ph][k] * i[ph][k];
+            calculated += i[ph][k];
+        }
+        const double difference = n[k] - calculated;
+        sumNN[0] += n[k] * n[k];
+        sumCC[0] += calculated * calculated;
+        sumDD[0] += difference * difference;
+    }
+
+    for (int ph = 0; ph < PHASES; ph++) {
+        sums.vv[ph] = (sumVV[ph][0] + sumVV[ph][1]) + (sumVV[ph][2] + sumVV[ph][3]);
+        sums.ii[ph] = (sumII[ph][0] + sumII[ph][1]) + (sumII[ph][2] + sumII[ph][3]);
+        sums.vi[ph] = (sumVI[ph][0] + sumVI[ph][1]) + (sumVI[ph][2] + sumVI[ph][3]);
+    }
+    sums.nn = (sumNN[0] + sumNN[1]) + (sumNN[2] + sumNN[3]);
+    sums.cc = (sumCC[0] + sumCC[1]) + (sumCC[2] + sumCC[3]);
+    sums.dd = (sumDD[0] + sumDD[1]) + (sumDD[2] + sumDD[3]);
+}
+
+}
+
+PowerAccumulator::PowerAccumulator()
+    : m_cycleLength(0)
+    , m_filled(0)
+    , m_phases(1)
+    , m_cycles(0)
+    , m_energy(0.0)
+    , m_sumNN(0.0)
+    , m_sumCC(0.0)
+    , m_sumDD(0.0)
+    , m_neutral{}
+{
+    configure(256);
+}
+
+void PowerAccumulator::configure(int cycleLength)
+{
+    m_cycleLength = std::max(cycleLength, 8);
+    for (int ph = 0; ph < 3; ph++) {
+        m_voltage[ph].assign(m_cycleLength, 0.0);
+        m_current[ph].assign(m_cycleLength, 0.0);
+    }
+    m_noNeutral.assign(m_cycleLength, 0.0);
+    m_plan = FFTPlan::get(m_cycleLength);
+    m_spectrumV.assign(m_cycleLength / 2 + 1, 0.0);
+    m_spectrumI.assign(m_cycleLength / 2 + 1, 0.0);
+    m_scratch.assign(m_plan->realPairScratchSize(), 0.0);
+    reset();
+}
+
+void PowerAccumulator::reset()
+{
+    m_filled = 0;
+    m_cycles = 0;
+    m_energy = 0.0;
+    for (int ph = 0; ph < 3; ph++) {
+        m_sumVV[ph] = m_sumII[ph] = m_sumVI[ph] = 0.0;
+        m_result[ph] = {};
+    }
+    m_sumNN = m_sumCC = m_sumDD = 0.0;
+    m_neutral = {};
+}
+
+int PowerAccumulator::process(const SampleBlock& block)
+{
+    // A change of configuration restarts the cycle being filled
+    if (block.phases != m_phases) {
+        m_phases = block.phases;
+        m_filled = 0;
+        for (int ph = 0; ph < 3; ph++) {
+            m_sumVV[ph] = m_sumII[ph] = m_sumVI[ph] = 0.0;
+            m_result[ph] = {};
+        }
+        m_sumNN = m_sumCC = m_sumDD = 0.0;
+        m_neutral = {};
+    }
+    const bool hasNeutral = block.neutral.size() >= static_cast<size_t>(block.count);
+
+    int completed = 0;
+    int offset = 0;
+    double blockVI = 0.0;
+    while (offset < block.count) {
+        const int take = std::min(block.count - offset, m_cycleLength - m_filled);
+        const double* v[3];
+        const double* i[3];
+        for (int ph = 0; ph < m_phases; ph++) {
+            v[ph] = block.voltage[ph].data() + offset;
+            i[ph] = block.current[ph].data() + offset;
+            std::memcpy(m_voltage[ph].data() + m_filled, v[ph], take * sizeof(double));
+            std::memcpy(m_current[ph].data() + m_filled, i[ph], take * sizeof(double));
+        }
+        const double* n = hasNeutral ? block.neutral.data() + offset : m_noNeutral.data();
+
+        SegmentSums sums;
+        if (m_phases == 3) {
+            accumulateSegment<3>(v, i, n, take, sums);
+        } else {
+            accumulateSegment<1>(v, i, n, take, sums);
+        }
+        for (int ph = 0; ph < m_phases; ph++) {
+            m_sumVV[ph] += sums.vv[ph];
+            m_sumII[ph] += sums.ii[ph];
+            m_sumVI[ph] += sums.vi[ph];
+            blockVI += sums.vi[ph];
+        }
+        m_sumNN += sums.nn;
+        m_sumCC += sums.cc;
+        m_sumDD += sums.dd;
+        m_filled += take;
+        offset += take;
+
+        if (m_filled == m_cycleLength) {
+            closeCycle();
+            completed++;
+        }
+    }
+    m_energy += blockVI / block.sampleRate;
+    return completed;
+}
+
+void PowerAccumulator::closeCycle()
+{
+    const double n = m_cycleLength;
+    const int bins = m_cycleLength / 2 + 1;
+    // |X_h| * sqrt(2) / N is the RMS of harmonic h, so products of two RMS phasors scale by 2 / N^2
+    const double phasorScale = std::sqrt(2.0) / n;
+    const double productScale = 2.0 / (n * n);
+
+    for (int ph = 0; ph < m_phases; ph++) {
+        PhasePower& r = m_result[ph];
+        r.voltageRMS = std::sqrt(m_sumVV[ph] / n);
+        r.currentRMS = std::sqrt(m_sumII[ph] / n);
+        r.activePower = m_sumVI[ph] / n;
+        r.apparentPower = r.voltageRMS * r.currentRMS;
+
+        m_plan->forwardRealPair(m_voltage[ph].data(), m_current[ph].data(),
+                                m_spectrumV.data(), m_spectrumI.data(), m_scratch);
+
+        // Budeanu: reactive power of every harmonic, DC and Nyquist carry none
+        double q[4] = {0.0, 0.0, 0.0, 0.0};
+        int h = 1;
+        for (; h + 4 <= bins; h += 4) {
+            for (int lane = 0; lane < 4; lane++) {
+                const std::complex<double>& x = m_spectrumV[h + lane];
+                const std::complex<double>& y = m_spectrumI[h + lane];
+                q[lane] += x.imag() * y.real() - x.real() * y.imag();
+            }
+        }
+        for (; h < bins; h++) {
+            q[0] += m_spectrumV[h].imag() * m_spectrumI[h].real() - m_spectrumV[h].real() * m_spectrumI[h].imag();
+        }
+        r.reactivePower = ((q[0] + q[1]) + (q[2] + q[3])) * productScale;
+
+        r.voltagePhasor = m_spectrumV[1] * phasorScale;
+        r.currentPhasor = m_spectrumI[1] * phasorScale;
+        std::complex<double> s1 = r.voltagePhasor * std::conj(r.currentPhasor);
+        r.fundamentalActive = s1.real();
+        r.fundamentalReactive = s1.imag();
+        r.fundamentalApparent = std::abs(s1);
+
+        const double s2 = r.apparentPower * r.apparentPower;
+        const double p2 = r.activePower * r.activePower;
+        r.nonactivePower = std::sqrt(std::max(s2 - p2, 0.0));
+        r.distortionPower = std::sqrt(std::max(s2 - p2 - r.reactivePower * r.reactivePower, 0.0));
+        r.harmonicApparent = std::sqrt(std::max(s2 - r.fundamentalApparent * r.fundamentalApparent, 0.0));
+
+        m_sumVV[ph] = m_sumII[ph] = m_sumVI[ph] = 0.0;
+    }
+
+    m_neutral.measuredRMS = std::sqrt(m_sumNN / n);
+    m_neutral.calculatedRMS = std::sqrt(m_sumCC / n);
+    m_neutral.mismatchRMS = std::sqrt(m_sumDD / n);
+    m_sumNN = m_sumCC = m_sumDD = 0.0;
+
+    m_filled = 0;
+    m_cycles++;
+}
@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <cstdint>
+
+class FFTPlan;
+struct SampleBlock;
+
+// Per-phase power quantities over one measurement cycle
+struct PhasePower {
+    double voltageRMS;
+    double currentRMS;
+    double activePower;           // P, mean of v * i
+    double apparentPower;         // S = V * I
+    double reactivePower;         // Budeanu Q_B = sum over h of V_h I_h sin(theta_h)
+    double distortionPower;       // Budeanu D_B = sqrt(S^2 - P^2 - Q_B^2)
+    double nonactivePower;        // Fryze / IEEE 1459 N = sqrt(S^2 - P^2)
+    double fundamentalActive;     // P1
+    double fundamentalReactive;   // Q1
+    double fundamentalApparent;   // S1
+    double harmonicApparent;      // S_N = sqrt(S^2 - S1^2)
+    std::complex<double> voltagePhasor;  // fundamental, RMS
+    std::complex<double> currentPhasor;
+};
+
+// Neutral conductor current over one measurement cycle. The calculated neutral is
+// the sum of the phase currents (the phase current itself in single phase); the
+// mismatch is the RMS of measured minus calculated, so it also sees phase errors.
+struct NeutralCurrent {
+    double measuredRMS;
+    double calculatedRMS;
+    double mismatchRMS;
+};
+
+// Measures RMS and power from the sample stream over consecutive windows of
+// one nominal cycle. Blocks of any length are split at cycle boundaries;
+// sums of v^2, i^2 and v*i run over each segment as blocks arrive, in
+// four-lane partial sums without branches, and the cycle's samples are kept
+// for one real-pair FFT per phase when it closes, which yields the
+// fundamental (IEEE 1459) and the per-harmonic Budeanu reactive power.
+// The neutral channel and the vector sum of the phase currents are summed in
+// the same pass; blocks without a neutral channel read as an open neutral.
+class PowerAccumulator
+{
+public:
+    PowerAccumulator();
+
+    // Window length in samples, normally sample rate / nominal frequency
+    void configure(int cycleLength);
+    void reset();
+
+    // Returns the number of cycles completed by this block
+    int process(const SampleBlock& block);
+
+    // Latest completed cycle; zero before the first
+    const PhasePower& getPhase(int ph) const { return m_result[ph]; }
+    const NeutralCurrent& getNeutral() const { return m_neutral; }
+    int getPhases() const { return m_phases; }
+    int getCycleLength() const { return m_cycleLength; }
+    uint64_t getCycleCount() const { return m_cycles; }
+
+    // Active energy of every sample since reset, all phases, in joules
+    double getEnergy() const { return m_energy; }
+
+private:
+    void closeCycle();
+
+    int m_cycleLength;
+    int m_filled;
+    int m_phases;
+
+    std::vector<double> m_voltage[3];  // samples of the cycle being filled
+    std::vector<double> m_current[3];
+    double m_sumVV[3];
+    double m_sumII[3];
+    double m_sumVI[3];
+    std::vector<double> m_noNeutral;  // zeros standing in for a missing neutral channel
+
+    std::shared_ptr<const FFTPlan> m_plan;
+    std::vector<std::complex<double>> m_spectrumV;
+    std::vector<std::complex<double>> m_spectrumI;
+    std::vector<std::complex<double>> m_scratch;
+
+    PhasePower m_result[3];
+    uint64_t m_cycles;
+    double m_energy;
+
+    double m_sumNN;
+    double m_sumCC;
+    double m_sumDD;
+    NeutralCurrent m_neutral;
+};
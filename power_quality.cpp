@@ -0,0 +1,66 @@
+
+#include "power_quality.h"
+#include <cmath>
+
+PowerQualityIndices computePowerQuality(const HarmonicSpectrum& spectrum, double voltageRMS,
+                                        double currentRMS, double demandCurrent)
+{
+    constexpr int ORDERS = HarmonicSpectrum::ORDERS;
+
+    // Squared order weights for the K-factor, built once
+    static const struct OrderWeights {
+        alignas(32) double value[ORDERS];
+        OrderWeights()
+        {
+            for (int i = 0; i < ORDERS; i++) {
+                value[i] = (i + 1.0) * (i + 1.0);
+            }
+        }
+    } orderSquared;
+
+    const double* v = spectrum.voltageMagnitude;
+    const double* c = spectrum.currentMagnitude;
+
+    // Harmonic orders 2..33 only; the fundamental enters the ratios below.
+    // Four independent partial sums per quantity let the adds run as vector lanes
+    // without reassociating floating point.
+    constexpr int LANES = 4;
+    static_assert((ORDERS - 1) % LANES == 0, "harmonic orders must fill whole lanes");
+    double vs[LANES] = {}, cs[LANES] = {}, ws[LANES] = {}, vp[LANES] = {}, cp[LANES] = {};
+    for (int i = 1; i < ORDERS; i += LANES) {
+        for (int l = 0; l < LANES; l++) {
+            double vi = v[i + l], ci = c[i + l];
+            vs[l] += vi * vi;
+            cs[l] += ci * ci;
+            ws[l] += orderSquared.value[i + l] * ci * ci;
+            vp[l] += vi;
+            cp[l] += ci;
+        }
+    }
+    const double voltageSquares = (vs[0] + vs[1]) + (vs[2] + vs[3]);
+    const double currentSquares = (cs[0] + cs[1]) + (cs[2] + cs[3]);
+    const double weightedSquares = (ws[0] + ws[1]) + (ws[2] + ws[3]);
+    const double voltagePeak = (vp[0] + vp[1]) + (vp[2] + vp[3]);
+    const double currentPeak = (cp[0] + cp[1]) + (cp[2] + cp[3]);
+
+    const double fundamentalV = v[0];
+    const double fundamentalI = c[0];
+    const double inverseV = fundamentalV > 0.0 ? 1.0 / fundamentalV : 0.0;
+    const double inverseI = fundamentalI > 0.0 ? 1.0 / fundamentalI : 0.0;
+
+    PowerQualityIndices indices;
+    indices.thdVoltage = std::sqrt(voltageSquares) * inverseV * 100.0;
+    indices.thdCurrent = std::sqrt(currentSquares) * inverseI * 100.0;
+
+    // Worst-case peak: every harmonic in phase with the fundamental crest
+    indices.crestFactorVoltage = voltageRMS > 0.0 ? std::sqrt(2.0) * (voltageRMS + voltagePeak) / voltageRMS : 0.0;
+    indices.crestFactorCurrent = currentRMS > 0.0 ? std::sqrt(2.0) * (currentRMS + currentPeak) / currentRMS : 0.0;
+
+    indices.kFactor = 1.0 + weightedSquares * inverseI * inverseI;
+
+    double totalSquares = fundamentalI * fundamentalI + currentSquares;
+    indices.distortionPF = totalSquares > 0.0 ? fundamentalI / std::sqrt(totalSquares) : 1.0;
+
+    indices.tdd = demandCurrent > 0.0 ? std::sqrt(currentSquares) / demandCurrent * 100.0 : 0.0;
+    return indices;
+}
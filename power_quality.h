@@ -0,0 +1,29 @@
+
+#pragma once
+
+// Harmonic results in structure-of-arrays form. Index 0 is the fundamental,
+// index h - 1 the h-th order, matching the MeteringMeasurements arrays.
+struct HarmonicSpectrum {
+    static constexpr int ORDERS = 33;
+
+    alignas(32) double voltageMagnitude[ORDERS];  // RMS
+    alignas(32) double voltagePhase[ORDERS];      // degrees
+    alignas(32) double currentMagnitude[ORDERS];
+    alignas(32) double currentPhase[ORDERS];
+};
+
+struct PowerQualityIndices {
+    double thdVoltage;          // %
+    double thdCurrent;          // %
+    double crestFactorVoltage;
+    double crestFactorCurrent;
+    double kFactor;
+    double distortionPF;
+    double tdd;                 // %, harmonic current against the demand load current
+};
+
+// Every derived index in one pass over the spectrum. The loop runs a fixed
+// trip count over the aligned arrays with no data-dependent branches, so the
+// compiler vectorises it; the divisions are hoisted out.
+PowerQualityIndices computePowerQuality(const HarmonicSpectrum& spectrum, double voltageRMS,
+                                        double currentRMS, double demandCurrent);
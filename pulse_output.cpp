@@ -0,0 +1,156 @@
+
+#include "pulse_output.h"
+#include "metering_engine.h"
+#include <algorithm>
+#include <cmath>
+
+PulseOutput::PulseOutput()
+    : m_meterConstant(1000.0)
+    , m_pulseWidth(0.03)
+    , m_quantity(PulseQuantity::ActiveImport)
+    , m_pulseEnergy(1.0)
+{
+    m_history.resize(HISTORY);
+    reset();
+}
+
+void PulseOutput::configure(double meterConstant, double pulseWidth, PulseQuantity quantity)
+{
+    if (meterConstant <= 0.0 || pulseWidth <= 0.0) {
+        return;
+    }
+
+    m_meterConstant = meterConstant;
+    m_pulseWidth = pulseWidth;
+    m_quantity = quantity;
+    m_pulseEnergy = 1000.0 / meterConstant;
+    reset();
+}
+
+void PulseOutput::reset()
+{
+    m_accumulator = 0.0;
+    m_energy = 0.0;
+    m_pulseCount = 0;
+    m_lastPulseTime = -1.0;
+}
+
+void PulseOutput::process(const SampleBlock& block)
+{
+    const int count = block.count;
+    if (count <= 0) return;
+
+    // Energy of every sample interval in Wh, summed over the phases
+    m_sampleEnergy.assign(count, 0.0);
+    double* e = m_sampleEnergy.data();
+    for (int ph = 0; ph < block.phases; ph++) {
+        const double* v = block.voltage[ph].data();
+        const double* i = block.current[ph].data();
+        for (int n = 0; n < count; n++) {
+            e[n] += v[n] * i[n];
+        }
+    }
+
+    const double interval = 1.0 / block.sampleRate;
+    const double scale = interval / 3600.0;
+    double total = 0.0;
+    switch (m_quantity) {
+    case PulseQuantity::ActiveImport:
+        for (int n = 0; n < count; n++) {
+            e[n] = std::max(e[n], 0.0) * scale;
+            total += e[n];
+        }
+        break;
+    case PulseQuantity::ActiveExport:
+        for (int n = 0; n < count; n++) {
+            e[n] = std::max(-e[n], 0.0) * scale;
+            total += e[n];
+        }
+        break;
+    case PulseQuantity::ActiveAbsolute:
+        for (int n = 0; n < count; n++) {
+            e[n] = std::abs(e[n]) * scale;
+            total += e[n];
+        }
+        break;
+    }
+    m_energy += total;
+
+    // Most blocks do not complete a pulse
+    if (m_accumulator + total < m_pulseEnergy) {
+        m_accumulator += total;
+        return;
+    }
+
+    // Energy is taken to flow evenly over each sample interval
+    for (int n = 0; n < count; n++) {
+        double before = m_accumulator;
+        m_accumulator += e[n];
+        while (m_accumulator >= m_pulseEnergy) {
+            double fraction = e[n] > 0.0 ? (m_pulseEnergy - before) / e[n] : 0.0;
+            emit(block.startTime + (n + std::min(std::max(fraction, 0.0), 1.0)) * interval);
+            m_accumulator -= m_pulseEnergy;
+            before -= m_pulseEnergy;
+        }
+    }
+}
+
+void PulseOutput::emit(double time)
+{
+    double width = m_pulseWidth;
+    if (m_lastPulseTime >= 0.0) {
+        width = std::min(width, 0.5 * (time - m_lastPulseTime));
+    }
+
+    PulseEvent& pulse = m_history[m_pulseCount % HISTORY];
+    pulse = {m_pulseCount, time, width};
+    m_pulseCount++;
+    m_lastPulseTime = time;
+
+    if (m_listener) {
+        m_listener(pulse);
+    }
+}
+
+bool PulseOutput::levelAt(double time) const
+{
+    // Newest pulse starting at or before the instant
+    const uint64_t available = std::min<uint64_t>(m_pulseCount, HISTORY);
+    for (uint64_t back = 1; back <= available; back++) {
+        const PulseEvent& pulse = m_history[(m_pulseCount - back) % HISTORY];
+        if (pulse.time <= time) {
+            return time < pulse.time + pulse.width;
+        }
+    }
+    return false;
+}
+
+uint64_t PulseOutput::getPulsesSince(uint64_t first, std::vector<PulseEvent>& pulses, uint64_t* overrun) const
+{
+    uint64_t oldest = m_pulseCount > HISTORY ? m_pulseCount - HISTORY : 0;
+    if (overrun) {
+        *overrun = first < oldest ? oldest - first : 0;
+    }
+    for (uint64_t index = std::max(first, oldest); index < m_pulseCount; index++) {
+        pulses.push_back(m_history[index % HISTORY]);
+    }
+    return m_pulseCount;
+}
+
+void PulseOutput::render(double startTime, double interval, size_t count, std::vector<bool>& levels) const
+{
+    levels.assign(count, false);
+    const uint64_t available = std::min<uint64_t>(m_pulseCount, HISTORY);
+    if (available == 0) return;
+
+    // Both the instants and the pulses are in time order, so one merge pass suffices
+    uint64_t index = m_pulseCount - available;
+    for (size_t k = 0; k < count; k++) {
+        double time = startTime + k * interval;
+        while (index + 1 < m_pulseCount && m_history[(index + 1) % HISTORY].time <= time) {
+            index++;
+        }
+        const PulseEvent& pulse = m_history[index % HISTORY];
+        levels[k] = pulse.time <= time && time < pulse.time + pulse.width;
+    }
+}
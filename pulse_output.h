@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+struct SampleBlock;
+
+// Energy direction counted by the pulse output
+enum class PulseQuantity {
+    ActiveImport,
+    ActiveExport,
+    ActiveAbsolute
+};
+
+struct PulseEvent {
+    uint64_t index;   // pulses since reset, from 0
+    double time;      // rising edge in seconds, resolved inside the sample interval
+    double width;     // seconds
+};
+
+using PulseListener = std::function<void(const PulseEvent&)>;
+
+// Metrology pulse output (calibration LED or S0) driven by the energy of the
+// sample stream. Instantaneous power is integrated per sample and each pulse
+// edge is placed where the accumulator crosses the pulse quantum, interpolated
+// within the sample, so pulse timing is independent of the block size and of
+// the simulation step. Blocks that cannot complete a pulse cost one vector
+// sum; only blocks that do are scanned sample by sample.
+class PulseOutput
+{
+public:
+    static constexpr size_t HISTORY = 4096;  // recent pulses kept for levels and readers
+
+    PulseOutput();
+
+    // meterConstant in imp/kWh; pulses are shortened to half the pulse period when faster
+    void configure(double meterConstant, double pulseWidth, PulseQuantity quantity = PulseQuantity::ActiveImport);
+    void reset();
+
+    double getMeterConstant() const { return m_meterConstant; }
+    double getPulseWidth() const { return m_pulseWidth; }
+    PulseQuantity getQuantity() const { return m_quantity; }
+
+    void setListener(PulseListener listener) { m_listener = listener; }
+
+    void process(const SampleBlock& block);
+
+    uint64_t getPulseCount() const { return m_pulseCount; }
+    double getEnergy() const { return m_energy; }  // Wh integrated from the samples
+
+    // Output level at an instant covered by the pulse history
+    bool levelAt(double time) const;
+
+    // Appends pulses with index >= first still in the history; returns the index to pass next time.
+    // Pulses from first on that already left the history are counted in *overrun.
+    uint64_t getPulsesSince(uint64_t first, std::vector<PulseEvent>& pulses, uint64_t* overrun = nullptr) const;
+
+    // Levels at count instants spaced interval apart, for the logic analyser
+    void render(double startTime, double interval, size_t count, std::vector<bool>& levels) const;
+
+private:
+    void emit(double time);
+
+    double m_meterConstant;
+    double m_pulseWidth;
+    PulseQuantity m_quantity;
+    double m_pulseEnergy;     // Wh per pulse
+
+    double m_accumulator;     // Wh towards the next pulse
+    double m_energy;
+    uint64_t m_pulseCount;
+    double m_lastPulseTime;
+
+    std::vector<PulseEvent> m_history;  // ring, slot = index % HISTORY
+    std::vector<double> m_sampleEnergy;
+    PulseListener m_listener;
+};
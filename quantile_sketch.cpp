@@ -0,0 +1,80 @@
+
+#include "quantile_sketch.h"
+#include <algorithm>
+#include <cmath>
+
+QuantileSketch::QuantileSketch(double relativeAccuracy)
+    : m_accuracy(std::min(std::max(relativeAccuracy, 1e-6), 0.5))
+{
+    m_gamma = (1.0 + m_accuracy) / (1.0 - m_accuracy);
+    m_logGamma = std::log(m_gamma);
+    clear();
+}
+
+void QuantileSketch::clear()
+{
+    m_buckets.clear();
+    m_zeroCount = 0;
+    m_count = 0;
+    m_min = 0.0;
+    m_max = 0.0;
+}
+
+void QuantileSketch::add(double value)
+{
+    value = std::max(value, 0.0);
+    if (m_count == 0) {
+        m_min = m_max = value;
+    } else {
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+    m_count++;
+
+    if (value < MIN_POSITIVE) {
+        m_zeroCount++;
+        return;
+    }
+    // Bucket i holds (gamma^(i-1), gamma^i]
+    m_buckets[static_cast<int>(std::ceil(std::log(value) / m_logGamma))]++;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+    if (other.m_count == 0) return;
+
+    if (m_count == 0) {
+        m_min = other.m_min;
+        m_max = other.m_max;
+    } else {
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+    m_count += other.m_count;
+    m_zeroCount += other.m_zeroCount;
+    for (const auto& bucket : other.m_buckets) {
+        m_buckets[bucket.first] += bucket.second;
+    }
+}
+
+double QuantileSketch::quantile(double q) const
+{
+    if (m_count == 0) return 0.0;
+    if (q <= 0.0) return m_min;
+    if (q >= 1.0) return m_max;
+
+    // Value of rank floor(q * (count - 1)), as the bucket's relative-error midpoint
+    uint64_t rank = static_cast<uint64_t>(q * (m_count - 1));
+    if (rank < m_zeroCount) {
+        return m_min;
+    }
+    uint64_t seen = m_zeroCount;
+    for (const auto& bucket : m_buckets) {
+        seen += bucket.second;
+        if (seen > rank) {
+            double value = 2.0 * std::exp(bucket.first * m_logGamma) / (1.0 + m_gamma);
+            return std::min(std::max(value, m_min), m_max);
+        }
+    }
+    return m_max;
+}
@@ -0,0 +1,41 @@
+
+#pragma once
+
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+// Streaming quantile estimate for non-negative values with a bounded relative
+// error. Values fall into logarithmically spaced buckets, so memory grows with
+// the spread of the data rather than with the number of values, and two
+// sketches with the same accuracy merge exactly.
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(double relativeAccuracy = 1e-4);
+
+    void add(double value);
+    void merge(const QuantileSketch& other);
+    void clear();
+
+    // q in 0..1; within relativeAccuracy of the exact rank value
+    double quantile(double q) const;
+
+    uint64_t getCount() const { return m_count; }
+    double getMin() const { return m_min; }
+    double getMax() const { return m_max; }
+    double getRelativeAccuracy() const { return m_accuracy; }
+    size_t getBucketCount() const { return m_buckets.size(); }
+
+private:
+    static constexpr double MIN_POSITIVE = 1e-9;  // smaller values are counted as zero
+
+    double m_accuracy;
+    double m_gamma;
+    double m_logGamma;
+    std::map<int, uint64_t> m_buckets;
+    uint64_t m_zeroCount;
+    uint64_t m_count;
+    double m_min;
+    double m_max;
+};
@@ -0,0 +1,302 @@
+
+#include "register_journal.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr uint32_t SECTOR_MAGIC = 0x314A564E;  // "NVJ1"
+
+template <typename T>
+void put(uint8_t* data, T value)
+{
+    std::memcpy(data, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const uint8_t* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+bool isErased(const uint8_t* data, size_t length)
+{
+    return std::all_of(data, data + length, [](uint8_t byte) { return byte == 0xFF; });
+}
+
+}
+
+RegisterJournal::RegisterJournal(size_t sectorSize, size_t maxEvents)
+    : m_sectorSize(std::max(sectorSize, SECTOR_HEADER_SIZE + 8 * RECORD_SIZE))
+    , m_maxEvents(maxEvents)
+    , m_active(0)
+    , m_generation(0)
+    , m_writeOffset(SECTOR_HEADER_SIZE)
+    , m_sequence(0)
+    , m_powered(true)
+    , m_budgeted(false)
+    , m_budget(0)
+    , m_recordCount(0)
+    , m_compactionCount(0)
+    , m_eraseCount{0, 0}
+{
+    m_sectors[0].assign(m_sectorSize, 0xFF);
+    m_sectors[1].assign(m_sectorSize, 0xFF);
+    format();
+}
+
+uint32_t RegisterJournal::crc32(const uint8_t* data, size_t length)
+{
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+void RegisterJournal::format()
+{
+    m_powered = true;
+    m_budgeted = false;
+    m_values.clear();
+    m_events.clear();
+    m_sequence = 0;
+
+    erase(0);
+    erase(1);
+
+    uint8_t header[SECTOR_HEADER_SIZE];
+    put<uint32_t>(header, SECTOR_MAGIC);
+    put<uint32_t>(header + 4, 1);
+    put<uint32_t>(header + 8, RECORD_SIZE);
+    put<uint32_t>(header + 12, crc32(header, 12));
+    program(0, 0, header, sizeof(header));
+
+    m_active = 0;
+    m_generation = 1;
+    m_writeOffset = SECTOR_HEADER_SIZE;
+}
+
+double RegisterJournal::read(uint16_t id, double fallback) const
+{
+    auto it = m_values.find(id);
+    return it != m_values.end() ? it->second : fallback;
+}
+
+bool RegisterJournal::write(uint16_t id, double value)
+{
+    m_values[id] = value;
+    return append(Value, id, value);
+}
+
+bool RegisterJournal::logEvent(uint16_t code, double time)
+{
+    m_events.push_back({code, time});
+    if (m_events.size() > m_maxEvents) {
+        m_events.erase(m_events.begin());
+    }
+    return append(Event, code, time);
+}
+
+void RegisterJournal::failAfter(size_t bytes)
+{
+    m_budgeted = true;
+    m_budget = bytes;
+}
+
+void RegisterJournal::encodeRecord(uint8_t* record, uint8_t kind, uint16_t id, double value)
+{
+    put<uint16_t>(record, id);
+    record[2] = kind;
+    record[3] = 0;
+    put<uint32_t>(record + 4, m_sequence++);
+    put<double>(record + 8, value);
+    put<uint32_t>(record + 16, crc32(record, 16));
+}
+
+bool RegisterJournal::append(uint8_t kind, uint16_t id, double value)
+{
+    if (!m_powered) return false;
+
+    // The compacted sector already holds the value just set
+    if (m_writeOffset + RECORD_SIZE > m_sectorSize) {
+        return compact();
+    }
+
+    uint8_t record[RECORD_SIZE];
+    encodeRecord(record, kind, id, value);
+    bool written = program(m_active, m_writeOffset, record, RECORD_SIZE);
+    m_writeOffset += RECORD_SIZE;
+    m_recordCount++;
+    return written;
+}
+
+bool RegisterJournal::compact()
+{
+    const int target = 1 - m_active;
+    if (m_values.size() + m_events.size() > getRecordsPerSector() || !erase(target)) {
+        return false;
+    }
+
+    uint8_t record[RECORD_SIZE];
+    size_t offset = SECTOR_HEADER_SIZE;
+    for (const auto& entry : m_values) {
+        encodeRecord(record, Value, entry.first, entry.second);
+        if (!program(target, offset, record, RECORD_SIZE)) return false;
+        offset += RECORD_SIZE;
+    }
+    for (const auto& event : m_events) {
+        encodeRecord(record, Event, event.code, event.time);
+        if (!program(target, offset, record, RECORD_SIZE)) return false;
+        offset += RECORD_SIZE;
+    }
+
+    // Committing the header makes the new sector the newest valid one
+    uint8_t header[SECTOR_HEADER_SIZE];
+    put<uint32_t>(header, SECTOR_MAGIC);
+    put<uint32_t>(header + 4, m_generation + 1);
+    put<uint32_t>(header + 8, RECORD_SIZE);
+    put<uint32_t>(header + 12, crc32(header, 12));
+    if (!program(target, 0, header, sizeof(header))) return false;
+
+    m_active = target;
+    m_generation++;
+    m_writeOffset = offset;
+    m_recordCount += m_values.size() + m_events.size();
+    m_compactionCount++;
+    return true;
+}
+
+bool RegisterJournal::recover()
+{
+    m_powered = true;
+    m_budgeted = false;
+
+    int best = -1;
+    uint32_t bestGeneration = 0;
+    for (int s = 0; s < 2; s++) {
+        const uint8_t* header = m_sectors[s].data();
+        if (get<uint32_t>(header) != SECTOR_MAGIC || get<uint32_t>(header + 8) != RECORD_SIZE ||
+            get<uint32_t>(header + 12) != crc32(header, 12)) {
+            continue;
+        }
+        uint32_t generation = get<uint32_t>(header + 4);
+        if (best < 0 || generation > bestGeneration) {
+            best = s;
+            bestGeneration = generation;
+        }
+    }
+
+    if (best < 0) {
+        format();
+        return false;
+    }
+
+    m_values.clear();
+    m_events.clear();
+    m_sequence = 0;
+    m_active = best;
+    m_generation = bestGeneration;
+
+    const uint8_t* sector = m_sectors[best].data();
+    size_t offset = SECTOR_HEADER_SIZE;
+    while (offset + RECORD_SIZE <= m_sectorSize) {
+        const uint8_t* record = sector + offset;
+        if (isErased(record, RECORD_SIZE)) break;
+
+        // A torn record is skipped over, not treated as the end: its bytes cannot be
+        // reprogrammed before an erase, so records appended after a recovery follow it
+        offset += RECORD_SIZE;
+        if (get<uint32_t>(record + 16) != crc32(record, 16)) continue;
+
+        uint16_t id = get<uint16_t>(record);
+        double value = get<double>(record + 8);
+        m_sequence = get<uint32_t>(record + 4) + 1;
+        if (record[2] == Value) {
+            m_values[id] = value;
+        } else if (record[2] == Event) {
+            m_events.push_back({id, value});
+            if (m_events.size() > m_maxEvents) {
+                m_events.erase(m_events.begin());
+            }
+        }
+    }
+    m_writeOffset = offset;
+    return true;
+}
+
+bool RegisterJournal::program(int sector, size_t offset, const uint8_t* data, size_t length)
+{
+    if (!m_powered) return false;
+
+    size_t count = m_budgeted ? std::min(length, m_budget) : length;
+    uint8_t* target = m_sectors[sector].data() + offset;
+    for (size_t i = 0; i < count; i++) {
+        target[i] &= data[i];
+    }
+
+    if (m_budgeted) {
+        m_budget -= count;
+        if (count < length) {
+            m_powered = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RegisterJournal::erase(int sector)
+{
+    if (!m_powered) return false;
+    if (m_budgeted && m_budget == 0) {
+        m_powered = false;
+        return false;
+    }
+
+    std::fill(m_sectors[sector].begin(), m_sectors[sector].end(), 0xFF);
+    m_eraseCount[sector]++;
+    return true;
+}
+
+bool RegisterJournal::saveImage(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint32_t size = static_cast<uint32_t>(m_sectorSize);
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    for (const auto& sector : m_sectors) {
+        out.write(reinterpret_cast<const char*>(sector.data()), sector.size());
+    }
+    return static_cast<bool>(out);
+}
+
+bool RegisterJournal::loadImage(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    uint32_t size = 0;
+    if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)) || size != m_sectorSize) {
+        return false;
+    }
+
+    std::vector<uint8_t> sectors[2] = {std::vector<uint8_t>(size), std::vector<uint8_t>(size)};
+    for (auto& sector : sectors) {
+        if (!in.read(reinterpret_cast<char*>(sector.data()), size)) return false;
+    }
+    m_sectors[0].swap(sectors[0]);
+    m_sectors[1].swap(sectors[1]);
+    return true;
+}
@@ -0,0 +1,98 @@
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct JournalEvent {
+    uint16_t code;
+    double time;
+};
+
+// Append-only register journal in a simulated two-sector EEPROM/flash part.
+// Every write is one fixed-size CRC-32 protected record appended to the active
+// sector. When the sector fills, the latest value of each register and the
+// most recent events are compacted into the other, erased sector, whose header
+// is programmed last; a power failure at any byte therefore leaves either the
+// old or the new sector intact. Recovery replays the newest valid sector up to
+// the first erased slot, skipping torn records, so writes appended after one
+// power failure survive the next.
+//
+// Programming follows flash rules (bits can only be cleared until the sector
+// is erased) and can be cut off after a byte budget to simulate supply loss at
+// an arbitrary instant.
+class RegisterJournal
+{
+public:
+    static constexpr size_t RECORD_SIZE = 20;
+    static constexpr size_t SECTOR_HEADER_SIZE = 16;
+
+    explicit RegisterJournal(size_t sectorSize = 4096, size_t maxEvents = 64);
+
+    void format();  // erases both sectors and forgets every register
+
+    // Appends one record; false once power has failed
+    bool write(uint16_t id, double value);
+    bool logEvent(uint16_t code, double time);
+
+    // Latest values, as journaled so far or as recovered
+    bool has(uint16_t id) const { return m_values.count(id) != 0; }
+    double read(uint16_t id, double fallback = 0.0) const;
+    const std::vector<JournalEvent>& getEvents() const { return m_events; }
+
+    // Power-fail simulation: programming stops after bytes more bytes, mid-record if need be
+    void failAfter(size_t bytes);
+    bool isPowered() const { return m_powered; }
+
+    // Power-up: rebuilds the registers from the NV image; false when no sector is valid
+    bool recover();
+
+    // NV image as raw bytes, e.g. to keep it across simulator runs; call recover() after loading
+    bool saveImage(const std::string& path) const;
+    bool loadImage(const std::string& path);
+
+    size_t getSectorSize() const { return m_sectorSize; }
+    size_t getRecordsPerSector() const { return (m_sectorSize - SECTOR_HEADER_SIZE) / RECORD_SIZE; }
+    uint64_t getRecordCount() const { return m_recordCount; }
+    uint64_t getCompactionCount() const { return m_compactionCount; }
+    uint64_t getEraseCount(int sector) const { return m_eraseCount[sector]; }
+
+    static uint32_t crc32(const uint8_t* data, size_t length);
+
+private:
+    enum RecordKind : uint8_t {
+        Value = 1,
+        Event = 2
+    };
+
+    bool append(uint8_t kind, uint16_t id, double value);
+    bool compact();
+    void encodeRecord(uint8_t* record, uint8_t kind, uint16_t id, double value);
+
+    // Flash primitives; both honour the power-fail budget
+    bool program(int sector, size_t offset, const uint8_t* data, size_t length);
+    bool erase(int sector);
+
+    size_t m_sectorSize;
+    size_t m_maxEvents;
+    std::vector<uint8_t> m_sectors[2];
+
+    int m_active;               // sector being appended to
+    uint32_t m_generation;      // of the active sector
+    size_t m_writeOffset;
+    uint32_t m_sequence;
+
+    std::map<uint16_t, double> m_values;
+    std::vector<JournalEvent> m_events;
+
+    bool m_powered;
+    bool m_budgeted;
+    size_t m_budget;
+
+    uint64_t m_recordCount;
+    uint64_t m_compactionCount;
+    uint64_t m_eraseCount[2];
+};
@@ -0,0 +1,102 @@
+// Shared sample ring check: exports an engine through SimulatorCore, reads the
+// object back as another process would, and verifies samples, the measurement
+// snapshot and overrun detection once the writer has lapped the reader.
+//
+//   ring_check [name]
+
+#include "simulator_core.h"
+#include "metering_engine.h"
+#include "shared_sample_ring.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t CAPACITY = 8192;
+constexpr double STEP = 0.001;
+
+bool expect(bool condition, const char* what)
+{
+    std::printf("  %-52s %s\n", what, condition ? "ok" : "FAIL");
+    return condition;
+}
+
+void run(MeteringEngine& engine, double seconds)
+{
+    const long steps = static_cast<long>(seconds / STEP + 0.5);
+    for (long step = 0; step < steps; step++) {
+        engine.update(STEP);
+    }
+}
+
+// Samples [first, first + count) of every channel match what the engine generated
+bool matches(const SharedSampleReader& reader, const std::vector<double>* generated, uint64_t first, size_t count)
+{
+    std::vector<double> copy(count);
+    for (int c = 0; c < SharedSampleWriter::CHANNELS; c++) {
+        if (!reader.readSamples(c, first, count, copy.data())) return false;
+        for (size_t i = 0; i < count; i++) {
+            if (copy[i] != generated[c][first + i]) return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string name = argc > 1 ? argv[1] : "smsr_check_" + std::to_string(getpid());
+
+    auto engine = std::make_shared<MeteringEngine>();
+    engine->configure(true, 230.0, 10.0, 50.0, 0.9);
+    engine->setHarmonic(HarmonicChannel::Current, 3, 0.2);
+
+    // What the engine generated, for comparison with what a reader sees
+    std::vector<double> generated[SharedSampleWriter::CHANNELS];
+    engine->addSampleBlockListener([&](const SampleBlock& block) {
+        for (int ph = 0; ph < 3; ph++) {
+            generated[ph].insert(generated[ph].end(), block.voltage[ph].begin(), block.voltage[ph].begin() + block.count);
+            generated[3 + ph].insert(generated[3 + ph].end(), block.current[ph].begin(), block.current[ph].begin() + block.count);
+        }
+    });
+
+    SimulatorCore core;
+    core.setMeteringEngine(engine);
+    if (!core.startSharedExport(name, CAPACITY)) {
+        std::printf("cannot create shared-memory object %s\n", name.c_str());
+        return 2;
+    }
+    run(*engine, 0.5);
+
+    SharedSampleReader reader;
+    bool ok = expect(reader.open(name), "reader maps the exported object");
+    if (!ok) return 1;
+    ok &= expect(reader.getCapacity() == CAPACITY && reader.getPhases() == 3, "header: capacity and phases");
+    ok &= expect(reader.getWriteIndex() == generated[0].size(), "write index counts every generated sample");
+    ok &= expect(matches(reader, generated, 0, generated[0].size()), "all six channels read back exactly");
+
+    SharedMeasurementSnapshot snapshot;
+    ok &= expect(reader.readMeasurements(snapshot) &&
+                 std::abs(snapshot.voltageRMS - engine->getBasicMeasurements().voltageRMS) < 1e-9 &&
+                 std::abs(snapshot.activePower - engine->getBasicMeasurements().activePower) < 1e-9,
+                 "measurement snapshot matches the engine");
+
+    // The writer laps the ring; the oldest samples are gone and a reader must be told
+    run(*engine, 0.5);
+    const uint64_t written = reader.getWriteIndex();
+    std::vector<double> copy(64);
+    ok &= expect(written > CAPACITY && !reader.readSamples(0, 0, copy.size(), copy.data()),
+                 "overwritten samples are reported as overrun");
+    ok &= expect(matches(reader, generated, written - CAPACITY, CAPACITY), "the newest capacity samples still read back");
+    ok &= expect(!reader.readSamples(0, written, 1, copy.data()), "samples not yet written are refused");
+
+    core.stopSharedExport();
+    ok &= expect(!SharedSampleReader().open(name), "object unlinked when the export stops");
+
+    std::printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
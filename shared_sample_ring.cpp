@@ -0,0 +1,314 @@
+
+#include "shared_sample_ring.h"
+#include "metering_engine.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr size_t MEASUREMENT_OFFSET = 192;
+constexpr size_t SAMPLE_OFFSET = 4096;  // page aligned
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock-free to be shared");
+static_assert(offsetof(SharedRingHeader, capacity) == 16, "documented layout");
+static_assert(offsetof(SharedRingHeader, sampleOffset) == 40, "documented layout");
+static_assert(offsetof(SharedRingHeader, writeBegin) == 64, "documented layout");
+static_assert(offsetof(SharedRingHeader, writeIndex) == 72, "documented layout");
+static_assert(offsetof(SharedRingHeader, measurementSequence) == 128, "documented layout");
+static_assert(sizeof(SharedRingHeader) <= MEASUREMENT_OFFSET, "header overlaps the snapshot");
+static_assert(MEASUREMENT_OFFSET + sizeof(SharedMeasurementSnapshot) <= SAMPLE_OFFSET, "snapshot overlaps the samples");
+
+std::string objectName(const std::string& name)
+{
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+}
+
+SharedSampleWriter::SharedSampleWriter()
+    : m_header(nullptr)
+    , m_samples(nullptr)
+    , m_measurement(nullptr)
+    , m_size(0)
+    , m_mask(0)
+    , m_engine(nullptr)
+    , m_listenerId(-1)
+    , m_subscriptionId(-1)
+{
+}
+
+SharedSampleWriter::~SharedSampleWriter()
+{
+    disconnect();
+    close();
+}
+
+bool SharedSampleWriter::open(const std::string& name, size_t capacity, double sampleRate)
+{
+    close();
+
+    size_t rounded = 1;
+    while (rounded < std::max<size_t>(capacity, 1)) {
+        rounded <<= 1;
+    }
+
+    m_name = objectName(name);
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t size = SAMPLE_OFFSET + CHANNELS * rounded * sizeof(double);
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    // A fresh object reads as zeros; the header is placed over it, magic last
+    uint8_t* base = static_cast<uint8_t*>(mapping);
+    m_size = size;
+    m_mask = rounded - 1;
+    m_header = new (base) SharedRingHeader();
+    m_measurement = reinterpret_cast<SharedMeasurementSnapshot*>(base + MEASUREMENT_OFFSET);
+    m_samples = reinterpret_cast<double*>(base + SAMPLE_OFFSET);
+
+    m_header->version = VERSION;
+    m_header->channels = CHANNELS;
+    m_header->phases = 1;
+    m_header->capacity = rounded;
+    m_header->sampleRate = sampleRate;
+    m_header->startTime = 0.0;
+    m_header->sampleOffset = SAMPLE_OFFSET;
+    m_header->measurementOffset = MEASUREMENT_OFFSET;
+    m_header->reserved = 0;
+    m_header->writeBegin.store(0, std::memory_order_relaxed);
+    m_header->writeIndex.store(0, std::memory_order_relaxed);
+    m_header->measurementSequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = MAGIC;
+    return true;
+}
+
+void SharedSampleWriter::close()
+{
+    if (!m_header) return;
+
+    munmap(m_header, m_size);
+    shm_unlink(m_name.c_str());
+    m_header = nullptr;
+    m_samples = nullptr;
+    m_measurement = nullptr;
+    m_size = 0;
+}
+
+uint64_t SharedSampleWriter::getWriteIndex() const
+{
+    return m_header ? m_header->writeIndex.load(std::memory_order_relaxed) : 0;
+}
+
+void SharedSampleWriter::publish(const SampleBlock& block)
+{
+    if (!m_header || block.count <= 0) return;
+
+    const uint64_t capacity = m_mask + 1;
+    const uint64_t index = m_header->writeIndex.load(std::memory_order_relaxed);
+    const uint64_t end = index + block.count;
+    if (index == 0) {
+        m_header->startTime = block.startTime;
+    }
+    m_header->phases = static_cast<uint32_t>(block.phases);
+
+    // Announce the overwrite before touching the slots, commit after
+    m_header->writeBegin.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Only the newest capacity samples of an oversized block can survive
+    const uint64_t skip = static_cast<uint64_t>(block.count) > capacity ? block.count - capacity : 0;
+    const uint64_t first = index + skip;
+    const size_t count = static_cast<size_t>(end - first);
+    const size_t slot = static_cast<size_t>(first & m_mask);
+    const size_t head = std::min<size_t>(count, capacity - slot);
+
+    for (int c = 0; c < CHANNELS; c++) {
+        int ph = c % 3;
+        double* channel = m_samples + c * capacity;
+        if (ph < block.phases) {
+            const double* source = (c < 3 ? block.voltage[ph] : block.current[ph]).data() + skip;
+            std::memcpy(channel + slot, source, head * sizeof(double));
+            std::memcpy(channel, source + head, (count - head) * sizeof(double));
+        } else {
+            std::fill(channel + slot, channel + slot + head, 0.0);
+            std::fill(channel, channel + (count - head), 0.0);
+        }
+    }
+
+    m_header->writeIndex.store(end, std::memory_order_release);
+}
+
+void SharedSampleWriter::publish(const MeteringMeasurements& m, double time)
+{
+    if (!m_header) return;
+
+    const uint64_t sequence = m_header->measurementSequence.load(std::memory_order_relaxed);
+    m_header->measurementSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    SharedMeasurementSnapshot& s = *m_measurement;
+    s.time = time;
+    s.voltageRMS = m.voltageRMS;
+    s.currentRMS = m.currentRMS;
+    s.activePower = m.activePower;
+    s.reactivePower = m.reactivePower;
+    s.apparentPower = m.apparentPower;
+    s.powerFactor = m.powerFactor;
+    s.frequency = m.frequency;
+    s.energy = m.energy;
+    s.thdVoltage = m.thd_voltage;
+    s.thdCurrent = m.thd_current;
+    for (int ph = 0; ph < 3; ph++) {
+        s.voltage[ph] = m.voltage[ph];
+        s.current[ph] = m.current[ph];
+    }
+
+    m_header->measurementSequence.store(sequence + 2, std::memory_order_release);
+}
+
+void SharedSampleWriter::connect(MeteringEngine& engine)
+{
+    disconnect();
+    m_engine = &engine;
+    m_listenerId = engine.addSampleBlockListener([this](const SampleBlock& block) {
+        publish(block);
+    });
+    m_subscriptionId = engine.subscribeMeasurements(MeasurementGroup::All, [this](const MeteringMeasurements& m) {
+        publish(m, m_engine->getSimulationTime());
+    });
+}
+
+void SharedSampleWriter::disconnect()
+{
+    if (m_engine) {
+        m_engine->removeSampleBlockListener(m_listenerId);
+        m_engine->unsubscribeMeasurements(m_subscriptionId);
+    }
+    m_engine = nullptr;
+    m_listenerId = m_subscriptionId = -1;
+}
+
+SharedSampleReader::SharedSampleReader()
+    : m_header(nullptr)
+    , m_samples(nullptr)
+    , m_measurement(nullptr)
+    , m_size(0)
+{
+}
+
+SharedSampleReader::~SharedSampleReader()
+{
+    close();
+}
+
+bool SharedSampleReader::open(const std::string& name)
+{
+    close();
+
+    int fd = shm_open(objectName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= SAMPLE_OFFSET) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const uint8_t* base = static_cast<const uint8_t*>(mapping);
+    const SharedRingHeader* header = reinterpret_cast<const SharedRingHeader*>(base);
+    const size_t size = info.st_size;
+    const uint64_t capacity = header->capacity;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    bool valid = header->magic == SharedSampleWriter::MAGIC && header->version == SharedSampleWriter::VERSION &&
+                 header->channels == SharedSampleWriter::CHANNELS && capacity > 0 &&
+                 (capacity & (capacity - 1)) == 0 && header->sampleOffset >= SAMPLE_OFFSET &&
+                 header->measurementOffset + sizeof(SharedMeasurementSnapshot) <= header->sampleOffset &&
+                 header->sampleOffset + SharedSampleWriter::CHANNELS * capacity * sizeof(double) <= size;
+    if (!valid) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    m_header = header;
+    m_samples = reinterpret_cast<const double*>(base + header->sampleOffset);
+    m_measurement = reinterpret_cast<const SharedMeasurementSnapshot*>(base + header->measurementOffset);
+    m_size = size;
+    return true;
+}
+
+void SharedSampleReader::close()
+{
+    if (!m_header) return;
+
+    munmap(const_cast<SharedRingHeader*>(m_header), m_size);
+    m_header = nullptr;
+    m_samples = nullptr;
+    m_measurement = nullptr;
+    m_size = 0;
+}
+
+uint64_t SharedSampleReader::getWriteIndex() const
+{
+    return m_header ? m_header->writeIndex.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedSampleReader::readSamples(int channel, uint64_t first, size_t count, double* out) const
+{
+    if (!m_header || channel < 0 || channel >= SharedSampleWriter::CHANNELS) return false;
+
+    const uint64_t capacity = m_header->capacity;
+    const uint64_t written = m_header->writeIndex.load(std::memory_order_acquire);
+    if (count > capacity || first + count > written || written - first > capacity) {
+        return false;
+    }
+
+    const double* samples = m_samples + channel * capacity;
+    const size_t slot = static_cast<size_t>(first & (capacity - 1));
+    const size_t head = std::min<size_t>(count, capacity - slot);
+    std::memcpy(out, samples + slot, head * sizeof(double));
+    std::memcpy(out + head, samples, (count - head) * sizeof(double));
+
+    // The writer may have lapped the range while it was copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return first + capacity >= m_header->writeBegin.load(std::memory_order_relaxed);
+}
+
+bool SharedSampleReader::readMeasurements(SharedMeasurementSnapshot& snapshot, int attempts) const
+{
+    if (!m_header) return false;
+
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        uint64_t before = m_header->measurementSequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        std::memcpy(&snapshot, m_measurement, sizeof(snapshot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->measurementSequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
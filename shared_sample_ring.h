@@ -0,0 +1,142 @@
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class MeteringEngine;
+struct SampleBlock;
+struct MeteringMeasurements;
+
+// Live export of an engine's samples and measurements through a POSIX
+// shared-memory object (/dev/shm/<name>) that other processes map read-only.
+//
+// Layout, little-endian, offsets in bytes from the start of the mapping:
+//
+//   0     u32  magic 0x52534D53 ("SMSR")
+//   4     u32  version (1)
+//   8     u32  channels (6: VA VB VC IA IB IC; B and C are zero for single phase)
+//   12    u32  phases (1 or 3)
+//   16    u64  capacity, samples per channel (a power of two)
+//   24    f64  sample rate
+//   32    f64  time of sample index 0, seconds
+//   40    u64  sample offset: channel c, index i is the f64 at
+//              sampleOffset + 8 * (c * capacity + (i & (capacity - 1)))
+//   48    u64  measurement offset (SharedMeasurementSnapshot)
+//   64    u64  write begin: samples below begin - capacity may be overwritten
+//   72    u64  write index: samples below it are complete
+//   128   u64  measurement sequence: odd while the snapshot is being written
+//
+// Samples: read the write index, copy any range inside the last capacity
+// samples, then read write begin; the copy is intact when its first index is
+// not below begin - capacity, otherwise the reader was overrun.
+// Measurements: a seqlock; read the sequence, copy the snapshot, read the
+// sequence again and retry unless both reads are equal and even.
+// The writer never waits for readers.
+struct SharedMeasurementSnapshot {
+    double time;
+    double voltageRMS;
+    double currentRMS;
+    double activePower;
+    double reactivePower;
+    double apparentPower;
+    double powerFactor;
+    double frequency;
+    double energy;
+    double thdVoltage;
+    double thdCurrent;
+    double voltage[3];
+    double current[3];
+};
+
+struct SharedRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t channels;
+    uint32_t phases;
+    uint64_t capacity;
+    double sampleRate;
+    double startTime;
+    uint64_t sampleOffset;
+    uint64_t measurementOffset;
+    uint64_t reserved;
+    std::atomic<uint64_t> writeBegin;
+    std::atomic<uint64_t> writeIndex;
+    alignas(64) std::atomic<uint64_t> measurementSequence;
+};
+
+// Owns the shared-memory object and publishes into it
+class SharedSampleWriter
+{
+public:
+    static constexpr uint32_t MAGIC = 0x52534D53;
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int CHANNELS = 6;
+
+    SharedSampleWriter();
+    ~SharedSampleWriter();
+
+    SharedSampleWriter(const SharedSampleWriter&) = delete;
+    SharedSampleWriter& operator=(const SharedSampleWriter&) = delete;
+
+    // Creates or replaces the object; capacity is rounded up to a power of two
+    bool open(const std::string& name, size_t capacity, double sampleRate);
+    void close();  // unmaps and unlinks
+    bool isOpen() const { return m_header != nullptr; }
+
+    void publish(const SampleBlock& block);
+    void publish(const MeteringMeasurements& measurements, double time);
+
+    // Publishes every sample block and every measurement update of the engine
+    void connect(MeteringEngine& engine);
+    void disconnect();
+
+    uint64_t getWriteIndex() const;
+
+private:
+    std::string m_name;
+    SharedRingHeader* m_header;
+    double* m_samples;
+    SharedMeasurementSnapshot* m_measurement;
+    size_t m_size;
+    uint64_t m_mask;
+
+    MeteringEngine* m_engine;
+    int m_listenerId;
+    int m_subscriptionId;
+};
+
+// Read-only view of a ring published by another process (or this one)
+class SharedSampleReader
+{
+public:
+    SharedSampleReader();
+    ~SharedSampleReader();
+
+    SharedSampleReader(const SharedSampleReader&) = delete;
+    SharedSampleReader& operator=(const SharedSampleReader&) = delete;
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+
+    uint64_t getWriteIndex() const;
+    uint64_t getCapacity() const { return m_header ? m_header->capacity : 0; }
+    double getSampleRate() const { return m_header ? m_header->sampleRate : 0.0; }
+    int getPhases() const { return m_header ? static_cast<int>(m_header->phases) : 0; }
+
+    // Copies samples [first, first + count) of a channel; false when they are not
+    // yet written or were overwritten during the copy
+    bool readSamples(int channel, uint64_t first, size_t count, double* out) const;
+
+    // Latest snapshot; false when the writer kept it busy for every attempt
+    bool readMeasurements(SharedMeasurementSnapshot& snapshot, int attempts = 100) const;
+
+private:
+    const SharedRingHeader* m_header;
+    const double* m_samples;
+    const SharedMeasurementSnapshot* m_measurement;
+    size_t m_size;
+};
@@ -3,16 +3,29 @@
 #include "mcu_emulator.h"
 #include "metering_engine.h"
 #include "protocol_handler.h"
+#include "adc_model.h"
+#include "metrology_afe.h"
+#include "synchrophasor_estimator.h"
+#include "c37118_server.h"
+#include "shared_sample_ring.h"
 #include <iostream>
 
 SimulatorCore::SimulatorCore()
-    : m_lastUpdate(std::chrono::high_resolution_clock::now())
+    : m_adcListenerId(-1)
+    , m_afeChipSelect(0)
+    , m_afeListenerId(-1)
+    , m_pmuListenerId(-1)
+    , m_pulsePin(-1)
+    , m_nextPulse(0)
+    , m_lastUpdate(std::chrono::high_resolution_clock::now())
 {
 }
 
 SimulatorCore::~SimulatorCore()
 {
     stopSimulation();
+    stopSynchrophasorStream();
+    stopSharedExport();
 }
 
 void SimulatorCore::startSimulation()
@@ -49,16 +62,42 @@ void SimulatorCore::resetSimulation()
     if (m_meteringEngine) {
         m_meteringEngine->reset();
     }
+    m_nextPulse = 0;
+    if (m_adcModel) {
+        m_adcModel->reset();
+    }
+    if (m_afe) {
+        m_afe->reset();
+    }
+    if (m_pmuEstimator) {
+        m_pmuEstimator->reset();
+    }
 }
 
 void SimulatorCore::setMCUEmulator(std::shared_ptr<MCUEmulator> emulator)
 {
+    disconnectAcquisition();
+    disconnectMetrology();
     m_mcuEmulator = emulator;
+    connectAcquisition();
+    connectMetrology();
 }
 
 void SimulatorCore::setMeteringEngine(std::shared_ptr<MeteringEngine> engine)
 {
+    disconnectAcquisition();
+    disconnectMetrology();
+    disconnectSynchrophasors();
+    if (m_sharedExport) {
+        m_sharedExport->disconnect();
+    }
     m_meteringEngine = engine;
+    connectAcquisition();
+    connectMetrology();
+    connectSynchrophasors();
+    if (m_sharedExport && m_meteringEngine) {
+        m_sharedExport->connect(*m_meteringEngine);
+    }
 }
 
 void SimulatorCore::setProtocolHandler(std::shared_ptr<ProtocolHandler> handler)
@@ -66,6 +105,147 @@ void SimulatorCore::setProtocolHandler(std::shared_ptr<ProtocolHandler> handler)
     m_protocolHandler = handler;
 }
 
+void SimulatorCore::setADCModel(std::shared_ptr<ADCModel> model)
+{
+    disconnectAcquisition();
+    m_adcModel = model;
+    connectAcquisition();
+}
+
+void SimulatorCore::setMetrologyAFE(std::shared_ptr<MetrologyAFE> afe, int chipSelect)
+{
+    disconnectMetrology();
+    m_afe = afe;
+    m_afeChipSelect = chipSelect;
+    connectMetrology();
+}
+
+void SimulatorCore::setPulseOutputPin(int pin)
+{
+    m_pulsePin = pin;
+    m_nextPulse = m_meteringEngine ? m_meteringEngine->getPulseOutput().getPulseCount() : 0;
+    if (m_mcuEmulator && pin >= 0) {
+        m_mcuEmulator->configureGPIO(pin, true);
+    }
+}
+
+bool SimulatorCore::startSynchrophasorStream(uint16_t port, int reportingRate, uint16_t idCode,
+                                             const std::string& stationName)
+{
+    stopSynchrophasorStream();
+    if (!m_meteringEngine) return false;
+    
+    const double frequency = m_meteringEngine->getNominalFrequency();
+    const int phases = m_meteringEngine->isThreePhase() ? 3 : 1;
+    
+    auto estimator = std::make_unique<SynchrophasorEstimator>();
+    estimator->configure(frequency, m_meteringEngine->getSampleRate(), reportingRate);
+    auto server = std::make_unique<C37118Server>();
+    server->configure(idCode, stationName, frequency, estimator->getReportingRate(), phases);
+    if (!server->listen(port)) {
+        return false;
+    }
+    
+    server->connect(*estimator);
+    m_pmuEstimator = std::move(estimator);
+    m_pmuServer = std::move(server);
+    connectSynchrophasors();
+    return true;
+}
+
+void SimulatorCore::stopSynchrophasorStream()
+{
+    disconnectSynchrophasors();
+    if (m_pmuServer) {
+        m_pmuServer->close();
+    }
+    m_pmuServer.reset();
+    m_pmuEstimator.reset();
+}
+
+uint16_t SimulatorCore::getSynchrophasorPort() const
+{
+    return m_pmuServer ? m_pmuServer->getPort() : 0;
+}
+
+bool SimulatorCore::startSharedExport(const std::string& name, size_t capacity)
+{
+    stopSharedExport();
+    if (!m_meteringEngine) return false;
+    
+    auto writer = std::make_unique<SharedSampleWriter>();
+    if (!writer->open(name, capacity, m_meteringEngine->getSampleRate())) {
+        return false;
+    }
+    writer->connect(*m_meteringEngine);
+    m_sharedExport = std::move(writer);
+    return true;
+}
+
+void SimulatorCore::stopSharedExport()
+{
+    // Disconnects from the engine, then unlinks the object; mapped readers keep their view
+    m_sharedExport.reset();
+}
+
+void SimulatorCore::connectSynchrophasors()
+{
+    // The estimator follows the engine's sample stream and hands each report to the server
+    if (m_meteringEngine && m_pmuEstimator) {
+        m_pmuListenerId = m_pmuEstimator->connect(*m_meteringEngine);
+    }
+}
+
+void SimulatorCore::disconnectSynchrophasors()
+{
+    if (m_pmuListenerId >= 0 && m_meteringEngine) {
+        m_meteringEngine->removeSampleBlockListener(m_pmuListenerId);
+    }
+    m_pmuListenerId = -1;
+}
+
+void SimulatorCore::connectAcquisition()
+{
+    // The ADC model converts each sample block and feeds the MCU's ADC channels
+    if (m_meteringEngine && m_mcuEmulator && m_adcModel) {
+        m_adcListenerId = m_adcModel->connect(*m_meteringEngine, *m_mcuEmulator);
+    }
+}
+
+void SimulatorCore::disconnectAcquisition()
+{
+    if (m_adcListenerId >= 0 && m_meteringEngine) {
+        m_meteringEngine->removeSampleBlockListener(m_adcListenerId);
+    }
+    m_adcListenerId = -1;
+}
+
+void SimulatorCore::connectMetrology()
+{
+    // The AFE converts each sample block; the MCU reaches its registers through SPI frames
+    if (!m_afe) return;
+    if (m_meteringEngine) {
+        m_afeListenerId = m_afe->connect(*m_meteringEngine);
+    }
+    if (m_mcuEmulator) {
+        MetrologyAFE* afe = m_afe.get();
+        m_mcuEmulator->attachSPIDevice(m_afeChipSelect, [afe](const std::vector<uint8_t>& tx) {
+            return afe->spiTransfer(tx);
+        });
+    }
+}
+
+void SimulatorCore::disconnectMetrology()
+{
+    if (m_afeListenerId >= 0 && m_meteringEngine) {
+        m_meteringEngine->removeSampleBlockListener(m_afeListenerId);
+    }
+    m_afeListenerId = -1;
+    if (m_afe && m_mcuEmulator) {
+        m_mcuEmulator->detachSPIDevice(m_afeChipSelect);
+    }
+}
+
 void SimulatorCore::simulationLoop()
 {
     const auto frameDuration = std::chrono::microseconds(1000000 / SIMULATION_FREQUENCY_HZ);
@@ -97,11 +277,44 @@ void SimulatorCore::updateComponents()
         m_meteringEngine->update(deltaTime);
     }
     
+    // Both edges of every pulse since the last step reach the GPIO, however short the
+    // pulse; the pin is then left at the level at the end of the step
+    if (m_meteringEngine && m_mcuEmulator && m_pulsePin >= 0) {
+        const PulseOutput& pulses = m_meteringEngine->getPulseOutput();
+        const double now = m_meteringEngine->getSimulationTime();
+        if (pulses.getPulseCount() < m_nextPulse) {
+            m_nextPulse = 0;  // the engine was reset
+        }
+        m_pulseEvents.clear();
+        uint64_t overrun = 0;
+        m_nextPulse = pulses.getPulsesSince(m_nextPulse, m_pulseEvents, &overrun);
+        // A long step can emit more pulses than the history holds; those ended before the
+        // oldest one kept, so only their edges are driven
+        for (uint64_t missed = 0; missed < overrun; missed++) {
+            m_mcuEmulator->setGPIOState(m_pulsePin, false);
+            m_mcuEmulator->setGPIOState(m_pulsePin, true);
+        }
+        for (const PulseEvent& pulse : m_pulseEvents) {
+            // Pulses never overlap, so one still high from the last step ends first
+            m_mcuEmulator->setGPIOState(m_pulsePin, false);
+            m_mcuEmulator->setGPIOState(m_pulsePin, true);
+            if (pulse.time + pulse.width <= now) {
+                m_mcuEmulator->setGPIOState(m_pulsePin, false);
+            }
+        }
+        m_mcuEmulator->setGPIOState(m_pulsePin, pulses.levelAt(now));
+    }
+    
     // Update MCU emulator (processes ADC values, runs firmware)
     if (m_mcuEmulator) {
         m_mcuEmulator->update(deltaTime);
     }
     
+    // Synchrophasor clients: accept, answer commands, flush the frames this step produced
+    if (m_pmuServer) {
+        m_pmuServer->poll();
+    }
+    
     // Update protocol handler (processes communication)
     if (m_protocolHandler) {
         m_protocolHandler->update(deltaTime);
@@ -5,10 +5,20 @@
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "pulse_output.h"
 
 class MCUEmulator;
 class MeteringEngine;
 class ProtocolHandler;
+class ADCModel;
+class MetrologyAFE;
+class SynchrophasorEstimator;
+class C37118Server;
+class SharedSampleWriter;
 
 class SimulatorCore
 {
@@ -26,10 +36,41 @@ public:
     void setMCUEmulator(std::shared_ptr<MCUEmulator> emulator);
     void setMeteringEngine(std::shared_ptr<MeteringEngine> engine);
     void setProtocolHandler(std::shared_ptr<ProtocolHandler> handler);
+    void setADCModel(std::shared_ptr<ADCModel> model);
+    
+    // Metrology front end fed from the engine's samples and wired to the MCU's SPI bus
+    // on chipSelect, where firmware models read and calibrate it register by register
+    void setMetrologyAFE(std::shared_ptr<MetrologyAFE> afe, int chipSelect = 0);
+    
+    // MCU pin that follows the engine's pulse output; -1 disconnects it
+    void setPulseOutputPin(int pin);
+    
+    // IEEE C37.118.2 stream of synchrophasors estimated from the engine's samples, served on
+    // 127.0.0.1:port (0 picks a free port) and polled from the simulation loop. Takes the
+    // nominal frequency and phase count from the engine, so set and configure it first.
+    bool startSynchrophasorStream(uint16_t port, int reportingRate, uint16_t idCode = 1,
+                                  const std::string& stationName = "SMART METER");
+    void stopSynchrophasorStream();
+    uint16_t getSynchrophasorPort() const;
+    const SynchrophasorEstimator* getSynchrophasorEstimator() const { return m_pmuEstimator.get(); }
+    const C37118Server* getSynchrophasorServer() const { return m_pmuServer.get(); }
+    
+    // Publishes the engine's samples and measurements to the shared-memory object
+    // /dev/shm/<name> (layout in shared_sample_ring.h) until stopped; capacity is in
+    // samples per channel. Set the engine first.
+    bool startSharedExport(const std::string& name, size_t capacity = 1u << 16);
+    void stopSharedExport();
+    const SharedSampleWriter* getSharedExport() const { return m_sharedExport.get(); }
 
 private:
     void simulationLoop();
     void updateComponents();
+    void connectAcquisition();
+    void disconnectAcquisition();
+    void connectMetrology();
+    void disconnectMetrology();
+    void connectSynchrophasors();
+    void disconnectSynchrophasors();
 
     std::atomic<bool> m_running{false};
     std::atomic<bool> m_paused{false};
@@ -38,6 +79,18 @@ private:
     std::shared_ptr<MCUEmulator> m_mcuEmulator;
     std::shared_ptr<MeteringEngine> m_meteringEngine;
     std::shared_ptr<ProtocolHandler> m_protocolHandler;
+    std::shared_ptr<ADCModel> m_adcModel;
+    int m_adcListenerId;
+    std::shared_ptr<MetrologyAFE> m_afe;
+    int m_afeChipSelect;
+    int m_afeListenerId;
+    std::unique_ptr<SynchrophasorEstimator> m_pmuEstimator;
+    std::unique_ptr<C37118Server> m_pmuServer;
+    int m_pmuListenerId;
+    std::unique_ptr<SharedSampleWriter> m_sharedExport;
+    int m_pulsePin;
+    uint64_t m_nextPulse;                 // first pulse not yet driven onto the pin
+    std::vector<PulseEvent> m_pulseEvents;
     
     std::chrono::high_resolution_clock::time_point m_lastUpdate;
     static constexpr int SIMULATION_FREQUENCY_HZ = 1000;
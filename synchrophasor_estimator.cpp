@@ -0,0 +1,222 @@
+
+#include "synchrophasor_estimator.h"
+#include "metering_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int CHANNELS = SynchrophasorFrame::CHANNELS;
+
+double wrapAngle(double angle)
+{
+    return std::remainder(angle, 2.0 * M_PI);
+}
+
+}
+
+SynchrophasorEstimator::SynchrophasorEstimator()
+    : m_nominalFrequency(50.0)
+    , m_sampleRate(12800.0)
+    , m_reportingRate(50)
+{
+    configure(50.0, 12800.0, 50);
+}
+
+void SynchrophasorEstimator::configure(double nominalFrequency, double sampleRate, int reportingRate)
+{
+    if (nominalFrequency <= 0.0 || sampleRate <= 0.0 || reportingRate <= 0) {
+        return;
+    }
+
+    m_nominalFrequency = nominalFrequency;
+    m_sampleRate = sampleRate;
+    m_reportingRate = reportingRate;
+    m_samplesPerCycle = std::max(4, static_cast<int>(std::lround(sampleRate / nominalFrequency)));
+    m_halfWindow = m_samplesPerCycle;
+    m_reportInterval = sampleRate / reportingRate;
+
+    // Triangular two-cycle filter, unity DC gain
+    const int taps = 2 * m_halfWindow - 1;
+    m_weights.resize(taps);
+    double sum = 0.0;
+    for (int i = 0; i < taps; i++) {
+        m_weights[i] = 1.0 - std::abs(i - (m_halfWindow - 1)) / static_cast<double>(m_halfWindow);
+        sum += m_weights[i];
+    }
+    for (double& w : m_weights) {
+        w /= sum;
+    }
+
+    // Room for the three filter positions of a report plus one engine block in flight
+    int span = 4 * m_samplesPerCycle + 1024;
+    int ringSize = 1;
+    while (ringSize < span) ringSize <<= 1;
+    m_ringMask = ringSize - 1;
+    for (int c = 0; c < CHANNELS; c++) {
+        m_real[c].assign(ringSize, 0.0);
+        m_imag[c].assign(ringSize, 0.0);
+    }
+
+    reset();
+}
+
+void SynchrophasorEstimator::reset()
+{
+    for (int c = 0; c < CHANNELS; c++) {
+        std::fill(m_real[c].begin(), m_real[c].end(), 0.0);
+        std::fill(m_imag[c].begin(), m_imag[c].end(), 0.0);
+        m_maxTVE[c] = 0.0;
+    }
+    m_samplesSeen = 0;
+    m_nextReport = 0;
+    m_phases = 1;
+    m_latest = {};
+    m_frameCount = 0;
+    m_maxFrequencyError = 0.0;
+    m_maxRocofError = 0.0;
+}
+
+int SynchrophasorEstimator::connect(MeteringEngine& engine)
+{
+    MeteringEngine* source = &engine;
+    m_reference = [source](double time, SignalReference& reference) {
+        return source->getSignalReference(time, reference);
+    };
+    return engine.addSampleBlockListener([this](const SampleBlock& block) {
+        process(block);
+    });
+}
+
+void SynchrophasorEstimator::process(const SampleBlock& block)
+{
+    const int count = block.count;
+    if (count <= 0) return;
+
+    // Reports need one cycle plus half a window on either side of their instant
+    const uint64_t reach = m_samplesPerCycle + m_halfWindow - 1;
+
+    // Absolute sample numbering follows the block timestamps; the first block or a gap
+    // restarts the history, and reports resume once it covers a whole filter span
+    uint64_t first = static_cast<uint64_t>(std::llround(block.startTime * m_sampleRate));
+    if (m_samplesSeen == 0 || first != m_samplesSeen) {
+        m_nextReport = static_cast<uint64_t>(std::ceil((first + reach) / m_reportInterval));
+    }
+    m_phases = block.phases;
+
+    // One oscillator for all channels: exp(-j w0 t) from the block-start phase, then a rotation
+    m_oscillatorCos.resize(count);
+    m_oscillatorSin.resize(count);
+    double cycles = m_nominalFrequency * (first / m_sampleRate);
+    double angle = 2.0 * M_PI * (cycles - std::floor(cycles));
+    const double stepCos = std::cos(2.0 * M_PI * m_nominalFrequency / m_sampleRate);
+    const double stepSin = std::sin(2.0 * M_PI * m_nominalFrequency / m_sampleRate);
+    double c = std::cos(angle), s = std::sin(angle);
+    for (int i = 0; i < count; i++) {
+        m_oscillatorCos[i] = c;
+        m_oscillatorSin[i] = s;
+        double next = c * stepCos - s * stepSin;
+        s = s * stepCos + c * stepSin;
+        c = next;
+    }
+
+    const double* oscCos = m_oscillatorCos.data();
+    const double* oscSin = m_oscillatorSin.data();
+    for (int ph = 0; ph < 3; ph++) {
+        const double* inputs[2] = {block.voltage[ph].data(), block.current[ph].data()};
+        for (int k = 0; k < 2; k++) {
+            int channel = ph + 3 * k;
+            double* re = m_real[channel].data();
+            double* im = m_imag[channel].data();
+            const double* x = inputs[k];
+            const bool present = ph < block.phases;
+            for (int i = 0; i < count; i++) {
+                size_t slot = (first + i) & m_ringMask;
+                double value = present ? x[i] : 0.0;
+                re[slot] = value * oscCos[i];
+                im[slot] = -value * oscSin[i];
+            }
+        }
+    }
+    m_samplesSeen = first + count;
+
+    for (;;) {
+        uint64_t centre = static_cast<uint64_t>(std::llround(m_nextReport * m_reportInterval));
+        if (centre + reach >= m_samplesSeen) break;
+        report(centre);
+        m_nextReport++;
+    }
+}
+
+std::complex<double> SynchrophasorEstimator::filter(int channel, uint64_t centre) const
+{
+    const double* re = m_real[channel].data();
+    const double* im = m_imag[channel].data();
+    const double* w = m_weights.data();
+    const int taps = static_cast<int>(m_weights.size());
+    const uint64_t start = centre - (m_halfWindow - 1);
+
+    double sumRe = 0.0, sumIm = 0.0;
+    for (int i = 0; i < taps; i++) {
+        size_t slot = (start + i) & m_ringMask;
+        sumRe += w[i] * re[slot];
+        sumIm += w[i] * im[slot];
+    }
+
+    // Peak to RMS: the demodulated fundamental is half the peak
+    return std::sqrt(2.0) * std::complex<double>(sumRe, sumIm);
+}
+
+void SynchrophasorEstimator::report(uint64_t centre)
+{
+    SynchrophasorFrame frame = {};
+    frame.timestamp = centre / m_sampleRate;
+
+    for (int ph = 0; ph < m_phases; ph++) {
+        frame.phasor[ph] = filter(ph, centre);
+        frame.phasor[3 + ph] = filter(3 + ph, centre);
+    }
+
+    // Positive sequence in the generated rotation (phase B at +120 degrees)
+    const std::complex<double> a = std::polar(1.0, 2.0 * M_PI / 3.0);
+    auto positiveSequence = [&](uint64_t at) {
+        if (m_phases < 3) return filter(0, at);
+        return (filter(0, at) + std::conj(a) * filter(1, at) + a * filter(2, at)) / 3.0;
+    };
+
+    const uint64_t offset = m_samplesPerCycle;
+    std::complex<double> before = positiveSequence(centre - offset);
+    std::complex<double> after = positiveSequence(centre + offset);
+    frame.positiveSequence = m_phases < 3 ? frame.phasor[0]
+                           : (frame.phasor[0] + std::conj(a) * frame.phasor[1] + a * frame.phasor[2]) / 3.0;
+
+    const double spacing = offset / m_sampleRate;
+    double stepBefore = wrapAngle(std::arg(frame.positiveSequence) - std::arg(before));
+    double stepAfter = wrapAngle(std::arg(after) - std::arg(frame.positiveSequence));
+    frame.frequency = m_nominalFrequency + (stepBefore + stepAfter) / (2.0 * M_PI * 2.0 * spacing);
+    frame.rocof = (stepAfter - stepBefore) / (2.0 * M_PI * spacing * spacing);
+
+    SignalReference reference;
+    if (m_reference && m_reference(frame.timestamp, reference)) {
+        frame.referenceValid = true;
+        for (int ph = 0; ph < 3; ph++) {
+            const std::complex<double>* expected[2] = {&reference.voltage[ph], &reference.current[ph]};
+            for (int k = 0; k < 2; k++) {
+                int channel = ph + 3 * k;
+                double magnitude = std::abs(*expected[k]);
+                frame.tve[channel] = magnitude > 0.0 ? std::abs(frame.phasor[channel] - *expected[k]) / magnitude * 100.0 : 0.0;
+                m_maxTVE[channel] = std::max(m_maxTVE[channel], frame.tve[channel]);
+            }
+        }
+        frame.frequencyError = std::abs(frame.frequency - reference.frequency);
+        frame.rocofError = std::abs(frame.rocof - reference.rocof);
+        m_maxFrequencyError = std::max(m_maxFrequencyError, frame.frequencyError);
+        m_maxRocofError = std::max(m_maxRocofError, frame.rocofError);
+    }
+
+    m_latest = frame;
+    m_frameCount++;
+    if (m_listener) {
+        m_listener(frame);
+    }
+}
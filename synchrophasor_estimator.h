@@ -0,0 +1,100 @@
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <functional>
+#include <cstdint>
+
+class MeteringEngine;
+struct SampleBlock;
+struct SignalReference;
+
+// One reported measurement. Phasors are RMS against a cosine at the nominal
+// frequency, channels 0-2 voltages A-C and 3-5 currents A-C.
+struct SynchrophasorFrame {
+    static constexpr int CHANNELS = 6;
+
+    double timestamp;                          // seconds since the stream epoch
+    std::complex<double> phasor[CHANNELS];
+    std::complex<double> positiveSequence;     // voltage
+    double frequency;                          // Hz
+    double rocof;                              // Hz/s
+
+    // Self-evaluation against the signal reference; valid only when referenceValid
+    bool referenceValid;
+    double tve[CHANNELS];                      // total vector error, %
+    double frequencyError;                     // FE, Hz
+    double rocofError;                         // RFE, Hz/s
+};
+
+using SynchrophasorReferenceProvider = std::function<bool(double time, SignalReference& reference)>;
+using SynchrophasorFrameListener = std::function<void(const SynchrophasorFrame&)>;
+
+// P-class style synchrophasor estimator. Every sample of the six channels is
+// demodulated by one shared nominal-frequency oscillator into a ring buffer as
+// blocks arrive; at each reporting instant a two-cycle triangular filter gives
+// the phasors, and the positive-sequence angle one cycle either side gives
+// frequency and ROCOF. Work per block is proportional to its length, and the
+// filters run only at the reporting rate, so fleets scale linearly.
+class SynchrophasorEstimator
+{
+public:
+    SynchrophasorEstimator();
+
+    // Reporting rate in frames per second; it must divide the sample rate evenly enough
+    // for report instants to fall on samples (10 to 50 fps at 50 Hz)
+    void configure(double nominalFrequency, double sampleRate, int reportingRate);
+    void reset();
+
+    int getReportingRate() const { return m_reportingRate; }
+    double getNominalFrequency() const { return m_nominalFrequency; }
+
+    void setReferenceProvider(SynchrophasorReferenceProvider provider) { m_reference = provider; }
+    void setFrameListener(SynchrophasorFrameListener listener) { m_listener = listener; }
+
+    // Feeds the estimator from the engine's sample stream and uses the engine as the reference
+    int connect(MeteringEngine& engine);
+
+    void process(const SampleBlock& block);
+
+    uint64_t getFrameCount() const { return m_frameCount; }
+    const SynchrophasorFrame& getLatestFrame() const { return m_latest; }
+
+    // Worst errors since reset, over frames with a valid reference
+    double getMaxTVE(int channel) const { return m_maxTVE[channel]; }
+    double getMaxFrequencyError() const { return m_maxFrequencyError; }
+    double getMaxRocofError() const { return m_maxRocofError; }
+
+private:
+    std::complex<double> filter(int channel, uint64_t centre) const;
+    void report(uint64_t centre);
+
+    double m_nominalFrequency;
+    double m_sampleRate;
+    int m_reportingRate;
+    int m_samplesPerCycle;
+    int m_halfWindow;          // triangular filter spans centre +/- (m_halfWindow - 1)
+    double m_reportInterval;   // samples between reports, may be fractional
+    int m_phases;
+
+    // Demodulated samples, structure of arrays, indexed by absolute sample number
+    int m_ringMask;
+    std::vector<double> m_real[SynchrophasorFrame::CHANNELS];
+    std::vector<double> m_imag[SynchrophasorFrame::CHANNELS];
+    std::vector<double> m_weights;  // 2 * m_halfWindow - 1 taps, normalised
+
+    uint64_t m_samplesSeen;
+    uint64_t m_nextReport;     // index of the next report instant
+    std::vector<double> m_oscillatorCos;
+    std::vector<double> m_oscillatorSin;
+
+    SynchrophasorReferenceProvider m_reference;
+    SynchrophasorFrameListener m_listener;
+
+    SynchrophasorFrame m_latest;
+    uint64_t m_frameCount;
+    double m_maxTVE[SynchrophasorFrame::CHANNELS];
+    double m_maxFrequencyError;
+    double m_maxRocofError;
+};
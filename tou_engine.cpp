@@ -0,0 +1,248 @@
+
+#include "tou_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double SECONDS_PER_DAY = 86400.0;
+
+}
+
+TOUEngine::TOUEngine()
+    : m_calendarStart(1735689600) // 2025-01-01 00:00 UTC
+    , m_transitionIndex(0)
+    , m_horizonEnd(0.0)
+    , m_nextTransitionTime(-std::numeric_limits<double>::infinity())
+    , m_activeTariff(0)
+{
+    m_registers.assign(4, 0.0);
+}
+
+void TOUEngine::clearCalendar()
+{
+    m_dayProfiles.clear();
+    m_weekProfiles.clear();
+    m_seasons.clear();
+    m_specialDays.clear();
+    m_transitions.clear();
+    invalidate();
+}
+
+void TOUEngine::addDayProfile(const TOUDayProfile& profile)
+{
+    TOUDayProfile sorted = profile;
+    std::sort(sorted.switches.begin(), sorted.switches.end(),
+              [](const TOUDaySwitch& a, const TOUDaySwitch& b) { return a.startMinute < b.startMinute; });
+
+    for (const auto& sw : sorted.switches) {
+        if (sw.tariff >= getTariffCount()) {
+            setTariffCount(sw.tariff + 1);
+        }
+    }
+
+    m_dayProfiles[profile.id] = sorted;
+    invalidate();
+}
+
+void TOUEngine::addWeekProfile(const TOUWeekProfile& profile)
+{
+    m_weekProfiles[profile.id] = profile;
+    invalidate();
+}
+
+void TOUEngine::addSeason(const TOUSeason& season)
+{
+    m_seasons.push_back(season);
+    std::sort(m_seasons.begin(), m_seasons.end(), [](const TOUSeason& a, const TOUSeason& b) {
+        return a.startMonth != b.startMonth ? a.startMonth < b.startMonth : a.startDay < b.startDay;
+    });
+    invalidate();
+}
+
+void TOUEngine::addSpecialDay(const TOUSpecialDay& specialDay)
+{
+    m_specialDays.push_back(specialDay);
+    invalidate();
+}
+
+void TOUEngine::setTariffCount(int count)
+{
+    if (count > 0) {
+        m_registers.resize(count, 0.0);
+    }
+}
+
+void TOUEngine::setCalendarStart(long long unixSeconds)
+{
+    m_calendarStart = unixSeconds;
+    invalidate();
+}
+
+void TOUEngine::setCalendarStart(int year, int month, int day)
+{
+    setCalendarStart(daysFromCivil(year, month, day) * 86400LL);
+}
+
+void TOUEngine::resetRegisters()
+{
+    std::fill(m_registers.begin(), m_registers.end(), 0.0);
+    invalidate();
+}
+
+void TOUEngine::setTariffRegisters(const std::vector<double>& registers)
+{
+    for (size_t t = 0; t < registers.size() && t < m_registers.size(); t++) {
+        m_registers[t] = registers[t];
+    }
+}
+
+void TOUEngine::accumulate(double startTime, double endTime, double energy)
+{
+    update(startTime);
+
+    // Hot path: no switch point inside this interval
+    if (endTime < m_nextTransitionTime) {
+        m_registers[m_activeTariff] += energy;
+        return;
+    }
+
+    double duration = endTime - startTime;
+    double position = startTime;
+    double remaining = energy;
+
+    while (endTime >= m_nextTransitionTime) {
+        double boundary = m_nextTransitionTime;
+        double portion = (duration > 0.0) ? energy * (boundary - position) / duration : 0.0;
+
+        m_registers[m_activeTariff] += portion;
+        remaining -= portion;
+        position = boundary;
+
+        step();
+    }
+
+    m_registers[m_activeTariff] += remaining;
+}
+
+void TOUEngine::advanceTo(double time)
+{
+    if (m_nextTransitionTime == -std::numeric_limits<double>::infinity()) {
+        compile(time);
+    }
+
+    while (time >= m_nextTransitionTime) {
+        step();
+    }
+}
+
+void TOUEngine::step()
+{
+    if (m_transitionIndex < m_transitions.size() &&
+        m_transitions[m_transitionIndex].time == m_nextTransitionTime) {
+        m_activeTariff = m_transitions[m_transitionIndex].tariff;
+        m_transitionIndex++;
+        m_nextTransitionTime = (m_transitionIndex < m_transitions.size())
+            ? m_transitions[m_transitionIndex].time
+            : m_horizonEnd;
+    } else {
+        // Reached the end of the compiled horizon
+        compile(m_nextTransitionTime);
+    }
+}
+
+void TOUEngine::compile(double fromTime)
+{
+    m_transitions.clear();
+
+    // Start one day early so the tariff in force at fromTime is known
+    long long firstDay = static_cast<long long>(std::floor((m_calendarStart + fromTime) / SECONDS_PER_DAY)) - 1;
+    long long lastDay = firstDay + 1 + COMPILE_HORIZON_DAYS;
+
+    for (long long day = firstDay; day < lastDay; day++) {
+        auto it = m_dayProfiles.find(dayProfileForDay(day));
+        if (it == m_dayProfiles.end()) continue;
+
+        double dayStart = day * SECONDS_PER_DAY - m_calendarStart;
+        for (const auto& sw : it->second.switches) {
+            if (!m_transitions.empty() && m_transitions.back().tariff == sw.tariff) continue;
+            m_transitions.push_back({dayStart + sw.startMinute * 60.0, sw.tariff});
+        }
+    }
+
+    m_horizonEnd = lastDay * SECONDS_PER_DAY - m_calendarStart;
+
+    auto next = std::upper_bound(m_transitions.begin(), m_transitions.end(), fromTime,
+                                 [](double t, const TOUTransition& tr) { return t < tr.time; });
+    m_transitionIndex = next - m_transitions.begin();
+
+    if (m_transitionIndex > 0) {
+        m_activeTariff = m_transitions[m_transitionIndex - 1].tariff;
+    }
+    m_nextTransitionTime = (m_transitionIndex < m_transitions.size())
+        ? m_transitions[m_transitionIndex].time
+        : m_horizonEnd;
+}
+
+int TOUEngine::dayProfileForDay(long long day) const
+{
+    int year, month, dayOfMonth;
+    civilFromDays(day, year, month, dayOfMonth);
+
+    // Special days override the season/week tables
+    for (const auto& special : m_specialDays) {
+        if ((special.year == 0 || special.year == year) &&
+            special.month == month && special.day == dayOfMonth) {
+            return special.dayProfile;
+        }
+    }
+
+    int weekProfileId;
+    if (!m_seasons.empty()) {
+        // Last season starting on or before this date; wraps to the final season of the year
+        const TOUSeason* active = &m_seasons.back();
+        for (const auto& season : m_seasons) {
+            if (season.startMonth < month || (season.startMonth == month && season.startDay <= dayOfMonth)) {
+                active = &season;
+            }
+        }
+        weekProfileId = active->weekProfile;
+    } else if (!m_weekProfiles.empty()) {
+        weekProfileId = m_weekProfiles.begin()->first;
+    } else {
+        return m_dayProfiles.empty() ? -1 : m_dayProfiles.begin()->first;
+    }
+
+    auto week = m_weekProfiles.find(weekProfileId);
+    if (week == m_weekProfiles.end()) {
+        return -1;
+    }
+
+    // 1970-01-01 was a Thursday; index 0 is Monday
+    int weekday = static_cast<int>(((day % 7) + 7 + 3) % 7);
+    return week->second.dayProfile[weekday];
+}
+
+long long TOUEngine::daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    const long long era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(year - era * 400);
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long long>(doe) - 719468;
+}
+
+void TOUEngine::civilFromDays(long long days, int& year, int& month, int& day)
+{
+    days += 719468;
+    const long long era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+
+    day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
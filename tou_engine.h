@@ -0,0 +1,114 @@
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <limits>
+#include <cstddef>
+
+// Activity calendar building blocks, modelled on the DLMS activity calendar
+struct TOUDaySwitch {
+    int startMinute;   // minutes after midnight
+    int tariff;        // tariff register index
+};
+
+struct TOUDayProfile {
+    int id;
+    std::vector<TOUDaySwitch> switches;
+};
+
+struct TOUWeekProfile {
+    int id;
+    int dayProfile[7]; // Monday .. Sunday
+};
+
+struct TOUSeason {
+    int startMonth;    // 1..12
+    int startDay;      // 1..31
+    int weekProfile;
+};
+
+struct TOUSpecialDay {
+    int year;          // 0 = recurring every year
+    int month;
+    int day;
+    int dayProfile;
+};
+
+struct TOUTransition {
+    double time;       // simulation time in seconds
+    int tariff;
+};
+
+// Time-of-use tariff selection. The calendar is compiled into a sorted list of
+// tariff transitions, so advancing the clock costs a single comparison until
+// the next switch point is reached.
+class TOUEngine
+{
+public:
+    TOUEngine();
+
+    // Calendar definition
+    void clearCalendar();
+    void addDayProfile(const TOUDayProfile& profile);
+    void addWeekProfile(const TOUWeekProfile& profile);
+    void addSeason(const TOUSeason& season);
+    void addSpecialDay(const TOUSpecialDay& specialDay);
+    void setTariffCount(int count);
+    int getTariffCount() const { return static_cast<int>(m_registers.size()); }
+
+    // Wall-clock time (Unix seconds, UTC) that simulation time zero maps to
+    void setCalendarStart(long long unixSeconds);
+    void setCalendarStart(int year, int month, int day);
+    long long getCalendarStart() const { return m_calendarStart; }
+
+    // Returns the tariff active at the given simulation time
+    int update(double time)
+    {
+        if (time >= m_nextTransitionTime) {
+            advanceTo(time);
+        }
+        return m_activeTariff;
+    }
+
+    // Books energy (Wh) consumed over [startTime, endTime), splitting it at tariff switches
+    void accumulate(double startTime, double endTime, double energy);
+
+    int getActiveTariff() const { return m_activeTariff; }
+    double getNextTransitionTime() const { return m_nextTransitionTime; }
+    const std::vector<double>& getTariffRegisters() const { return m_registers; }
+    const std::vector<TOUTransition>& getTransitions() const { return m_transitions; }
+    void resetRegisters();
+    void setTariffRegisters(const std::vector<double>& registers);  // restored from non-volatile memory
+
+    // Re-arms the calendar so the next update recompiles from the given time
+    void invalidate() { m_nextTransitionTime = -std::numeric_limits<double>::infinity(); }
+
+private:
+    void advanceTo(double time);
+    void step();
+    void compile(double fromTime);
+    int dayProfileForDay(long long day) const;
+
+    static long long daysFromCivil(int year, int month, int day);
+    static void civilFromDays(long long days, int& year, int& month, int& day);
+
+    // Calendar tables
+    std::map<int, TOUDayProfile> m_dayProfiles;
+    std::map<int, TOUWeekProfile> m_weekProfiles;
+    std::vector<TOUSeason> m_seasons;  // sorted by start date
+    std::vector<TOUSpecialDay> m_specialDays;
+    long long m_calendarStart;
+
+    // Compiled switch points
+    std::vector<TOUTransition> m_transitions;
+    size_t m_transitionIndex;
+    double m_horizonEnd;
+    double m_nextTransitionTime;
+    int m_activeTariff;
+
+    // Energy registers per tariff (Wh)
+    std::vector<double> m_registers;
+
+    static constexpr int COMPILE_HORIZON_DAYS = 366;
+};
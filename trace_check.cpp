@@ -0,0 +1,146 @@
+
+// Golden-trace regression check: records a fixed scenario through the metering
+// engine, or diffs two recordings and reports the first divergence.
+//
+//   trace_check record <file> [seconds] [--raw | --quantum Q]
+//   trace_check compare <expected> <actual> [--abs X] [--rel X] [--ulp N]
+
+#include "golden_trace.h"
+#include "metering_engine.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+constexpr double SAMPLE_RATE = 12800.0;
+constexpr double STEP = 0.001;
+
+std::vector<TraceChannel> allChannels()
+{
+    std::vector<TraceChannel> channels;
+    for (int c = 0; c < static_cast<int>(TraceChannel::Count); c++) {
+        channels.push_back(static_cast<TraceChannel>(c));
+    }
+    return channels;
+}
+
+// Three-phase load with harmonics, seeded noise, a dip and a frequency excursion
+int record(const std::string& path, double duration, WaveformEncoding encoding, double quantum)
+{
+    MeteringEngine engine;
+    engine.configure(true, 230.0, 10.0, 50.0, 0.9);
+    engine.setHarmonicAnalysisEnabled(true);
+    engine.setNoiseSeed(0x5eed);
+    engine.injectNoise(0.5);
+    engine.setHarmonic(HarmonicChannel::Voltage, 5, 0.03, 20.0);
+    engine.setHarmonic(HarmonicChannel::Current, 3, 0.25, 0.0);
+    engine.setHarmonic(HarmonicChannel::Current, 5, 0.12, 45.0);
+
+    TraceRecorder recorder;
+    recorder.setCompression(encoding, quantum);
+    if (!recorder.open(path, allChannels(), SAMPLE_RATE)) {
+        std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        return 2;
+    }
+    recorder.connect(engine);
+
+    bool dipped = false, varied = false;
+    const long steps = static_cast<long>(duration / STEP + 0.5);
+    for (long step = 0; step < steps; step++) {
+        double time = step * STEP;
+        if (!dipped && time >= 0.5 * duration) {
+            engine.injectVoltageDip(0.3, 0.1);
+            dipped = true;
+        }
+        if (!varied && time >= 0.25 * duration) {
+            engine.injectFrequencyVariation(0.4, 0.3 * duration, 0.05 * duration);
+            varied = true;
+        }
+        engine.update(STEP);
+    }
+
+    recorder.disconnect();
+    uint64_t values = recorder.getValueCount();
+    recorder.close();
+    std::printf("recorded %llu values to %s\n", static_cast<unsigned long long>(values), path.c_str());
+    return 0;
+}
+
+int compare(const std::string& expectedPath, const std::string& actualPath, const TraceTolerance& tolerance)
+{
+    TraceComparator comparator;
+    comparator.setDefaultTolerance(tolerance);
+    TraceComparison result = comparator.compare(expectedPath, actualPath);
+
+    if (!result.error.empty()) {
+        std::printf("error: %s\n", result.error.c_str());
+    }
+    if (result.diverged) {
+        std::printf("first divergence: %s[%llu] at t=%.6f s: expected %.17g, got %.17g\n",
+                    result.channel.c_str(), static_cast<unsigned long long>(result.index), result.time,
+                    result.expected, result.actual);
+    }
+
+    std::printf("%-14s %12s %14s %12s %12s\n", "channel", "values", "max abs err", "max ulps", "violations");
+    for (const auto& channel : result.channels) {
+        std::printf("%-14s %12llu %14.6g %12llu %12llu\n", channel.name.c_str(),
+                    static_cast<unsigned long long>(channel.values), channel.maxAbsoluteError,
+                    static_cast<unsigned long long>(channel.maxUlps),
+                    static_cast<unsigned long long>(channel.violations));
+    }
+    std::printf("%s: %llu values compared\n", result.passed ? "PASS" : "FAIL",
+                static_cast<unsigned long long>(result.valuesCompared));
+    return result.passed ? 0 : 1;
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: trace_check record <file> [seconds] [--raw | --quantum Q]\n"
+                 "       trace_check compare <expected> <actual> [--abs X] [--rel X] [--ulp N]\n");
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 3 && std::strcmp(argv[1], "record") == 0) {
+        double duration = argc >= 4 ? std::atof(argv[3]) : 10.0;
+        WaveformEncoding encoding = WaveformEncoding::Xor;
+        double quantum = 0.0;
+        for (int i = 4; i < argc; i++) {
+            if (std::strcmp(argv[i], "--raw") == 0) {
+                encoding = WaveformEncoding::Raw;
+            } else if (std::strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {
+                encoding = WaveformEncoding::QuantizedDelta;
+                quantum = std::atof(argv[++i]);
+            } else {
+                usage();
+                return 2;
+            }
+        }
+        return record(argv[2], duration > 0.0 ? duration : 10.0, encoding, quantum);
+    }
+
+    if (argc >= 4 && std::strcmp(argv[1], "compare") == 0) {
+        TraceTolerance tolerance = {0.0, 0.0, 0};
+        for (int i = 4; i + 1 < argc; i += 2) {
+            if (std::strcmp(argv[i], "--abs") == 0) {
+                tolerance.absolute = std::atof(argv[i + 1]);
+            } else if (std::strcmp(argv[i], "--rel") == 0) {
+                tolerance.relative = std::atof(argv[i + 1]);
+            } else if (std::strcmp(argv[i], "--ulp") == 0) {
+                tolerance.ulps = std::strtoull(argv[i + 1], nullptr, 10);
+            } else {
+                usage();
+                return 2;
+            }
+        }
+        return compare(argv[2], argv[3], tolerance);
+    }
+
+    usage();
+    return 2;
+}
@@ -0,0 +1,322 @@
+
+#include "transient_generator.h"
+#include "metering_engine.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+namespace {
+
+// Filter length per output sample; sets the anti-alias transition band width
+constexpr int TAPS_PER_PHASE = 24;
+
+// Passband edge as a fraction of the output rate
+constexpr double CUTOFF = 0.4;
+
+// Transients are considered finished once their envelope falls below 1e-4
+constexpr double DECAY_SPAN = 9.2103403719761836;  // ln(1e4)
+
+struct Term {
+    std::complex<double> coefficient;
+    std::complex<double> pole;
+};
+
+}
+
+TransientGenerator::TransientGenerator()
+    : m_sampleRate(12800.0)
+    , m_oversampling(1)
+    , m_halfSpan(0.0)
+    , m_captureEnabled(false)
+    , m_captureChannel(TransientChannel::Voltage)
+    , m_capturePhase(0)
+    , m_maxBurstLength(1 << 20)
+    , m_previousBase(0.0)
+{
+    m_burst.sampleRate = 0.0;
+    m_lastBurst.sampleRate = 0.0;
+    configure(12800.0, 64);
+}
+
+void TransientGenerator::configure(double sampleRate, int oversampling)
+{
+    if (sampleRate <= 0.0 || oversampling < 1) {
+        return;
+    }
+
+    m_sampleRate = sampleRate;
+    m_oversampling = std::min(oversampling, std::max(1, static_cast<int>(MAX_OVERSAMPLED_RATE / sampleRate)));
+    designFilter();
+}
+
+void TransientGenerator::designFilter()
+{
+    const int L = m_oversampling;
+
+    if (L == 1) {
+        m_taps.assign(1, 1.0);
+        m_halfSpan = 0.0;
+        return;
+    }
+
+    // Blackman-windowed sinc, odd length so the group delay is a whole number of samples
+    const int length = TAPS_PER_PHASE * L + 1;
+    const int centre = length / 2;
+    const double fc = CUTOFF / L;  // cycles per oversampled sample
+
+    m_taps.resize(length);
+    double sum = 0.0;
+    for (int n = 0; n < length; n++) {
+        double x = n - centre;
+        double sinc = (x == 0.0) ? 2.0 * fc : std::sin(2.0 * M_PI * fc * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * n / (length - 1))
+                      + 0.08 * std::cos(4.0 * M_PI * n / (length - 1));
+        m_taps[n] = sinc * window;
+        sum += m_taps[n];
+    }
+    for (auto& tap : m_taps) {
+        tap /= sum;
+    }
+
+    m_halfSpan = centre / getOversampledRate();
+}
+
+void TransientGenerator::schedule(const Transient& transient)
+{
+    if (transient.amplitude != 0.0 && transient.timeConstant > 0.0) {
+        m_transients.push_back(transient);
+    }
+}
+
+void TransientGenerator::clear()
+{
+    m_transients.clear();
+    m_burst.samples.clear();
+    m_lastBurst.samples.clear();
+    m_previousBase = 0.0;
+}
+
+double TransientGenerator::endTime(const Transient& transient)
+{
+    return transient.startTime + transient.timeConstant * DECAY_SPAN;
+}
+
+bool TransientGenerator::isActive(double startTime, double endTime) const
+{
+    for (const auto& transient : m_transients) {
+        if (transient.startTime - m_halfSpan <= endTime &&
+            TransientGenerator::endTime(transient) + m_halfSpan >= startTime) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TransientGenerator::expire(double time)
+{
+    m_transients.erase(std::remove_if(m_transients.begin(), m_transients.end(),
+                                      [this, time](const Transient& t) { return endTime(t) + m_halfSpan < time; }),
+                       m_transients.end());
+}
+
+void TransientGenerator::setCapture(bool enabled, TransientChannel channel, int phase)
+{
+    if (!enabled && !m_burst.samples.empty()) {
+        finishBurst();
+    }
+    m_captureEnabled = enabled;
+    m_captureChannel = channel;
+    m_capturePhase = std::min(std::max(phase, 0), 2);
+}
+
+void TransientGenerator::process(SampleBlock& block)
+{
+    const int count = block.count;
+    const int captureChannel = static_cast<int>(m_captureChannel);
+    const std::vector<double>* captureBase = nullptr;
+    if (m_captureEnabled && m_capturePhase < block.phases) {
+        captureBase = (m_captureChannel == TransientChannel::Voltage)
+            ? &block.voltage[m_capturePhase] : &block.current[m_capturePhase];
+    }
+
+    if (count <= 0) {
+        return;
+    }
+
+    expire(block.startTime);
+    double blockEnd = block.startTime + (count - 1) / m_sampleRate;
+
+    if (!isActive(block.startTime, blockEnd)) {
+        if (!m_burst.samples.empty()) {
+            finishBurst();
+        }
+        if (captureBase) {
+            m_previousBase = (*captureBase)[count - 1];
+        }
+        return;
+    }
+
+    // Oversampled span: every tap of every output in this block
+    const int L = m_oversampling;
+    const double oversampledRate = getOversampledRate();
+    const size_t taps = m_taps.size();
+    const size_t length = static_cast<size_t>(count - 1) * L + taps;
+    const double firstTime = block.startTime - (taps / 2) / oversampledRate;
+    const double lastTime = firstTime + (length - 1) / oversampledRate;
+
+    for (auto& channel : m_used) {
+        std::fill(channel, channel + 3, false);
+    }
+
+    for (const auto& transient : m_transients) {
+        if (transient.startTime > lastTime || endTime(transient) < firstTime) continue;
+
+        int channel = static_cast<int>(transient.channel);
+        for (int ph = 0; ph < block.phases; ph++) {
+            if (!(transient.phaseMask & (1u << ph))) continue;
+
+            std::vector<double>& buffer = m_buffer[channel][ph];
+            if (!m_used[channel][ph]) {
+                buffer.assign(length, 0.0);
+                m_used[channel][ph] = true;
+            }
+            render(transient, firstTime, length, buffer.data());
+        }
+    }
+
+    // Capture sees the block before the decimated disturbance is added
+    if (captureBase && m_used[captureChannel][m_capturePhase]) {
+        capture(block, m_buffer[captureChannel][m_capturePhase].data());
+    } else if (!m_burst.samples.empty()) {
+        finishBurst();
+    }
+    if (captureBase) {
+        m_previousBase = (*captureBase)[count - 1];
+    }
+
+    // Decimate: only the retained outputs are computed
+    const double* h = m_taps.data();
+    for (int channel = 0; channel < 2; channel++) {
+        for (int ph = 0; ph < block.phases; ph++) {
+            if (!m_used[channel][ph]) continue;
+
+            const double* x = m_buffer[channel][ph].data();
+            double* out = (channel == 0) ? block.voltage[ph].data() : block.current[ph].data();
+
+            for (int j = 0; j < count; j++) {
+                const double* xj = x + static_cast<size_t>(j) * L;
+
+                // Four partial sums keep the multiply-add pipelines busy
+                double acc0 = 0.0, acc1 = 0.0, acc2 = 0.0, acc3 = 0.0;
+                size_t k = 0;
+                for (; k + 4 <= taps; k += 4) {
+                    acc0 += h[k] * xj[k];
+                    acc1 += h[k + 1] * xj[k + 1];
+                    acc2 += h[k + 2] * xj[k + 2];
+                    acc3 += h[k + 3] * xj[k + 3];
+                }
+                for (; k < taps; k++) {
+                    acc0 += h[k] * xj[k];
+                }
+                out[j] += (acc0 + acc1) + (acc2 + acc3);
+            }
+        }
+    }
+}
+
+void TransientGenerator::render(const Transient& transient, double firstTime, size_t count, double* out) const
+{
+    const double oversampledRate = getOversampledRate();
+
+    // Each shape is a sum of damped complex exponentials, stepped by recurrence
+    Term terms[2];
+    int termCount = 1;
+    bool rectify = false;
+    const double omega = 2.0 * M_PI * transient.frequency;
+    const double decay = 1.0 / transient.timeConstant;
+
+    switch (transient.type) {
+    case TransientType::Oscillatory:
+        terms[0] = {transient.amplitude, {-decay, omega}};
+        break;
+    case TransientType::Impulse:
+        if (transient.riseTime > 0.0 && transient.riseTime < transient.timeConstant) {
+            // Normalise so the double exponential peaks at the requested amplitude
+            double tail = transient.timeConstant;
+            double front = transient.riseTime;
+            double peakTime = tail * front * std::log(tail / front) / (tail - front);
+            double peak = std::exp(-peakTime / tail) - std::exp(-peakTime / front);
+            terms[0] = {transient.amplitude / peak, {-1.0 / tail, 0.0}};
+            terms[1] = {-transient.amplitude / peak, {-1.0 / front, 0.0}};
+            termCount = 2;
+        } else {
+            terms[0] = {transient.amplitude, {-decay, 0.0}};
+        }
+        break;
+    case TransientType::Inrush:
+        terms[0] = {{0.0, -transient.amplitude}, {-decay, omega}};
+        rectify = true;
+        break;
+    }
+
+    double first = std::ceil((transient.startTime - firstTime) * oversampledRate);
+    double last = std::floor((endTime(transient) - firstTime) * oversampledRate);
+    size_t begin = static_cast<size_t>(std::max(first, 0.0));
+    size_t end = static_cast<size_t>(std::min(std::max(last + 1.0, 0.0), static_cast<double>(count)));
+    if (begin >= end) {
+        return;
+    }
+
+    const double tau = firstTime + begin / oversampledRate - transient.startTime;
+
+    for (int t = 0; t < termCount; t++) {
+        std::complex<double> value = terms[t].coefficient * std::exp(terms[t].pole * tau);
+        const std::complex<double> step = std::exp(terms[t].pole / oversampledRate);
+
+        if (rectify) {
+            for (size_t i = begin; i < end; i++) {
+                out[i] += std::max(value.real(), 0.0);
+                value *= step;
+            }
+        } else {
+            for (size_t i = begin; i < end; i++) {
+                out[i] += value.real();
+                value *= step;
+            }
+        }
+    }
+}
+
+void TransientGenerator::capture(const SampleBlock& block, const double* oversampled)
+{
+    const int L = m_oversampling;
+    const double oversampledRate = getOversampledRate();
+    const size_t centre = m_taps.size() / 2;
+    const std::vector<double>& base = (m_captureChannel == TransientChannel::Voltage)
+        ? block.voltage[m_capturePhase] : block.current[m_capturePhase];
+
+    if (m_burst.samples.empty()) {
+        m_burst.startTime = block.startTime - (L - 1) / oversampledRate;
+        m_burst.sampleRate = oversampledRate;
+        m_burst.channel = m_captureChannel;
+        m_burst.phase = m_capturePhase;
+    }
+
+    // The metering-rate waveform is interpolated up between the previous and current sample
+    double previous = m_previousBase;
+    for (int j = 0; j < block.count && m_burst.samples.size() < m_maxBurstLength; j++) {
+        double delta = (base[j] - previous) / L;
+        const double* x = oversampled + centre + static_cast<size_t>(j) * L - (L - 1);
+        for (int r = 0; r < L; r++) {
+            m_burst.samples.push_back(previous + delta * (r + 1) + x[r]);
+        }
+        previous = base[j];
+    }
+}
+
+void TransientGenerator::finishBurst()
+{
+    m_lastBurst = std::move(m_burst);
+    m_burst = TransientBurst();
+    m_burst.sampleRate = 0.0;
+}
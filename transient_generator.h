@@ -0,0 +1,99 @@
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+struct SampleBlock;
+
+enum class TransientType {
+    Oscillatory,  // step into a damped ring, e.g. capacitor switching
+    Impulse,      // double-exponential surge, e.g. 1.2/50 us lightning impulse
+    Inrush        // decaying unipolar half-cycles, e.g. transformer energisation
+};
+
+enum class TransientChannel {
+    Voltage,
+    Current
+};
+
+struct Transient {
+    TransientType type;
+    TransientChannel channel;
+    double startTime;
+    double amplitude;     // peak value in V or A
+    double frequency;     // ring frequency (Oscillatory) or mains frequency (Inrush), Hz
+    double timeConstant;  // decay, or tail time constant for Impulse, seconds
+    double riseTime;      // front time constant for Impulse, seconds
+    unsigned phaseMask;   // InjectionPhase bits
+};
+
+// Full-rate record of one transient episode on one channel
+struct TransientBurst {
+    double startTime;
+    double sampleRate;
+    TransientChannel channel;
+    int phase;
+    std::vector<double> samples;
+};
+
+// Renders fast disturbances at an oversampled rate and decimates them to the
+// metering rate through a linear-phase anti-alias FIR, adding the result to a
+// sample block. Only the disturbance is oversampled; the fundamental model
+// stays at the metering rate, and nothing runs while no transient is in flight.
+class TransientGenerator
+{
+public:
+    static constexpr double MAX_OVERSAMPLED_RATE = 1.0e6;
+
+    TransientGenerator();
+
+    // Output rate and oversampling factor; the oversampled rate is capped at 1 MS/s
+    void configure(double sampleRate, int oversampling);
+    int getOversampling() const { return m_oversampling; }
+    double getOversampledRate() const { return m_sampleRate * m_oversampling; }
+
+    void schedule(const Transient& transient);
+    void clear();
+
+    // True while any transient (including the filter's pre- and post-ringing) overlaps [start, end]
+    bool isActive(double startTime, double endTime) const;
+
+    // Adds the decimated disturbances to the block's channels
+    void process(SampleBlock& block);
+
+    // Optional capture of the oversampled composite waveform on one channel
+    void setCapture(bool enabled, TransientChannel channel = TransientChannel::Voltage, int phase = 0);
+    void setMaxBurstLength(size_t samples) { m_maxBurstLength = samples; }
+    const TransientBurst& getLastBurst() const { return m_lastBurst; }
+    bool hasBurst() const { return !m_lastBurst.samples.empty(); }
+
+private:
+    void designFilter();
+    void expire(double time);
+    void render(const Transient& transient, double firstTime, size_t count, double* out) const;
+    void capture(const SampleBlock& block, const double* oversampled);
+    void finishBurst();
+
+    static double endTime(const Transient& transient);
+
+    double m_sampleRate;
+    int m_oversampling;
+    double m_halfSpan;  // seconds covered by half the filter
+
+    std::vector<double> m_taps;
+    std::vector<Transient> m_transients;
+
+    // Scratch buffers: oversampled disturbance per channel/phase
+    std::vector<double> m_buffer[2][3];
+    bool m_used[2][3];
+
+    // Burst capture
+    bool m_captureEnabled;
+    TransientChannel m_captureChannel;
+    int m_capturePhase;
+    size_t m_maxBurstLength;
+    double m_previousBase;
+    TransientBurst m_burst;
+    TransientBurst m_lastBurst;
+};
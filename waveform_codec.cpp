@@ -0,0 +1,333 @@
+
+#include "waveform_codec.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr double MAX_CODE = 1.0e18;  // keeps second differences inside int64
+
+uint64_t lowMask(int bits)
+{
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : m_out(out), m_acc(0), m_bits(0) {}
+
+    void write(uint64_t value, int bits)
+    {
+        if (bits > 32) {
+            write(value >> 32, bits - 32);
+            bits = 32;
+        }
+        m_acc = (m_acc << bits) | (value & lowMask(bits));
+        m_bits += bits;
+        while (m_bits >= 8) {
+            m_bits -= 8;
+            m_out.push_back(static_cast<uint8_t>(m_acc >> m_bits));
+        }
+    }
+
+    void finish()
+    {
+        if (m_bits > 0) {
+            m_out.push_back(static_cast<uint8_t>(m_acc << (8 - m_bits)));
+            m_bits = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t m_acc;
+    int m_bits;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_pos(0), m_acc(0), m_bits(0) {}
+
+    uint64_t read(int bits)
+    {
+        if (bits > 32) {
+            uint64_t high = read(bits - 32);
+            return (high << 32) | read(32);
+        }
+        while (m_bits < bits) {
+            m_acc = (m_acc << 8) | (m_pos < m_size ? m_data[m_pos] : 0);
+            m_pos++;
+            m_bits += 8;
+        }
+        m_bits -= bits;
+        return (m_acc >> m_bits) & lowMask(bits);
+    }
+
+    // True when no read went past the end of the data
+    bool valid() const { return m_pos <= m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos;
+    uint64_t m_acc;
+    int m_bits;
+};
+
+template <typename T>
+void put(std::vector<uint8_t>& out, size_t offset, T value)
+{
+    std::memcpy(out.data() + offset, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const uint8_t* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t toBits(double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double fromBits(uint64_t bits)
+{
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool getVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+uint64_t zigzag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+}
+
+WaveformCodec::WaveformCodec()
+    : m_encoding(WaveformEncoding::Xor)
+    , m_quantum(0.0)
+{
+}
+
+void WaveformCodec::configure(WaveformEncoding encoding, double quantum)
+{
+    m_encoding = encoding;
+    m_quantum = quantum;
+}
+
+double WaveformCodec::quantumFor(double range, int bits)
+{
+    return range / std::ldexp(1.0, bits);
+}
+
+void WaveformCodec::encode(const double* values, size_t count, std::vector<uint8_t>& out) const
+{
+    WaveformEncoding encoding = m_encoding;
+    if (encoding == WaveformEncoding::QuantizedDelta) {
+        // Values the codes cannot represent keep the block lossless
+        bool representable = m_quantum > 0.0;
+        for (size_t i = 0; i < count && representable; i++) {
+            representable = std::abs(values[i] / m_quantum) < MAX_CODE;
+        }
+        if (!representable) encoding = WaveformEncoding::Xor;
+    }
+
+    size_t header = out.size();
+    out.resize(header + HEADER_SIZE);
+    size_t start = out.size();
+
+    switch (encoding) {
+    case WaveformEncoding::Raw:
+        out.resize(start + count * sizeof(double));
+        if (count > 0) std::memcpy(out.data() + start, values, count * sizeof(double));
+        break;
+    case WaveformEncoding::Xor:
+        encodeXor(values, count, out);
+        break;
+    case WaveformEncoding::QuantizedDelta:
+        encodeQuantized(values, count, m_quantum, out);
+        break;
+    }
+
+    // Noise-dominated doubles can grow under XOR; store those blocks as they are
+    if (encoding == WaveformEncoding::Xor && out.size() - start > count * sizeof(double)) {
+        encoding = WaveformEncoding::Raw;
+        out.resize(start + count * sizeof(double));
+        std::memcpy(out.data() + start, values, count * sizeof(double));
+    }
+
+    out[header] = static_cast<uint8_t>(encoding);
+    put(out, header + 1, static_cast<uint32_t>(count));
+    put(out, header + 5, static_cast<uint32_t>(out.size() - start));
+    put(out, header + 9, encoding == WaveformEncoding::QuantizedDelta ? m_quantum : 0.0);
+}
+
+size_t WaveformCodec::blockSize(const uint8_t* header)
+{
+    return HEADER_SIZE + get<uint32_t>(header + 5);
+}
+
+size_t WaveformCodec::decode(const uint8_t* data, size_t size, std::vector<double>& values)
+{
+    if (size < HEADER_SIZE) return 0;
+
+    WaveformEncoding encoding = static_cast<WaveformEncoding>(data[0]);
+    uint32_t count = get<uint32_t>(data + 1);
+    uint32_t payload = get<uint32_t>(data + 5);
+    double quantum = get<double>(data + 9);
+    if (payload > size - HEADER_SIZE) return 0;
+
+    const uint8_t* body = data + HEADER_SIZE;
+    bool ok = false;
+    switch (encoding) {
+    case WaveformEncoding::Raw:
+        ok = payload == count * sizeof(double);
+        if (ok) {
+            values.resize(count);
+            if (count > 0) std::memcpy(values.data(), body, payload);
+        }
+        break;
+    case WaveformEncoding::Xor:
+        // At least one bit per value after the first
+        ok = count == 0 || payload >= 8 + (count - 1) / 8;
+        if (ok) {
+            values.resize(count);
+            ok = decodeXor(body, payload, values.data(), count);
+        }
+        break;
+    case WaveformEncoding::QuantizedDelta:
+        ok = payload >= count && quantum > 0.0;
+        if (ok) {
+            values.resize(count);
+            ok = decodeQuantized(body, payload, quantum, values.data(), count);
+        }
+        break;
+    }
+    return ok ? HEADER_SIZE + payload : 0;
+}
+
+// Each XOR with the previous value is written as '0' when zero, '10' + the
+// meaningful bits when they fit the previous leading/trailing zero window, or
+// '11' + 5 bits of leading zeros + 6 bits of length - 1 + the meaningful bits.
+void WaveformCodec::encodeXor(const double* values, size_t count, std::vector<uint8_t>& out)
+{
+    if (count == 0) return;
+
+    BitWriter writer(out);
+    uint64_t previous = toBits(values[0]);
+    writer.write(previous, 64);
+
+    int windowLeading = -1, windowTrailing = 0;
+    for (size_t i = 1; i < count; i++) {
+        uint64_t bits = toBits(values[i]);
+        uint64_t x = bits ^ previous;
+        previous = bits;
+
+        if (x == 0) {
+            writer.write(0, 1);
+            continue;
+        }
+
+        int leading = __builtin_clzll(x);
+        int trailing = __builtin_ctzll(x);
+        if (leading > 31) leading = 31;
+
+        if (windowLeading >= 0 && leading >= windowLeading && trailing >= windowTrailing) {
+            writer.write(2, 2);
+            writer.write(x >> windowTrailing, 64 - windowLeading - windowTrailing);
+        } else {
+            int meaningful = 64 - leading - trailing;
+            writer.write(3, 2);
+            writer.write(leading, 5);
+            writer.write(meaningful - 1, 6);
+            writer.write(x >> trailing, meaningful);
+            windowLeading = leading;
+            windowTrailing = trailing;
+        }
+    }
+    writer.finish();
+}
+
+bool WaveformCodec::decodeXor(const uint8_t* data, size_t size, double* values, size_t count)
+{
+    if (count == 0) return true;
+
+    BitReader reader(data, size);
+    uint64_t previous = reader.read(64);
+    values[0] = fromBits(previous);
+
+    int windowLeading = 0, windowTrailing = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (reader.read(1)) {
+            if (reader.read(1)) {
+                windowLeading = static_cast<int>(reader.read(5));
+                int meaningful = static_cast<int>(reader.read(6)) + 1;
+                windowTrailing = 64 - windowLeading - meaningful;
+                if (windowTrailing < 0) return false;
+            }
+            previous ^= reader.read(64 - windowLeading - windowTrailing) << windowTrailing;
+        }
+        values[i] = fromBits(previous);
+    }
+    return reader.valid();
+}
+
+void WaveformCodec::encodeQuantized(const double* values, size_t count, double quantum, std::vector<uint8_t>& out)
+{
+    const double scale = 1.0 / quantum;
+    int64_t previous = 0, slope = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t code = std::llround(values[i] * scale);
+        putVarint(out, zigzag(code - previous - slope));
+        slope = i == 0 ? 0 : code - previous;
+        previous = code;
+    }
+}
+
+bool WaveformCodec::decodeQuantized(const uint8_t* data, size_t size, double quantum, double* values, size_t count)
+{
+    const uint8_t* end = data + size;
+    int64_t previous = 0, slope = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t residual;
+        if (!getVarint(data, end, residual)) return false;
+        int64_t code = previous + slope + unzigzag(residual);
+        slope = i == 0 ? 0 : code - previous;
+        previous = code;
+        values[i] = code * quantum;
+    }
+    return data == end;
+}
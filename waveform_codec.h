@@ -0,0 +1,55 @@
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+enum class WaveformEncoding : uint8_t {
+    Raw = 0,             // doubles as stored
+    Xor = 1,             // lossless, Gorilla-style XOR against the previous value
+    QuantizedDelta = 2   // rounded to a quantum, second differences as zig-zag varints
+};
+
+// Block codec for sample and measurement streams. Each encoded block is self
+// describing (encoding, count, payload size), so blocks can be concatenated
+// and decoded one at a time without an index.
+//
+// Xor reproduces every double bit for bit and suits slowly changing
+// measurements; a block it would enlarge is stored Raw instead. QuantizedDelta first rounds to a quantum, normally the line
+// value of one ADC LSB, then predicts each code linearly from the previous
+// two; the residuals of a sampled waveform are a few LSB and fit one or two
+// varint bytes. Decoding returns code * quantum.
+class WaveformCodec
+{
+public:
+    static constexpr size_t HEADER_SIZE = 1 + 4 + 4 + 8;  // encoding, count, payload bytes, quantum
+
+    WaveformCodec();
+
+    void configure(WaveformEncoding encoding, double quantum = 0.0);
+    WaveformEncoding getEncoding() const { return m_encoding; }
+    double getQuantum() const { return m_quantum; }
+
+    // Appends one encoded block to out
+    void encode(const double* values, size_t count, std::vector<uint8_t>& out) const;
+
+    // Decodes the block at data into values (replacing its contents); returns the
+    // bytes consumed, or 0 when the block is malformed or truncated
+    static size_t decode(const uint8_t* data, size_t size, std::vector<double>& values);
+
+    // Total size of the block whose HEADER_SIZE header bytes are given
+    static size_t blockSize(const uint8_t* header);
+
+    // Line value of one LSB for a converter spanning range (peak to peak) with bits of resolution
+    static double quantumFor(double range, int bits);
+
+private:
+    static void encodeXor(const double* values, size_t count, std::vector<uint8_t>& out);
+    static bool decodeXor(const uint8_t* data, size_t size, double* values, size_t count);
+    static void encodeQuantized(const double* values, size_t count, double quantum, std::vector<uint8_t>& out);
+    static bool decodeQuantized(const uint8_t* data, size_t size, double quantum, double* values, size_t count);
+
+    WaveformEncoding m_encoding;
+    double m_quantum;
+};